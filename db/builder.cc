@@ -6,6 +6,7 @@
 
 #include "db/filename.h"
 #include "db/dbformat.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "leveldb/db.h"
@@ -19,13 +20,19 @@ Status BuildTable(const std::string& dbname,
 		const Options& options,
 		TableCache* table_cache,
 		Iterator* iter,
+		Iterator* range_del_iter,
 		FileMetaData* meta) {
 	Status s;
 	meta->file_size = 0;
+	meta->num_range_deletions = 0;
+	meta->largest_seqno = 0;
+	meta->num_entries = 0;
+	meta->num_deletions = 0;
 	iter->SeekToFirst();
+	range_del_iter->SeekToFirst();
 
 	std::string fname = TableFileName(dbname, meta->number);
-	if (iter->Valid()) {
+	if (iter->Valid() || range_del_iter->Valid()) {
 		WritableFile* file;
 		s = env->NewWritableFile(fname, &file);
 		if (!s.ok()) {
@@ -34,18 +41,51 @@ Status BuildTable(const std::string& dbname,
 		}
 
 		TableBuilder* builder = new TableBuilder(options, file);
-		meta->smallest.DecodeFrom(iter->key());
+		bool empty = true;
+		ParsedInternalKey ikey;
 		for (; iter->Valid(); iter->Next()) {
 			Slice key = iter->key();
+			if (empty) {
+				meta->smallest.DecodeFrom(key);
+				empty = false;
+			}
 			meta->largest.DecodeFrom(key);
+			if (ParseInternalKey(key, &ikey)) {
+				if (ikey.sequence > meta->largest_seqno) {
+					meta->largest_seqno = ikey.sequence;
+				}
+				if (ikey.type == kTypeDeletion) {
+					meta->num_deletions++;
+				}
+			}
 			builder->Add(key, iter->value());
 		}
+		const Comparator* ucmp = static_cast<const InternalKeyComparator*>(
+				options.comparator)->user_comparator();
+		for (; range_del_iter->Valid(); range_del_iter->Next()) {
+			Slice key = range_del_iter->key();
+			Slice end = range_del_iter->value();
+			if (!ParseInternalKey(key, &ikey) ||
+					ucmp->Compare(ikey.user_key, end) >= 0) {
+				continue;  // Deletes nothing; must not widen the range
+			}
+			AddTombstoneToRange(options.comparator, key, end, empty,
+					&meta->smallest, &meta->largest);
+			empty = false;
+			if (ikey.sequence > meta->largest_seqno) {
+				meta->largest_seqno = ikey.sequence;
+			}
+			builder->AddRangeDeletion(key, end);
+			meta->num_range_deletions++;
+		}
 
-		// Finish and check for builder errors
-		if (s.ok()) {
+		// Finish and check for builder errors.  A table left without
+		// entries is dropped below.
+		if (s.ok() && !empty) {
 			s = builder->Finish();
 			if (s.ok()) {
 				meta->file_size = builder->FileSize();
+				meta->num_entries = builder->NumEntries();
 				assert(meta->file_size > 0);
 			}
 		} else {
@@ -69,11 +109,15 @@ Status BuildTable(const std::string& dbname,
 		}
 
 
-		if (s.ok()) {
-			// Verify that the table is usable
+		if (s.ok() && meta->file_size > 0) {
+			// Verify that the table is usable.  This also opens it, as a
+			// table of level 0, where tables built from a memtable start
+			// out (or a level or two below).
 			Iterator* it = table_cache->NewIterator(ReadOptions(),
 					meta->number,
-					meta->file_size);
+					meta->file_size,
+					NULL,
+					0);
 			s = it->status();
 			if (!s.ok()) {
 				assert(0);
@@ -86,6 +130,8 @@ Status BuildTable(const std::string& dbname,
 	// Check for input iterator errors
 	if (!iter->status().ok()) {
 		s = iter->status();
+	} else if (!range_del_iter->status().ok()) {
+		s = range_del_iter->status();
 	}
 
 	if (s.ok() && meta->file_size > 0) {
@@ -100,6 +100,30 @@ static int FLAGS_open_files = 0;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// Maximum number of threads that may work on a single compaction.
+static int FLAGS_max_subcompactions = 1;
+
+// Derive level target sizes from the size of the largest level.
+static bool FLAGS_dynamic_level_bytes = false;
+
+// Compaction style: 0 for leveled, 1 for universal compaction.
+static int FLAGS_compaction_style = 0;
+
+// LSM tree shape (use default if == 0)
+static int FLAGS_level0_file_num_compaction_trigger = 0;
+static int FLAGS_level0_slowdown_writes_trigger = 0;
+static int FLAGS_level0_stop_writes_trigger = 0;
+static int FLAGS_target_file_size_base = 0;
+static int FLAGS_target_file_size_multiplier = 0;
+static int FLAGS_max_grandparent_overlap_factor = 0;
+static int FLAGS_expanded_compaction_factor = 0;
+static int FLAGS_max_bytes_for_level_base = 0;
+static int FLAGS_max_bytes_for_level_multiplier = 0;
+
+// Level to push new memtables to at most (use default if < 0; zero
+// keeps them in level-0)
+static int FLAGS_max_mem_compact_level = -1;
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
@@ -718,6 +742,44 @@ class Benchmark {
     options.write_buffer_size = FLAGS_write_buffer_size;
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
+    options.max_subcompactions = FLAGS_max_subcompactions;
+    options.dynamic_level_bytes = FLAGS_dynamic_level_bytes;
+    options.compaction_style =
+        static_cast<leveldb::CompactionStyle>(FLAGS_compaction_style);
+    if (FLAGS_level0_file_num_compaction_trigger > 0) {
+      options.level0_file_num_compaction_trigger =
+          FLAGS_level0_file_num_compaction_trigger;
+    }
+    if (FLAGS_level0_slowdown_writes_trigger > 0) {
+      options.level0_slowdown_writes_trigger =
+          FLAGS_level0_slowdown_writes_trigger;
+    }
+    if (FLAGS_level0_stop_writes_trigger > 0) {
+      options.level0_stop_writes_trigger = FLAGS_level0_stop_writes_trigger;
+    }
+    if (FLAGS_max_mem_compact_level >= 0) {
+      options.max_mem_compact_level = FLAGS_max_mem_compact_level;
+    }
+    if (FLAGS_target_file_size_base > 0) {
+      options.target_file_size_base = FLAGS_target_file_size_base;
+    }
+    if (FLAGS_target_file_size_multiplier > 0) {
+      options.target_file_size_multiplier = FLAGS_target_file_size_multiplier;
+    }
+    if (FLAGS_max_grandparent_overlap_factor > 0) {
+      options.max_grandparent_overlap_factor =
+          FLAGS_max_grandparent_overlap_factor;
+    }
+    if (FLAGS_expanded_compaction_factor > 0) {
+      options.expanded_compaction_factor = FLAGS_expanded_compaction_factor;
+    }
+    if (FLAGS_max_bytes_for_level_base > 0) {
+      options.max_bytes_for_level_base = FLAGS_max_bytes_for_level_base;
+    }
+    if (FLAGS_max_bytes_for_level_multiplier > 0) {
+      options.max_bytes_for_level_multiplier =
+          FLAGS_max_bytes_for_level_multiplier;
+    }
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "db/db_bench.cc open error: %s\n", s.ToString().c_str());
@@ -1002,6 +1064,45 @@ nvinit_(500);
       FLAGS_bloom_bits = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--max_subcompactions=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_max_subcompactions = n;
+    } else if (sscanf(argv[i], "--dynamic_level_bytes=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_dynamic_level_bytes = n;
+    } else if (sscanf(argv[i], "--compaction_style=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_compaction_style = n;
+    } else if (sscanf(argv[i], "--level0_file_num_compaction_trigger=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_level0_file_num_compaction_trigger = n;
+    } else if (sscanf(argv[i], "--level0_slowdown_writes_trigger=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_level0_slowdown_writes_trigger = n;
+    } else if (sscanf(argv[i], "--level0_stop_writes_trigger=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_level0_stop_writes_trigger = n;
+    } else if (sscanf(argv[i], "--max_mem_compact_level=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_max_mem_compact_level = n;
+    } else if (sscanf(argv[i], "--target_file_size_base=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_target_file_size_base = n;
+    } else if (sscanf(argv[i], "--target_file_size_multiplier=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_target_file_size_multiplier = n;
+    } else if (sscanf(argv[i], "--max_grandparent_overlap_factor=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_max_grandparent_overlap_factor = n;
+    } else if (sscanf(argv[i], "--expanded_compaction_factor=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_expanded_compaction_factor = n;
+    } else if (sscanf(argv[i], "--max_bytes_for_level_base=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_max_bytes_for_level_base = n;
+    } else if (sscanf(argv[i], "--max_bytes_for_level_multiplier=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_max_bytes_for_level_multiplier = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
@@ -17,9 +17,11 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/status.h"
@@ -27,6 +29,7 @@
 #include "leveldb/table_builder.h"
 #include "port/port.h"
 #include "table/block.h"
+#include "table/format.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
@@ -48,6 +51,32 @@ struct DBImpl::Writer {
 	explicit Writer(port::Mutex* mu) : cv(mu) { }
 };
 
+// The memtables and version that a read looks at, referenced as one.
+// Guarded by mutex_.
+struct DBImpl::SuperVersion {
+	MemTable* mem;
+	MemTable* imm;
+	Version* current;
+	int refs;
+};
+
+// A thread's cached reference to the SuperVersion of one DB
+struct DBImpl::ThreadSuperVersion {
+	const uint64_t db_id;
+	DBImpl* db;        // NULL once the DB is closed; guarded by thread_sv_mutex
+	port::Mutex mu;
+	SuperVersion* sv;  // NULL if none or in use by the thread; guarded by mu
+
+	explicit ThreadSuperVersion(DBImpl* d) : db_id(d->id_), db(d), sv(NULL) { }
+};
+
+namespace {
+port::OnceType thread_sv_once = LEVELDB_ONCE_INIT;
+port::Mutex* thread_sv_mutex;          // Guards next_db_id too
+port::ThreadLocalPtr* thread_sv_lists; // std::vector<ThreadSuperVersion*>
+uint64_t next_db_id = 0;
+}  // namespace
+
 struct DBImpl::CompactionState {
 	Compaction* const compaction;
 
@@ -57,11 +86,20 @@ struct DBImpl::CompactionState {
 	// we can drop all entries for the same key with sequence numbers < S.
 	SequenceNumber smallest_snapshot;
 
+	// Entries with sequence numbers > newest_snapshot are not visible to
+	// any snapshot, so the compaction filter may delete or rewrite them.
+	// Zero if there are no snapshots.
+	SequenceNumber newest_snapshot;
+
 	// Files produced by compaction
 	struct Output {
 		uint64_t number;
 		uint64_t file_size;
 		InternalKey smallest, largest;
+		uint64_t num_range_deletions;
+		SequenceNumber largest_seqno;
+		uint64_t num_entries;
+		uint64_t num_deletions;
 	};
 	std::vector<Output> outputs;
 
@@ -71,14 +109,109 @@ struct DBImpl::CompactionState {
 
 	uint64_t total_bytes;
 
+	// Range of user keys [*start, *end) merged by this state.  A NULL
+	// bound means the range is unbounded on that side.
+	const std::string* start;
+	const std::string* end;
+
+	// Position of this state's pass over the compaction inputs
+	Compaction::Cursor cursor;
+
+	// Range deletions to copy to the outputs, clipped to [*start, *end).
+	// Each output gets the parts that fall between its first user key
+	// and the first user key of the next output, so an output never
+	// ends inside the entries of one user key while these exist.
+	std::vector<RangeTombstone> range_dels;
+
+	// Where the range deletions of the current output start, if bounded
+	std::string output_start;
+	bool has_output_start;
+
+	// Data blocks of the inputs in [*start, *end) that overlap no other
+	// input, in key order, and iterators that keep their tables open.
+	// The blocks before next_block have been passed.
+	std::vector<Compaction::IsolatedBlock> blocks;
+	std::vector<Iterator*> block_pins;
+	size_t next_block;
+
+	// Result of merging the range on a subcompaction thread
+	Status status;
+
 	Output* current_output() { return &outputs[outputs.size()-1]; }
 
+	// Return true iff some range deletion is left for the outputs
+	// from output_start on.
+	bool HasRangeDeletionsLeft(const Comparator* ucmp) const {
+		for (size_t i = 0; i < range_dels.size(); i++) {
+			if (!has_output_start ||
+					ucmp->Compare(range_dels[i].end, output_start) > 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void AddRangeDeletions(const InternalKeyComparator& icmp,
+			const Slice* limit);
+
 	explicit CompactionState(Compaction* c)
 	: compaction(c),
 	  outfile(NULL),
 	  builder(NULL),
-	  total_bytes(0) {
+	  total_bytes(0),
+	  start(NULL),
+	  end(NULL),
+	  has_output_start(false),
+	  next_block(0) {
+	}
+};
+
+// Add to the current output the parts of range_dels in
+// [output_start, *limit), or from output_start on if limit is NULL,
+// and let the next output start at *limit.
+void DBImpl::CompactionState::AddRangeDeletions(
+		const InternalKeyComparator& icmp, const Slice* limit) {
+	const Comparator* ucmp = icmp.user_comparator();
+	std::vector<RangeTombstone> fragments;
+	for (size_t i = 0; i < range_dels.size(); i++) {
+		RangeTombstone t = range_dels[i];
+		if (has_output_start && ucmp->Compare(t.begin, output_start) < 0) {
+			t.begin = output_start;
+		}
+		if (limit != NULL && ucmp->Compare(t.end, *limit) > 0) {
+			t.end = limit->ToString();
+		}
+		if (ucmp->Compare(t.begin, t.end) < 0) {
+			fragments.push_back(t);
+		}
+	}
+	SortTombstones(ucmp, &fragments);
+
+	Output* out = current_output();
+	for (size_t i = 0; i < fragments.size(); i++) {
+		const RangeTombstone& t = fragments[i];
+		InternalKey key(t.begin, t.sequence, kTypeRangeDeletion);
+		const bool empty = (builder->NumEntries() == 0 &&
+				out->num_range_deletions == 0);
+		AddTombstoneToRange(&icmp, key.Encode(), t.end, empty,
+				&out->smallest, &out->largest);
+		builder->AddRangeDeletion(key.Encode(), t.end);
+		out->num_range_deletions++;
+		if (t.sequence > out->largest_seqno) {
+			out->largest_seqno = t.sequence;
+		}
+	}
+	if (limit != NULL) {
+		output_start = limit->ToString();
+		has_output_start = true;
 	}
+}
+
+// Arguments of a thread that merges one key range of a compaction
+struct DBImpl::SubcompactionWorker {
+	DBImpl* db;
+	CompactionState* compact;
+	int* pending;  // Number of unfinished subcompactions, guarded by mutex_
 };
 
 // Fix user-supplied options to be reasonable
@@ -87,6 +220,23 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
 	if (static_cast<V>(*ptr) > maxvalue) *ptr = maxvalue;
 	if (static_cast<V>(*ptr) < minvalue) *ptr = minvalue;
 }
+static void SanitizeShapeOptions(Options* result) {
+	const uint64_t kMinBytes = 64<<10;
+	const uint64_t kMaxBytes = static_cast<uint64_t>(1) << 40;
+	ClipToRange(&result->level0_file_num_compaction_trigger, 1, 1<<20);
+	ClipToRange(&result->level0_slowdown_writes_trigger,
+			result->level0_file_num_compaction_trigger, 1<<20);
+	ClipToRange(&result->level0_stop_writes_trigger,
+			result->level0_slowdown_writes_trigger, 1<<20);
+	ClipToRange(&result->max_mem_compact_level, 0, config::kNumLevels - 1);
+	ClipToRange(&result->target_file_size_base, kMinBytes, kMaxBytes);
+	ClipToRange(&result->target_file_size_multiplier, 1, 100);
+	ClipToRange(&result->max_grandparent_overlap_factor, 1, 1000);
+	ClipToRange(&result->expanded_compaction_factor, 1, 1000);
+	ClipToRange(&result->max_bytes_for_level_base, kMinBytes, kMaxBytes);
+	ClipToRange(&result->max_bytes_for_level_multiplier, 1, 100);
+}
+
 Options SanitizeOptions(const std::string& dbname,
 		const InternalKeyComparator* icmp,
 		const InternalFilterPolicy* ipolicy,
@@ -97,6 +247,8 @@ Options SanitizeOptions(const std::string& dbname,
 	ClipToRange(&result.max_open_files,    64 + kNumNonTableCacheFiles, 50000);
 	ClipToRange(&result.write_buffer_size, 64<<10,                      1<<30);
 	ClipToRange(&result.block_size,        1<<10,                       4<<20);
+	ClipToRange(&result.max_subcompactions, 1,                          64);
+	SanitizeShapeOptions(&result);
 	if (result.info_log == NULL) {
 		// Open a log file in the same directory as the db
 		src.env->CreateDir(dbname);  // In case it does not exist
@@ -108,7 +260,9 @@ Options SanitizeOptions(const std::string& dbname,
 		}
 	}
 	if (result.block_cache == NULL) {
-		result.block_cache = NewLRUCache(8 << 20);
+		// Midpoint insertion keeps blocks read by a large scan from
+		// evicting the ones that are read repeatedly
+		result.block_cache = NewLRUCache(8 << 20, 0.0, 0.375);
 	}
 	return result;
 }
@@ -116,17 +270,21 @@ Options SanitizeOptions(const std::string& dbname,
 DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
 : env_(raw_options.env),
   internal_comparator_(raw_options.comparator),
-  internal_filter_policy_(raw_options.filter_policy),
+  internal_filter_policy_(raw_options.filter_policy,
+		  raw_options.prefix_extractor),
   options_(SanitizeOptions(dbname, &internal_comparator_,
 		  &internal_filter_policy_, raw_options)),
+		  shape_options_(options_),
 		  owns_info_log_(options_.info_log != raw_options.info_log),
 		  owns_cache_(options_.block_cache != raw_options.block_cache),
 		  dbname_(dbname),
+		  id_(NewId()),
 		  db_lock_(NULL),
 		  shutting_down_(NULL),
 		  bg_cv_(&mutex_),
 		  mem_(new MemTable(internal_comparator_)),
 		  imm_(NULL),
+		  super_version_(NULL),
 		  logfile_(NULL),
 		  logfile_number_(0),
 		  log_(NULL),
@@ -136,12 +294,14 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
 		  manual_compaction_(NULL) {
 	mem_->Ref();
 	has_imm_.Release_Store(NULL);
+	current_super_version_.Release_Store(NULL);
+	visible_sequence_.Release_Store(NULL);
 
 	// Reserve ten files or so for other uses and give the rest to TableCache.
 	const int table_cache_size = options_.max_open_files - kNumNonTableCacheFiles;
 	table_cache_ = new TableCache(dbname_, &options_, table_cache_size);
 
-	versions_ = new VersionSet(dbname_, &options_, table_cache_,
+	versions_ = new VersionSet(dbname_, &shape_options_, table_cache_,
 			&internal_comparator_);
 }
 
@@ -154,6 +314,25 @@ DBImpl::~DBImpl() {
 	}
 	mutex_.Unlock();
 
+	// Threads that outlive the DB must not touch it when they exit
+	{
+		MutexLock gl(thread_sv_mutex);
+		MutexLock l(&mutex_);
+		for (size_t i = 0; i < thread_super_versions_.size(); i++) {
+			ThreadSuperVersion* slot = thread_super_versions_[i];
+			if (slot->sv != NULL) {
+				UnrefSuperVersion(slot->sv);
+				slot->sv = NULL;
+			}
+			slot->db = NULL;
+		}
+		thread_super_versions_.clear();
+		if (super_version_ != NULL) {
+			UnrefSuperVersion(super_version_);
+			super_version_ = NULL;
+		}
+	}
+
 	if (db_lock_ != NULL) {
 		env_->UnlockFile(db_lock_);
 	}
@@ -174,6 +353,163 @@ DBImpl::~DBImpl() {
 	}
 }
 
+void DBImpl::InitThreadSuperVersions() {
+	thread_sv_mutex = new port::Mutex;
+	thread_sv_lists = new port::ThreadLocalPtr(&ReleaseThreadSuperVersions);
+}
+
+uint64_t DBImpl::NewId() {
+	port::InitOnce(&thread_sv_once, &InitThreadSuperVersions);
+	MutexLock l(thread_sv_mutex);
+	return ++next_db_id;
+}
+
+void DBImpl::ReleaseThreadSuperVersions(void* arg) {
+	std::vector<ThreadSuperVersion*>* list =
+			reinterpret_cast<std::vector<ThreadSuperVersion*>*>(arg);
+	MutexLock gl(thread_sv_mutex);
+	for (size_t i = 0; i < list->size(); i++) {
+		ThreadSuperVersion* slot = (*list)[i];
+		DBImpl* db = slot->db;
+		if (db != NULL) {
+			MutexLock l(&db->mutex_);
+			std::vector<ThreadSuperVersion*>* slots = &db->thread_super_versions_;
+			slots->erase(std::find(slots->begin(), slots->end(), slot));
+			if (slot->sv != NULL) {
+				db->UnrefSuperVersion(slot->sv);
+			}
+		}
+		delete slot;
+	}
+	delete list;
+}
+
+void DBImpl::InstallSuperVersion() {
+	mutex_.AssertHeld();
+	SuperVersion* sv = new SuperVersion;
+	sv->mem = mem_;
+	sv->imm = imm_;
+	sv->current = versions_->current();
+	sv->mem->Ref();
+	if (sv->imm != NULL) sv->imm->Ref();
+	sv->current->Ref();
+	sv->refs = 1;
+
+	SuperVersion* old = super_version_;
+	super_version_ = sv;
+	current_super_version_.Release_Store(sv);
+
+	// A thread that is using its cached reference drops it itself when
+	// done, since it will see that it is no longer current.
+	for (size_t i = 0; i < thread_super_versions_.size(); i++) {
+		ThreadSuperVersion* slot = thread_super_versions_[i];
+		slot->mu.Lock();
+		SuperVersion* cached = slot->sv;
+		slot->sv = NULL;
+		slot->mu.Unlock();
+		if (cached != NULL) {
+			UnrefSuperVersion(cached);
+		}
+	}
+	if (old != NULL) {
+		UnrefSuperVersion(old);
+	}
+}
+
+void DBImpl::UnrefSuperVersion(SuperVersion* sv) {
+	mutex_.AssertHeld();
+	assert(sv->refs > 0);
+	if (--sv->refs == 0) {
+		sv->mem->Unref();
+		if (sv->imm != NULL) sv->imm->Unref();
+		sv->current->Unref();
+		delete sv;
+	}
+}
+
+DBImpl::SuperVersion* DBImpl::AcquireSuperVersion(ThreadSuperVersion** slotptr) {
+	std::vector<ThreadSuperVersion*>* list =
+			reinterpret_cast<std::vector<ThreadSuperVersion*>*>(
+					thread_sv_lists->Get());
+	ThreadSuperVersion* slot = NULL;
+	for (size_t i = 0; list != NULL && i < list->size(); i++) {
+		if ((*list)[i]->db_id == id_) {
+			slot = (*list)[i];
+			break;
+		}
+	}
+	if (slot == NULL) {
+		// First read by this thread
+		if (list == NULL) {
+			list = new std::vector<ThreadSuperVersion*>;
+			thread_sv_lists->Set(list);
+		} else {
+			// Forget the DBs that were closed since
+			MutexLock gl(thread_sv_mutex);
+			size_t live = 0;
+			for (size_t i = 0; i < list->size(); i++) {
+				if ((*list)[i]->db == NULL) {
+					delete (*list)[i];
+				} else {
+					(*list)[live++] = (*list)[i];
+				}
+			}
+			list->resize(live);
+		}
+		slot = new ThreadSuperVersion(this);
+		list->push_back(slot);
+		MutexLock l(&mutex_);
+		thread_super_versions_.push_back(slot);
+	}
+	*slotptr = slot;
+
+	slot->mu.Lock();
+	SuperVersion* sv = slot->sv;
+	slot->sv = NULL;
+	slot->mu.Unlock();
+	if (sv != current_super_version_.Acquire_Load()) {
+		// Our reference is held, so sv cannot have been reused for the
+		// current SuperVersion.
+		MutexLock l(&mutex_);
+		if (sv != NULL) {
+			UnrefSuperVersion(sv);
+		}
+		sv = super_version_;
+		sv->refs++;
+	}
+	return sv;
+}
+
+void DBImpl::ReturnSuperVersion(ThreadSuperVersion* slot, SuperVersion* sv) {
+	// Checked under slot->mu so that either a concurrent
+	// InstallSuperVersion() finds sv in the slot, or we see that it
+	// has been replaced.
+	slot->mu.Lock();
+	const bool keep = (sv == current_super_version_.Acquire_Load());
+	if (keep) {
+		slot->sv = sv;
+	}
+	slot->mu.Unlock();
+	if (!keep) {
+		MutexLock l(&mutex_);
+		UnrefSuperVersion(sv);
+	}
+}
+
+void DBImpl::PublishLastSequence() {
+	mutex_.AssertHeld();
+	visible_sequence_.Release_Store(reinterpret_cast<void*>(
+			static_cast<uintptr_t>(versions_->LastSequence())));
+}
+
+SequenceNumber DBImpl::VisibleSequence() {
+	if (sizeof(void*) >= sizeof(SequenceNumber)) {
+		return reinterpret_cast<uintptr_t>(visible_sequence_.Acquire_Load());
+	}
+	MutexLock l(&mutex_);
+	return versions_->LastSequence();
+}
+
 Status DBImpl::NewDB() {
 	VersionEdit new_db;
 	new_db.SetComparatorName(user_comparator()->Name());
@@ -304,6 +640,15 @@ Status DBImpl::Recover(VersionEdit* edit) {
 	fprintf(stdout, "Starting recovery\n");
 
 	s = versions_->Recover();
+	if (s.ok() && options_.compaction_style == kCompactionStyleUniversal) {
+		for (int level = 1; level < config::kNumLevels; level++) {
+			if (versions_->NumLevelFiles(level) > 0) {
+				return Status::InvalidArgument(
+						dbname_, "has files outside of level-0, which universal "
+						"compaction does not support");
+			}
+		}
+	}
 	if (s.ok()) {
 		SequenceNumber max_sequence(0);
 
@@ -473,13 +818,15 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 	meta.number = versions_->NewFileNumber();
 	pending_outputs_.insert(meta.number);
 	Iterator* iter = mem->NewIterator();
+	Iterator* range_del_iter = mem->NewRangeDeletionIterator();
 	Log(options_.info_log, "Level-0 table #%llu: started",
 			(unsigned long long) meta.number);
 
 	Status s;
 	{
 		mutex_.Unlock();
-		s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+		s = BuildTable(dbname_, env_, options_, table_cache_, iter,
+				range_del_iter, &meta);
 		mutex_.Lock();
 	}
 
@@ -488,6 +835,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 			(unsigned long long) meta.file_size,
 			s.ToString().c_str());
 	delete iter;
+	delete range_del_iter;
 	pending_outputs_.erase(meta.number);
 
 
@@ -500,8 +848,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 		if (base != NULL) {
 			level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
 		}
-		edit->AddFile(level, meta.number, meta.file_size,
-				meta.smallest, meta.largest);
+		edit->AddFile(level, meta);
 	}
 
 	CompactionStats stats;
@@ -539,6 +886,7 @@ void DBImpl::CompactMemTable() {
 		imm_->Unref();
 		imm_ = NULL;
 		has_imm_.Release_Store(NULL);
+		InstallSuperVersion();
 		DeleteObsoleteFiles();
 	} else {
 		RecordBackgroundError(s);
@@ -562,6 +910,52 @@ void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
 	}
 }
 
+Status DBImpl::DeleteFilesInRange(const Slice* begin, const Slice* end) {
+	MutexLock l(&mutex_);
+
+	// Take the place of the background work, so that no compaction
+	// reads the files while they are dropped.
+	while (bg_compaction_scheduled_) {
+		bg_cv_.Wait();
+	}
+	if (!bg_error_.ok()) {
+		return bg_error_;
+	}
+	bg_compaction_scheduled_ = true;
+
+	VersionEdit edit;
+	Version* base = versions_->current();
+	int num_files = 0;
+	uint64_t bytes = 0;
+	for (int level = 0; level < config::kNumLevels; level++) {
+		std::vector<FileMetaData*> files;
+		base->GetFilesInRange(level, begin, end, &files);
+		for (size_t i = 0; i < files.size(); i++) {
+			edit.DeleteFile(level, files[i]->number);
+			num_files++;
+			bytes += files[i]->file_size;
+		}
+	}
+
+	Status s;
+	if (num_files > 0) {
+		s = versions_->LogAndApply(&edit, &mutex_);
+		if (s.ok()) {
+			InstallSuperVersion();
+			DeleteObsoleteFiles();
+		}
+		VersionSet::LevelSummaryStorage tmp;
+		Log(options_.info_log, "Deleted %d files in range, %lld bytes %s: %s\n",
+				num_files, static_cast<long long>(bytes), s.ToString().c_str(),
+				versions_->LevelSummary(&tmp));
+	}
+
+	bg_compaction_scheduled_ = false;
+	MaybeScheduleCompaction();
+	bg_cv_.SignalAll();
+	return s;
+}
+
 void DBImpl::TEST_CompactRange(int level, const Slice* begin,const Slice* end) {
 	assert(level >= 0);
 	assert(level + 1 < config::kNumLevels);
@@ -681,6 +1075,10 @@ void DBImpl::BackgroundCompaction() {
 		m->done = (c == NULL);
 		if (c != NULL) {
 			manual_end = c->input(0, c->num_input_files(0) - 1)->largest;
+			if (options_.compaction_style == kCompactionStyleUniversal) {
+				// Merging all runs has covered the whole range
+				m->done = true;
+			}
 		}
 		Log(options_.info_log,
 				"Manual compaction at level-%d from %s .. %s; will stop at %s\n",
@@ -693,27 +1091,31 @@ void DBImpl::BackgroundCompaction() {
 	}
 
 	Status status;
+	int moved = 0;
+	if (c != NULL && !is_manual) {
+		// Inputs that overlap no other input go to the next level as they are
+		moved = c->MoveNonOverlappingInputs();
+	}
 	if (c == NULL) {
 		// Nothing to do
-	} else if (!is_manual && c->IsTrivialMove()) {
-		// Move file to next level
-		assert(c->num_input_files(0) == 1);
-		FileMetaData* f = c->input(0, 0);
-		c->edit()->DeleteFile(c->level(), f->number);
-		c->edit()->AddFile(c->level() + 1, f->number, f->file_size,
-				f->smallest, f->largest);
+	} else if (c->num_input_files(0) == 0) {
 		status = versions_->LogAndApply(c->edit(), &mutex_);
-		if (!status.ok()) {
+		if (status.ok()) {
+			InstallSuperVersion();
+		} else {
 			RecordBackgroundError(status);
 		}
 		VersionSet::LevelSummaryStorage tmp;
-		Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
-				static_cast<unsigned long long>(f->number),
-				c->level() + 1,
-				static_cast<unsigned long long>(f->file_size),
+		Log(options_.info_log, "Moved %d files to level-%d %s: %s\n",
+				moved,
+				c->output_level(),
 				status.ToString().c_str(),
 				versions_->LevelSummary(&tmp));
 	} else {
+		if (moved > 0) {
+			Log(options_.info_log, "Moving %d files to level-%d unmerged",
+					moved, c->output_level());
+		}
 		CompactionState* compact = new CompactionState(c);
 		status = DoCompactionWork(compact);
 		if (!status.ok()) {
@@ -772,12 +1174,21 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
 	uint64_t file_number;
 	{
 		mutex_.Lock();
-		file_number = versions_->NewFileNumber();
+		if (compact->compaction->output_number() != 0) {
+			assert(compact->outputs.empty());
+			file_number = compact->compaction->output_number();
+		} else {
+			file_number = versions_->NewFileNumber();
+		}
 		pending_outputs_.insert(file_number);
 		CompactionState::Output out;
 		out.number = file_number;
 		out.smallest.Clear();
 		out.largest.Clear();
+		out.num_range_deletions = 0;
+		out.largest_seqno = 0;
+		out.num_entries = 0;
+		out.num_deletions = 0;
 		compact->outputs.push_back(out);
 		mutex_.Unlock();
 	}
@@ -803,6 +1214,7 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 	// Check for iterator errors
 	Status s = input->status();
 	const uint64_t current_entries = compact->builder->NumEntries();
+	compact->current_output()->num_entries = current_entries;
 	if (s.ok()) {
 		s = compact->builder->Finish();
 	} else {
@@ -824,7 +1236,8 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 	delete compact->outfile;
 	compact->outfile = NULL;
 
-	if (s.ok() && current_entries > 0) {
+	if (s.ok() && (current_entries > 0 ||
+			compact->current_output()->num_range_deletions > 0)) {
 		// Verify that the table is usable
 		Iterator* iter = table_cache_->NewIterator(ReadOptions(),
 				output_number,
@@ -849,19 +1262,30 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
 			compact->compaction->num_input_files(0),
 			compact->compaction->level(),
 			compact->compaction->num_input_files(1),
-			compact->compaction->level() + 1,
+			compact->compaction->output_level(),
 			static_cast<long long>(compact->total_bytes));
 
 	// Add compaction outputs
 	compact->compaction->AddInputDeletions(compact->compaction->edit());
-	const int level = compact->compaction->level();
+	const int level = compact->compaction->output_level();
 	for (size_t i = 0; i < compact->outputs.size(); i++) {
 		const CompactionState::Output& out = compact->outputs[i];
-		compact->compaction->edit()->AddFile(
-				level + 1,
-				out.number, out.file_size, out.smallest, out.largest);
+		FileMetaData f;
+		f.number = out.number;
+		f.file_size = out.file_size;
+		f.smallest = out.smallest;
+		f.largest = out.largest;
+		f.num_range_deletions = out.num_range_deletions;
+		f.largest_seqno = out.largest_seqno;
+		f.num_entries = out.num_entries;
+		f.num_deletions = out.num_deletions;
+		compact->compaction->edit()->AddFile(level, f);
+	}
+	Status s = versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+	if (s.ok()) {
+		InstallSuperVersion();
 	}
-	return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+	return s;
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
@@ -872,30 +1296,195 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 			compact->compaction->num_input_files(0),
 			compact->compaction->level(),
 			compact->compaction->num_input_files(1),
-			compact->compaction->level() + 1);
+			compact->compaction->output_level());
 
 	assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
 	assert(compact->builder == NULL);
 	assert(compact->outfile == NULL);
 	if (snapshots_.empty()) {
 		compact->smallest_snapshot = versions_->LastSequence();
+		compact->newest_snapshot = 0;
 	} else {
 		compact->smallest_snapshot = snapshots_.oldest()->number_;
+		compact->newest_snapshot = snapshots_.newest()->number_;
 	}
 
 	// Release mutex while we're actually doing the compaction work
 	mutex_.Unlock();
 
+	const int dropped = versions_->DropCoveredInputs(compact->compaction,
+			compact->smallest_snapshot);
+	if (dropped > 0) {
+		Log(options_.info_log,  "Dropping %d files deleted by range deletions",
+				dropped);
+	}
+
+	// Split the inputs into disjoint key ranges.  This thread merges the
+	// first range and keeps compacting imm_; every other range is merged
+	// by a thread of its own.
+	std::vector<std::string> boundaries;
+	compact->compaction->GetBoundaries(options_.max_subcompactions,
+			&boundaries);
+	std::vector<CompactionState*> subcompactions;
+	int pending = boundaries.size();
+	if (!boundaries.empty()) {
+		compact->end = &boundaries[0];
+		Log(options_.info_log,  "Splitting compaction into %d ranges",
+				static_cast<int>(boundaries.size() + 1));
+	}
+	for (size_t i = 0; i < boundaries.size(); i++) {
+		CompactionState* sub = new CompactionState(compact->compaction);
+		sub->smallest_snapshot = compact->smallest_snapshot;
+		sub->newest_snapshot = compact->newest_snapshot;
+		sub->start = &boundaries[i];
+		if (i + 1 < boundaries.size()) {
+			sub->end = &boundaries[i + 1];
+		}
+		subcompactions.push_back(sub);
+
+		SubcompactionWorker* worker = new SubcompactionWorker;
+		worker->db = this;
+		worker->compact = sub;
+		worker->pending = &pending;
+		env_->StartThread(&DBImpl::BGSubcompaction, worker);
+	}
+
+	Status status = DoCompactionRange(compact, &imm_micros);
+
+	mutex_.Lock();
+	while (pending > 0) {
+		if (imm_ != NULL && bg_error_.ok()) {
+			const uint64_t imm_start = env_->NowMicros();
+			CompactMemTable();
+			bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
+			imm_micros += (env_->NowMicros() - imm_start);
+		} else {
+			bg_cv_.Wait();
+		}
+	}
+	for (size_t i = 0; i < subcompactions.size(); i++) {
+		CompactionState* sub = subcompactions[i];
+		if (status.ok()) {
+			status = sub->status;
+		}
+		// Hand the outputs over so that they are installed, or released
+		// by CleanupCompaction(), together with our own.
+		compact->outputs.insert(compact->outputs.end(),
+				sub->outputs.begin(), sub->outputs.end());
+		compact->total_bytes += sub->total_bytes;
+		sub->outputs.clear();
+		CleanupCompaction(sub);
+	}
+	compact->end = NULL;
+
+	CompactionStats stats;
+	stats.micros = env_->NowMicros() - start_micros - imm_micros;
+	for (int which = 0; which < 2; which++) {
+		for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+			stats.bytes_read += compact->compaction->input(which, i)->file_size;
+		}
+	}
+	for (size_t i = 0; i < compact->outputs.size(); i++) {
+		stats.bytes_written += compact->outputs[i].file_size;
+	}
+
+	stats_[compact->compaction->output_level()].Add(stats);
+
+	if (status.ok()) {
+		status = InstallCompactionResults(compact);
+	}
+	if (!status.ok()) {
+		RecordBackgroundError(status);
+	}
+	VersionSet::LevelSummaryStorage tmp;
+	Log(options_.info_log,
+			"compacted to: %s", versions_->LevelSummary(&tmp));
+	return status;
+}
+
+void DBImpl::BGSubcompaction(void* arg) {
+	SubcompactionWorker* worker = reinterpret_cast<SubcompactionWorker*>(arg);
+	DBImpl* db = worker->db;
+	worker->compact->status = db->DoCompactionRange(worker->compact, NULL);
+
+	MutexLock l(&db->mutex_);
+	(*worker->pending)--;
+	db->bg_cv_.SignalAll();
+	delete worker;
+}
+
+Status DBImpl::DoCompactionRange(CompactionState* compact,
+		int64_t* imm_micros) {
 	Iterator* input = versions_->MakeInputIterator(compact->compaction);
-	input->SeekToFirst();
+	if (compact->start != NULL) {
+		InternalKey start(*compact->start, kMaxSequenceNumber,
+				kValueTypeForSeek);
+		input->Seek(start.Encode());
+	} else {
+		input->SeekToFirst();
+	}
 	Status status;
+	const Comparator* ucmp = user_comparator();
+
+	// Range deletions that every snapshot sees delete the entries they
+	// cover.  The range deletions themselves are copied to the outputs
+	// unless they are that old and no level below can hold their keys.
+	RangeDelMap drop_map(ucmp, compact->smallest_snapshot);
+	{
+		RangeDelMap all(ucmp, kMaxSequenceNumber);
+		Iterator* range_iter =
+				versions_->MakeRangeDeletionIterator(compact->compaction);
+		status = drop_map.AddTombstones(range_iter);
+		if (status.ok()) {
+			status = all.AddTombstones(range_iter);
+		}
+		delete range_iter;
+
+		const std::vector<RangeTombstone>& tombstones = all.tombstones();
+		for (size_t i = 0; status.ok() && i < tombstones.size(); i++) {
+			RangeTombstone t = tombstones[i];
+			if (compact->start != NULL &&
+					ucmp->Compare(t.begin, *compact->start) < 0) {
+				t.begin = *compact->start;
+			}
+			if (compact->end != NULL &&
+					ucmp->Compare(t.end, *compact->end) > 0) {
+				t.end = *compact->end;
+			}
+			if (ucmp->Compare(t.begin, t.end) >= 0) {
+				continue;  // Belongs to another subcompaction
+			}
+			if (t.sequence <= compact->smallest_snapshot &&
+					compact->compaction->IsBaseLevelForRange(t.begin, t.end)) {
+				continue;  // Obsolete, like the deletion markers dropped below
+			}
+			compact->range_dels.push_back(t);
+		}
+	}
+	if (compact->start != NULL) {
+		compact->output_start = *compact->start;
+		compact->has_output_start = true;
+	}
+
+	// Blocks can only be copied if no entry is filtered or covered
+	if (status.ok() && options_.compaction_filter == NULL &&
+			drop_map.empty() && compact->range_dels.empty()) {
+		compact->compaction->GetIsolatedBlocks(compact->start, compact->end,
+				&compact->blocks, &compact->block_pins);
+	}
+
 	ParsedInternalKey ikey;
 	std::string current_user_key;
 	bool has_current_user_key = false;
 	SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
-	for (; input->Valid() && !shutting_down_.Acquire_Load(); ) {
+	const CompactionFilter* filter = options_.compaction_filter;
+	std::string filtered_key;
+	std::string filtered_value;
+	const uint64_t now = env_->NowMicros();
+	bool output_full = false;  // Finish the output before the next user key
+	for (; status.ok() && input->Valid() && !shutting_down_.Acquire_Load(); ) {
 		// Prioritize immutable compaction work
-		if (has_imm_.NoBarrier_Load() != NULL) {
+		if (imm_micros != NULL && has_imm_.NoBarrier_Load() != NULL) {
 			const uint64_t imm_start = env_->NowMicros();
 			mutex_.Lock();
 			if (imm_ != NULL) {
@@ -903,18 +1492,68 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 				bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
 			}
 			mutex_.Unlock();
-			imm_micros += (env_->NowMicros() - imm_start);
+			*imm_micros += (env_->NowMicros() - imm_start);
 		}
 
 		Slice key = input->key();
-		if (compact->compaction->ShouldStopBefore(key) &&
+		Slice value = input->value();
+		if (compact->end != NULL && ParseInternalKey(key, &ikey) &&
+				user_comparator()->Compare(ikey.user_key,
+						Slice(*compact->end)) >= 0) {
+			// Reached the range of the next subcompaction
+			break;
+		}
+		if (compact->compaction->ShouldStopBefore(key, &compact->cursor) &&
 				compact->builder != NULL) {
-			status = FinishCompactionOutputFile(compact, input);
+			output_full = true;
+		}
+		if (output_full) {
+			if (compact->range_dels.empty()) {
+				status = FinishCompactionOutputFile(compact, input);
+				output_full = false;
+			} else if (ParseInternalKey(key, &ikey) && has_current_user_key &&
+					ucmp->Compare(ikey.user_key, Slice(current_user_key)) != 0) {
+				compact->AddRangeDeletions(internal_comparator_, &ikey.user_key);
+				status = FinishCompactionOutputFile(compact, input);
+				output_full = false;
+			}
 			if (!status.ok()) {
 				break;
 			}
 		}
 
+		// Copy the blocks that overlap no other input without decoding
+		// their entries
+		while (compact->next_block < compact->blocks.size() &&
+				internal_comparator_.Compare(key,
+						compact->blocks[compact->next_block].upper) > 0) {
+			compact->next_block++;
+		}
+		if (compact->next_block < compact->blocks.size()) {
+			const Compaction::IsolatedBlock& b =
+					compact->blocks[compact->next_block];
+			const int r = internal_comparator_.Compare(key, b.lower);
+			if (r > 0 || (r == 0 && b.lower_inclusive)) {
+				const int copied = CopyIsolatedBlocks(compact, key,
+						&current_user_key, &has_current_user_key,
+						&last_sequence_for_key, &output_full, &status);
+				if (!status.ok()) {
+					break;
+				}
+				if (copied > 0) {
+					// Only the copied blocks hold keys up to their upper bound
+					const std::string& upper =
+							compact->blocks[compact->next_block - 1].upper;
+					input->Seek(upper);
+					while (input->Valid() &&
+							internal_comparator_.Compare(input->key(), upper) <= 0) {
+						input->Next();
+					}
+					continue;
+				}
+			}
+		}
+
 		// Handle key/value, add to state, etc.
 		bool drop = false;
 		if (!ParseInternalKey(key, &ikey)) {
@@ -930,6 +1569,39 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 				current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
 				has_current_user_key = true;
 				last_sequence_for_key = kMaxSequenceNumber;
+
+				if (filter != NULL && ikey.type == kTypeValue &&
+						ikey.sequence > compact->newest_snapshot) {
+					// Only the newest value of a key that no snapshot can see
+					// is offered to the filter.  A deleted key becomes a
+					// deletion marker so that it keeps hiding older values.
+					bool value_changed = false;
+					filtered_value.clear();
+					if (filter->Filter(compact->compaction->level(), ikey.user_key,
+							value, &filtered_value, &value_changed)) {
+						filtered_key.clear();
+						ikey.type = kTypeDeletion;
+						AppendInternalKey(&filtered_key, ikey);
+						key = filtered_key;
+						value = Slice();
+					} else if (value_changed) {
+						value = filtered_value;
+					}
+				}
+			}
+
+			Slice user_value = value;
+			uint64_t expiry;
+			if (ikey.type == kTypeValueWithExpiry &&
+					ParseExpiringValue(&user_value, &expiry) && expiry <= now) {
+				// Reads treat an expired value as deleted whatever their
+				// snapshot, so it can be turned into a deletion marker
+				// that is dropped under the same rules as any other.
+				filtered_key.clear();
+				ikey.type = kTypeDeletion;
+				AppendInternalKey(&filtered_key, ikey);
+				key = filtered_key;
+				value = Slice();
 			}
 
 			if (last_sequence_for_key <= compact->smallest_snapshot) {
@@ -937,7 +1609,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 				drop = true;    // (A)
 			} else if (ikey.type == kTypeDeletion &&
 					ikey.sequence <= compact->smallest_snapshot &&
-					compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+					compact->compaction->IsBaseLevelForKey(ikey.user_key,
+							&compact->cursor)) {
 				// For this user key:
 				// (1) there is no data in higher levels
 				// (2) data in lower levels will have larger sequence numbers
@@ -948,6 +1621,11 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 				drop = true;
 			}
 
+			if (!drop && drop_map.ShouldDelete(ikey)) {
+				// Deleted by a range deletion that every snapshot sees
+				drop = true;
+			}
+
 			last_sequence_for_key = ikey.sequence;
 		}
 #if 0
@@ -956,7 +1634,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 				"%d smallest_snapshot: %d",
 				ikey.user_key.ToString().c_str(),
 				(int)ikey.sequence, ikey.type, kTypeValue, drop,
-				compact->compaction->IsBaseLevelForKey(ikey.user_key),
+				compact->compaction->IsBaseLevelForKey(ikey.user_key,
+						&compact->cursor),
 				(int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
@@ -968,19 +1647,27 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 					break;
 				}
 			}
+			CompactionState::Output* out = compact->current_output();
 			if (compact->builder->NumEntries() == 0) {
-				compact->current_output()->smallest.DecodeFrom(key);
+				out->smallest.DecodeFrom(key);
+			}
+			out->largest.DecodeFrom(key);
+			if (!has_current_user_key) {
+				out->largest_seqno = kMaxSequenceNumber;  // Unparsable key
+			} else {
+				if (ikey.sequence > out->largest_seqno) {
+					out->largest_seqno = ikey.sequence;
+				}
+				if (ikey.type == kTypeDeletion) {
+					out->num_deletions++;
+				}
 			}
-			compact->current_output()->largest.DecodeFrom(key);
-			compact->builder->Add(key, input->value());
+			compact->builder->Add(key, value);
 
 			// Close output file if it is big enough
 			if (compact->builder->FileSize() >=
 					compact->compaction->MaxOutputFileSize()) {
-				status = FinishCompactionOutputFile(compact, input);
-				if (!status.ok()) {
-					break;
-				}
+				output_full = true;
 			}
 		}
 
@@ -990,39 +1677,135 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 	if (status.ok() && shutting_down_.Acquire_Load()) {
 		status = Status::IOError("Deleting DB during compaction");
 	}
+	if (status.ok() && compact->builder == NULL &&
+			compact->HasRangeDeletionsLeft(ucmp)) {
+		status = OpenCompactionOutputFile(compact);
+	}
 	if (status.ok() && compact->builder != NULL) {
+		compact->AddRangeDeletions(internal_comparator_, NULL);
 		status = FinishCompactionOutputFile(compact, input);
 	}
 	if (status.ok()) {
 		status = input->status();
 	}
 	delete input;
-	input = NULL;
+	for (size_t i = 0; i < compact->block_pins.size(); i++) {
+		delete compact->block_pins[i];
+	}
+	compact->block_pins.clear();
+	compact->blocks.clear();
+	return status;
+}
 
-	CompactionStats stats;
-	stats.micros = env_->NowMicros() - start_micros - imm_micros;
-	for (int which = 0; which < 2; which++) {
-		for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-			stats.bytes_read += compact->compaction->input(which, i)->file_size;
+int DBImpl::CopyIsolatedBlocks(CompactionState* compact, const Slice& key,
+		std::string* current_user_key,
+		bool* has_current_user_key,
+		SequenceNumber* last_sequence_for_key,
+		bool* output_full, Status* status) {
+	const Comparator* ucmp = user_comparator();
+	const std::vector<Compaction::IsolatedBlock>& blocks = compact->blocks;
+	int copied = 0;
+	std::string stored;
+	while (compact->next_block < blocks.size() && !*output_full) {
+		const Compaction::IsolatedBlock& b = blocks[compact->next_block];
+		if (copied > 0) {
+			const Compaction::IsolatedBlock& prev = blocks[compact->next_block - 1];
+			if (b.table != prev.table || b.index != prev.index + 1) {
+				break;  // The next key may come from another input
+			}
+		}
+		Iterator* entries;
+		if (!b.table->ReadDataBlock(b.handle, &stored, &entries).ok()) {
+			compact->next_block++;  // Let the merge read the block instead
+			break;
 		}
-	}
-	for (size_t i = 0; i < compact->outputs.size(); i++) {
-		stats.bytes_written += compact->outputs[i].file_size;
-	}
 
-	mutex_.Lock();
-	stats_[compact->compaction->level() + 1].Add(stats);
+		// Check the entries the way the merge would, and only copy the
+		// block if it keeps all of them as they are.
+		const CompressionType type = static_cast<CompressionType>(
+				stored[stored.size() - kBlockTrailerSize]);
+		bool copy = (type == kNoCompression || type == options_.compression);
+		std::string user_key = *current_user_key;
+		bool has_user_key = *has_current_user_key;
+		SequenceNumber last_sequence = *last_sequence_for_key;
+		SequenceNumber largest_seqno = 0;
+		std::string first, last;
+		ParsedInternalKey ikey;
+		for (entries->SeekToFirst(); copy && entries->Valid(); entries->Next()) {
+			if (!ParseInternalKey(entries->key(), &ikey) ||
+					ikey.type != kTypeValue) {
+				copy = false;
+				break;
+			}
+			if (!has_user_key || ucmp->Compare(ikey.user_key,
+					Slice(user_key)) != 0) {
+				user_key.assign(ikey.user_key.data(), ikey.user_key.size());
+				has_user_key = true;
+				last_sequence = kMaxSequenceNumber;
+			}
+			if (last_sequence <= compact->smallest_snapshot) {
+				copy = false;  // Hidden by a newer entry for the same user key
+				break;
+			}
+			last_sequence = ikey.sequence;
+			if (ikey.sequence > largest_seqno) {
+				largest_seqno = ikey.sequence;
+			}
+			if (first.empty()) {
+				first = entries->key().ToString();
+			}
+			last = entries->key().ToString();
+		}
+		if (copy && (!entries->status().ok() || first.empty() ||
+				(copied == 0 && Slice(first) != key))) {
+			copy = false;
+		}
+		if (!copy) {
+			delete entries;
+			compact->next_block++;  // Merge the block instead
+			break;
+		}
+		if (copied > 0 &&
+				compact->compaction->ShouldStopBefore(first, &compact->cursor)) {
+			// Let the merge finish the output before this block
+			delete entries;
+			*output_full = true;
+			break;
+		}
 
-	if (status.ok()) {
-		status = InstallCompactionResults(compact);
-	}
-	if (!status.ok()) {
-		RecordBackgroundError(status);
+		if (compact->builder == NULL) {
+			*status = OpenCompactionOutputFile(compact);
+			if (!status->ok()) {
+				delete entries;
+				break;
+			}
+		}
+		CompactionState::Output* out = compact->current_output();
+		if (compact->builder->NumEntries() == 0) {
+			out->smallest.DecodeFrom(first);
+		}
+		out->largest.DecodeFrom(last);
+		if (largest_seqno > out->largest_seqno) {
+			out->largest_seqno = largest_seqno;
+		}
+		compact->builder->AddBlock(stored, entries);
+		delete entries;
+		*status = compact->builder->status();
+		if (!status->ok()) {
+			break;
+		}
+		*current_user_key = user_key;
+		*has_current_user_key = has_user_key;
+		*last_sequence_for_key = last_sequence;
+		compact->next_block++;
+		copied++;
+
+		if (compact->builder->FileSize() >=
+				compact->compaction->MaxOutputFileSize()) {
+			*output_full = true;
+		}
 	}
-	VersionSet::LevelSummaryStorage tmp;
-	Log(options_.info_log,
-			"compacted to: %s", versions_->LevelSummary(&tmp));
-	return status;
+	return copied;
 }
 
 namespace {
@@ -1046,11 +1829,22 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
 		SequenceNumber* latest_snapshot,
-		uint32_t* seed) {
+		uint32_t* seed,
+		RangeDelMap** range_dels) {
 	IterState* cleanup = new IterState;
 	mutex_.Lock();
 	*latest_snapshot = versions_->LastSequence();
 
+	// Collect the range deletions of the same memtables and files
+	std::vector<Iterator*> range_del_list;
+	if (range_dels != NULL) {
+		range_del_list.push_back(mem_->NewRangeDeletionIterator());
+		if (imm_ != NULL) {
+			range_del_list.push_back(imm_->NewRangeDeletionIterator());
+		}
+		versions_->current()->AddRangeDeletionIterators(options, &range_del_list);
+	}
+
 	// Collect together all needed child iterators
 	std::vector<Iterator*> list;
 	list.push_back(mem_->NewIterator());
@@ -1072,13 +1866,40 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
 
 	*seed = ++seed_;
 	mutex_.Unlock();
+
+	if (range_dels != NULL) {
+		// The references taken above keep the sources alive while the
+		// range deletions are read without holding the mutex.
+		const SequenceNumber snapshot = (options.snapshot != NULL
+				? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
+				: *latest_snapshot);
+		RangeDelMap* map = new RangeDelMap(user_comparator(), snapshot);
+		Status s;
+		for (size_t i = 0; i < range_del_list.size(); i++) {
+			if (s.ok()) {
+				s = map->AddTombstones(range_del_list[i]);
+			}
+			delete range_del_list[i];
+		}
+		if (!s.ok()) {
+			delete map;
+			delete internal_iter;
+			*range_dels = NULL;
+			return NewErrorIterator(s);
+		}
+		if (map->empty()) {
+			delete map;
+			map = NULL;
+		}
+		*range_dels = map;
+	}
 	return internal_iter;
 }
 
 Iterator* DBImpl::TEST_NewInternalIterator() {
 	SequenceNumber ignored;
 	uint32_t ignored_seed;
-	return NewInternalIterator(ReadOptions(), &ignored, &ignored_seed);
+	return NewInternalIterator(ReadOptions(), &ignored, &ignored_seed, NULL);
 }
 
 int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
@@ -1089,60 +1910,171 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
 Status DBImpl::Get(const ReadOptions& options,
 		const Slice& key,
 		std::string* value) {
+	PinnableSlice pinned;
+	Status s = Get(options, key, &pinned);
+	if (s.ok()) {
+		if (pinned.IsPinned()) {
+			value->assign(pinned.data(), pinned.size());
+		} else {
+			value->swap(*pinned.GetSelf());
+		}
+	}
+	return s;
+}
+
+Status DBImpl::Get(const ReadOptions& options,
+		const Slice& key,
+		PinnableSlice* value) {
+	value->Reset();
 	Status s;
-	MutexLock l(&mutex_);
+	ThreadSuperVersion* slot;
+	SuperVersion* sv = AcquireSuperVersion(&slot);
 	SequenceNumber snapshot;
 	if (options.snapshot != NULL) {
 		snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
 	} else {
-		snapshot = versions_->LastSequence();
+		snapshot = VisibleSequence();
 	}
 
-	MemTable* mem = mem_;
-	MemTable* imm = imm_;
-	Version* current = versions_->current();
-	mem->Ref();
-	if (imm != NULL) imm->Ref();
-	current->Ref();
-
-	bool have_stat_update = false;
 	Version::GetStats stats;
+	stats.seek_file = NULL;
+
+	// First look in the memtable, then in the immutable memtable (if any).
+	LookupKey lkey(key, snapshot);
+	const uint64_t now = env_->NowMicros();
+	if (sv->mem->Get(lkey, now, value->GetSelf(), &s) ||
+			(sv->imm != NULL && sv->imm->Get(lkey, now, value->GetSelf(), &s))) {
+		// Memtables are not pinned since releasing one needs mutex_
+		if (s.ok()) {
+			value->PinSelf();
+		}
+	} else {
+		s = sv->current->Get(options, lkey, now, value, &stats);
+	}
 
-	// Unlock while reading from files and memtables
-	{
-		mutex_.Unlock();
-		// First look in the memtable, then in the immutable memtable (if any).
-		LookupKey lkey(key, snapshot);
-		if (mem->Get(lkey, value, &s)) {
+	// Only reads that looked at more than one file charge a seek
+	if (stats.seek_file != NULL) {
+		MutexLock l(&mutex_);
+		if (sv->current->UpdateStats(stats)) {
+			MaybeScheduleCompaction();
+		}
+	}
+	ReturnSuperVersion(slot, sv);
+	return s;
+}
+
+namespace {
+// Orders indexes into a vector of keys by the keys they refer to.
+struct KeyIndexLess {
+	const Comparator* cmp;
+	const std::vector<Slice>* keys;
+	bool operator()(size_t a, size_t b) const {
+		return cmp->Compare((*keys)[a], (*keys)[b]) < 0;
+	}
+};
+}  // namespace
+
+void DBImpl::MultiGet(const ReadOptions& options,
+		const std::vector<Slice>& keys,
+		std::vector<std::string>* values,
+		std::vector<Status>* statuses) {
+	const size_t n = keys.size();
+	values->assign(n, std::string());
+	statuses->assign(n, Status());
+	if (n == 0) {
+		return;
+	}
+
+	// Visit the keys in sorted order so that the ones falling in the
+	// same table are looked up together.
+	std::vector<size_t> order(n);
+	for (size_t i = 0; i < n; i++) {
+		order[i] = i;
+	}
+	KeyIndexLess less;
+	less.cmp = user_comparator();
+	less.keys = &keys;
+	std::stable_sort(order.begin(), order.end(), less);
+
+	ThreadSuperVersion* slot;
+	SuperVersion* sv = AcquireSuperVersion(&slot);
+	SequenceNumber snapshot;
+	if (options.snapshot != NULL) {
+		snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
+	} else {
+		snapshot = VisibleSequence();
+	}
+
+	const uint64_t now = env_->NowMicros();
+	std::vector<LookupKey*> lkeys;
+	std::vector<size_t> in_files;
+	std::vector<std::string*> file_values;
+	for (size_t i = 0; i < n; i++) {
+		const size_t k = order[i];
+		LookupKey* lkey = new LookupKey(keys[k], snapshot);
+		std::string* value = &(*values)[k];
+		Status* s = &(*statuses)[k];
+		if (sv->mem->Get(*lkey, now, value, s)) {
 			// Done
-		} else if (imm != NULL && imm->Get(lkey, value, &s)) {
+		} else if (sv->imm != NULL && sv->imm->Get(*lkey, now, value, s)) {
 			// Done
 		} else {
-			s = current->Get(options, lkey, value, &stats);
-			have_stat_update = true;
+			in_files.push_back(k);
+			file_values.push_back(value);
+			lkeys.push_back(lkey);
+			continue;
 		}
-		mutex_.Lock();
+		delete lkey;
 	}
 
-	if (have_stat_update && current->UpdateStats(stats)) {
-		MaybeScheduleCompaction();
+	std::vector<Version::GetStats> stats;
+	if (!lkeys.empty()) {
+		std::vector<Status> file_statuses;
+		sv->current->MultiGet(options, lkeys, now, file_values,
+				&file_statuses, &stats);
+		for (size_t i = 0; i < in_files.size(); i++) {
+			(*statuses)[in_files[i]] = file_statuses[i];
+		}
 	}
-	mem->Unref();
-	if (imm != NULL) imm->Unref();
-	current->Unref();
-	return s;
+	for (size_t i = 0; i < lkeys.size(); i++) {
+		delete lkeys[i];
+	}
+
+	bool have_stat_update = false;
+	for (size_t i = 0; i < stats.size(); i++) {
+		if (stats[i].seek_file != NULL) {
+			have_stat_update = true;
+		}
+	}
+	if (have_stat_update) {
+		MutexLock l(&mutex_);
+		bool schedule = false;
+		for (size_t i = 0; i < stats.size(); i++) {
+			if (sv->current->UpdateStats(stats[i])) {
+				schedule = true;
+			}
+		}
+		if (schedule) {
+			MaybeScheduleCompaction();
+		}
+	}
+	ReturnSuperVersion(slot, sv);
 }
 
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
 	SequenceNumber latest_snapshot;
 	uint32_t seed;
-	Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
+	RangeDelMap* range_dels;
+	Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed,
+			&range_dels);
 	return NewDBIterator(
 			this, user_comparator(), iter,
 			(options.snapshot != NULL
 					? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
 							: latest_snapshot),
-							  seed);
+							  seed, env_->NowMicros(), range_dels,
+							  options, options_.max_sequential_skip_in_iterations,
+							  options_.prefix_extractor);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1164,13 +2096,27 @@ void DBImpl::ReleaseSnapshot(const Snapshot* s) {
 
 // Convenience methods
 Status DBImpl::Put(const WriteOptions& o, const Slice& key, const Slice& val) {
-	return DB::Put(o, key, val);
+	if (o.ttl == 0) {
+		return DB::Put(o, key, val);
+	}
+	WriteBatch batch;
+	batch.PutWithExpiry(key, val, env_->NowMicros() + o.ttl * 1000000);
+	return Write(o, &batch);
 }
 
 Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
 	return DB::Delete(options, key);
 }
 
+Status DBImpl::DeleteRange(const WriteOptions& options, const Slice& begin,
+		const Slice& end) {
+	if (user_comparator()->Compare(begin, end) >= 0) {
+		return Status::InvalidArgument("empty range deletion",
+				begin.ToString() + " >= " + end.ToString());
+	}
+	return DB::DeleteRange(options, begin, end);
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
 	Writer w(&mutex_);
 	w.batch = my_batch;
@@ -1228,6 +2174,7 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
 		if (updates == tmp_batch_) tmp_batch_->Clear();
 
 		versions_->SetLastSequence(last_sequence);
+		PublishLastSequence();
 	}
 
 	while (true) {
@@ -1312,7 +2259,8 @@ Status DBImpl::MakeRoomForWrite(bool force) {
 			break;
 		} else if (
 				allow_delay &&
-				versions_->NumLevelFiles(0) >= config::kL0_SlowdownWritesTrigger) {
+				versions_->NumLevelFiles(0) >=
+				shape_options_.level0_slowdown_writes_trigger) {
 			// We are getting close to hitting a hard limit on the number of
 			// L0 files.  Rather than delaying a single write by several
 			// seconds when we hit the hard limit, start delaying each
@@ -1332,7 +2280,8 @@ Status DBImpl::MakeRoomForWrite(bool force) {
 			// one is still being compacted, so we wait.
 			Log(options_.info_log, "Current memtable full; waiting...\n");
 			bg_cv_.Wait();
-		} else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
+		} else if (versions_->NumLevelFiles(0) >=
+				shape_options_.level0_stop_writes_trigger) {
 			// There are too many level-0 files.
 			Log(options_.info_log, "Too many L0 files; waiting...\n");
 			bg_cv_.Wait();
@@ -1356,8 +2305,10 @@ Status DBImpl::MakeRoomForWrite(bool force) {
 			has_imm_.Release_Store(imm_);
 			mem_ = new MemTable(internal_comparator_);
 			mem_->Ref();
+			InstallSuperVersion();
 			force = false;   // Do not force another compaction if have room
 			MaybeScheduleCompaction();
+			bg_cv_.SignalAll();  // Wakeup a compaction waiting on subcompactions
 		}
 	}
 	return s;
@@ -1443,6 +2394,103 @@ void DBImpl::GetApproximateSizes(
 	}
 }
 
+namespace {
+// An Options field that DB::SetOptions() may change.  Exactly one of
+// int_field and uint64_field is non-NULL.
+struct ShapeOption {
+	const char* name;
+	int Options::* int_field;
+	uint64_t Options::* uint64_field;
+};
+
+const ShapeOption kShapeOptions[] = {
+	{ "level0_file_num_compaction_trigger",
+	  &Options::level0_file_num_compaction_trigger, NULL },
+	{ "level0_slowdown_writes_trigger",
+	  &Options::level0_slowdown_writes_trigger, NULL },
+	{ "level0_stop_writes_trigger", &Options::level0_stop_writes_trigger, NULL },
+	{ "max_mem_compact_level", &Options::max_mem_compact_level, NULL },
+	{ "target_file_size_base", NULL, &Options::target_file_size_base },
+	{ "target_file_size_multiplier", &Options::target_file_size_multiplier, NULL },
+	{ "max_grandparent_overlap_factor",
+	  &Options::max_grandparent_overlap_factor, NULL },
+	{ "expanded_compaction_factor", &Options::expanded_compaction_factor, NULL },
+	{ "max_bytes_for_level_base", NULL, &Options::max_bytes_for_level_base },
+	{ "max_bytes_for_level_multiplier",
+	  &Options::max_bytes_for_level_multiplier, NULL },
+};
+const int kNumShapeOptions = sizeof(kShapeOptions) / sizeof(kShapeOptions[0]);
+
+uint64_t GetShapeOption(const Options& options, const ShapeOption& opt) {
+	if (opt.int_field != NULL) {
+		return static_cast<uint64_t>(options.*(opt.int_field));
+	}
+	return options.*(opt.uint64_field);
+}
+
+void SetShapeOption(Options* options, const ShapeOption& opt, uint64_t value) {
+	if (opt.int_field != NULL) {
+		options->*(opt.int_field) = static_cast<int>(value);
+	} else {
+		options->*(opt.uint64_field) = value;
+	}
+}
+}  // namespace
+
+Status DBImpl::SetOptions(const std::map<std::string, std::string>& new_options) {
+	MutexLock l(&mutex_);
+	Options updated = shape_options_;
+	for (std::map<std::string, std::string>::const_iterator it =
+			new_options.begin(); it != new_options.end(); ++it) {
+		const ShapeOption* opt = NULL;
+		for (int i = 0; i < kNumShapeOptions; i++) {
+			if (it->first == kShapeOptions[i].name) {
+				opt = &kShapeOptions[i];
+				break;
+			}
+		}
+		if (opt == NULL) {
+			return Status::InvalidArgument("unknown or immutable option", it->first);
+		}
+		Slice in(it->second);
+		uint64_t value;
+		if (!ConsumeDecimalNumber(&in, &value) || !in.empty() ||
+				(opt->int_field != NULL && value > (1u << 30))) {
+			return Status::InvalidArgument(it->first, "bad value " + it->second);
+		}
+		SetShapeOption(&updated, *opt, value);
+	}
+
+	// Reject, rather than silently clip, anything Open() would have clipped
+	Options sanitized = updated;
+	SanitizeShapeOptions(&sanitized);
+	for (int i = 0; i < kNumShapeOptions; i++) {
+		if (GetShapeOption(updated, kShapeOptions[i]) !=
+				GetShapeOption(sanitized, kShapeOptions[i])) {
+			return Status::InvalidArgument(kShapeOptions[i].name, "out of range");
+		}
+	}
+
+	// Copy only the shape fields: compactions read the others without
+	// holding mutex_.
+	for (int i = 0; i < kNumShapeOptions; i++) {
+		const uint64_t value = GetShapeOption(updated, kShapeOptions[i]);
+		if (value != GetShapeOption(shape_options_, kShapeOptions[i])) {
+			SetShapeOption(&shape_options_, kShapeOptions[i], value);
+			Log(options_.info_log, "SetOptions: %s = %llu",
+					kShapeOptions[i].name, static_cast<unsigned long long>(value));
+		}
+	}
+
+	// The level targets and scores depend on the new values.  A lower
+	// trigger may call for a compaction and a higher stall limit may
+	// release writers waiting in MakeRoomForWrite().
+	versions_->UpdateCompactionScore();
+	MaybeScheduleCompaction();
+	bg_cv_.SignalAll();
+	return Status::OK();
+}
+
 // Default implementations of convenience methods that subclasses of DB
 // can call if they wish
 Status DB::Put(const WriteOptions& opt, const Slice& key, const Slice& value) {
@@ -1457,6 +2505,42 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
 	return Write(opt, &batch);
 }
 
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin,
+		const Slice& end) {
+	WriteBatch batch;
+	batch.DeleteRange(begin, end);
+	return Write(opt, &batch);
+}
+
+void DB::MultiGet(const ReadOptions& options,
+		const std::vector<Slice>& keys,
+		std::vector<std::string>* values,
+		std::vector<Status>* statuses) {
+	values->assign(keys.size(), std::string());
+	statuses->resize(keys.size());
+	for (size_t i = 0; i < keys.size(); i++) {
+		(*statuses)[i] = Get(options, keys[i], &(*values)[i]);
+	}
+}
+
+Status DB::Get(const ReadOptions& options, const Slice& key,
+		PinnableSlice* value) {
+	value->Reset();
+	Status s = Get(options, key, value->GetSelf());
+	if (s.ok()) {
+		value->PinSelf();
+	}
+	return s;
+}
+
+Status DB::DeleteFilesInRange(const Slice* begin, const Slice* end) {
+	return Status::NotSupported("DeleteFilesInRange");
+}
+
+Status DB::SetOptions(const std::map<std::string, std::string>& new_options) {
+	return Status::NotSupported("SetOptions");
+}
+
 DB::~DB() { }
 
 Status DB::Open(const Options& options, const std::string& dbname,
@@ -1480,6 +2564,8 @@ Status DB::Open(const Options& options, const std::string& dbname,
 			s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
 		}
 		if (s.ok()) {
+			impl->PublishLastSequence();
+			impl->InstallSuperVersion();
 			impl->DeleteObsoleteFiles();
 			impl->MaybeScheduleCompaction();
 		}
@@ -7,6 +7,7 @@
 
 #include <deque>
 #include <set>
+#include <vector>
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
@@ -18,6 +19,7 @@
 namespace leveldb {
 
 class MemTable;
+class RangeDelMap;
 class TableCache;
 class Version;
 class VersionEdit;
@@ -31,16 +33,27 @@ class DBImpl : public DB {
   // Implementations of the DB interface
   virtual Status Put(const WriteOptions&, const Slice& key, const Slice& value);
   virtual Status Delete(const WriteOptions&, const Slice& key);
+  virtual Status DeleteRange(const WriteOptions&, const Slice& begin,
+                             const Slice& end);
   virtual Status Write(const WriteOptions& options, WriteBatch* updates);
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
                      std::string* value);
+  virtual Status Get(const ReadOptions& options,
+                     const Slice& key,
+                     PinnableSlice* value);
   virtual Iterator* NewIterator(const ReadOptions&);
   virtual const Snapshot* GetSnapshot();
   virtual void ReleaseSnapshot(const Snapshot* snapshot);
   virtual bool GetProperty(const Slice& property, std::string* value);
   virtual void GetApproximateSizes(const Range* range, int n, uint64_t* sizes);
   virtual void CompactRange(const Slice* begin, const Slice* end);
+  virtual Status DeleteFilesInRange(const Slice* begin, const Slice* end);
+  virtual Status SetOptions(const std::map<std::string, std::string>& new_options);
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -67,14 +80,46 @@ class DBImpl : public DB {
  private:
   friend class DB;
   struct CompactionState;
+  struct SubcompactionWorker;
+  struct SuperVersion;
+  struct ThreadSuperVersion;
   struct Writer;
 
+  // If range_dels is non-NULL, store in *range_dels the range
+  // deletions visible to the iterator's snapshot, or NULL if there
+  // are none.
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+                                uint32_t* seed,
+                                RangeDelMap** range_dels);
 
   Status NewDB();
 
+  // Make mem_, imm_ and the current version the SuperVersion that
+  // Get() reads from, and drop the references that threads cached to
+  // the previous one.  Called whenever any of the three changes.
+  void InstallSuperVersion() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void UnrefSuperVersion(SuperVersion* sv) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Return a reference to the installed SuperVersion, normally taken
+  // from the calling thread's cache without locking mutex_.  Pass the
+  // result and *slot to ReturnSuperVersion() when done with it.
+  SuperVersion* AcquireSuperVersion(ThreadSuperVersion** slot);
+  void ReturnSuperVersion(ThreadSuperVersion* slot, SuperVersion* sv);
+
+  // Called with the per-thread list of cached SuperVersions when a
+  // thread exits.
+  static void ReleaseThreadSuperVersions(void* list);
+  static void InitThreadSuperVersions();
+  static uint64_t NewId();
+
+  // Make versions_->LastSequence() visible to VisibleSequence().
+  void PublishLastSequence() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Return the last sequence number published by PublishLastSequence().
+  // Does not lock mutex_ where a pointer can hold a sequence number.
+  SequenceNumber VisibleSequence();
+
   // Recover the descriptor from persistent storage.  May do a significant
   // amount of work to recover recently logged updates.  Any changes to
   // be made to the descriptor are added to *edit.
@@ -113,6 +158,27 @@ class DBImpl : public DB {
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Merge the part of the compaction inputs assigned to *compact into
+  // new output files.  If imm_micros is non-NULL, also compacts imm_
+  // whenever it fills up and adds the time spent doing so to *imm_micros.
+  // REQUIRES: mutex_ is not held.
+  Status DoCompactionRange(CompactionState* compact, int64_t* imm_micros);
+  static void BGSubcompaction(void* arg);
+
+  // Copy to the output the data blocks of compact->blocks that follow
+  // each other in one input, starting with the block whose first entry
+  // is "key", without decoding them.  Stops at the first block that has
+  // an entry the merge would drop or change, or when the output should
+  // be finished, which sets *output_full.  The user key state of the
+  // merge is updated as if the entries had been merged.  Returns the
+  // number of blocks copied.
+  // REQUIRES: mutex_ is not held.
+  int CopyIsolatedBlocks(CompactionState* compact, const Slice& key,
+                         std::string* current_user_key,
+                         bool* has_current_user_key,
+                         SequenceNumber* last_sequence_for_key,
+                         bool* output_full, Status* status);
+
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
   Status InstallCompactionResults(CompactionState* compact)
@@ -123,9 +189,13 @@ class DBImpl : public DB {
   const InternalKeyComparator internal_comparator_;
   const InternalFilterPolicy internal_filter_policy_;
   const Options options_;  // options_.comparator == &internal_comparator_
+  // Copy of options_ whose LSM shape fields SetOptions() may change.
+  // Those fields are guarded by mutex_; the rest are constant.
+  Options shape_options_;
   bool owns_info_log_;
   bool owns_cache_;
   const std::string dbname_;
+  const uint64_t id_;  // Unique in the process, for per-thread caches
 
   // table_cache_ provides its own synchronization
   TableCache* table_cache_;
@@ -140,6 +210,12 @@ class DBImpl : public DB {
   MemTable* mem_;
   MemTable* imm_;                // Memtable being compacted
   port::AtomicPointer has_imm_;  // So bg thread can detect non-NULL imm_
+  SuperVersion* super_version_;
+  port::AtomicPointer current_super_version_;  // super_version_, for readers
+  port::AtomicPointer visible_sequence_;       // See PublishLastSequence()
+  // Per-thread caches of super_version_, one for each thread that has
+  // called Get().
+  std::vector<ThreadSuperVersion*> thread_super_versions_;
   WritableFile* logfile_;
   uint64_t logfile_number_;
   log::Writer* log_;
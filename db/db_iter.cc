@@ -7,8 +7,10 @@
 #include "db/filename.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
+#include "db/range_del.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/slice_transform.h"
 #include "port/port.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -49,18 +51,30 @@ class DBIter: public Iterator {
   };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, uint64_t now, RangeDelMap* range_dels,
+         const ReadOptions& options, int max_skip,
+         const SliceTransform* prefix_extractor)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
+        now_(now),
+        range_dels_(range_dels),
+        lower_bound_(options.iterate_lower_bound),
+        upper_bound_(options.iterate_upper_bound),
+        max_skip_(max_skip),
+        prefix_extractor_(options.prefix_same_as_start ? prefix_extractor
+                                                       : NULL),
         direction_(kForward),
         valid_(false),
+        has_expiry_(false),
+        has_prefix_(false),
         rnd_(seed),
         bytes_counter_(RandomPeriod()) {
   }
   virtual ~DBIter() {
     delete iter_;
+    delete range_dels_;
   }
   virtual bool Valid() const { return valid_; }
   virtual Slice key() const {
@@ -69,7 +83,14 @@ class DBIter: public Iterator {
   }
   virtual Slice value() const {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    if (direction_ == kReverse) {
+      return saved_value_;
+    }
+    Slice v = iter_->value();
+    if (has_expiry_) {
+      v = Slice(v.data(), v.size() - 8);
+    }
+    return v;
   }
   virtual Status status() const {
     if (status_.ok()) {
@@ -89,6 +110,22 @@ class DBIter: public Iterator {
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
+  ValueType EffectiveType(const ParsedInternalKey& ikey);
+
+  bool BeforeLowerBound(const Slice& user_key) const {
+    return lower_bound_ != NULL &&
+           user_comparator_->Compare(user_key, *lower_bound_) < 0;
+  }
+  bool AtOrPastUpperBound(const Slice& user_key) const {
+    return upper_bound_ != NULL &&
+           user_comparator_->Compare(user_key, *upper_bound_) >= 0;
+  }
+
+  bool OutsidePrefix(const Slice& user_key) const {
+    return has_prefix_ &&
+           (!prefix_extractor_->InDomain(user_key) ||
+            prefix_extractor_->Transform(user_key) != Slice(prefix_));
+  }
 
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
@@ -112,12 +149,21 @@ class DBIter: public Iterator {
   const Comparator* const user_comparator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  uint64_t const now_;
+  RangeDelMap* const range_dels_;  // NULL if there are no range deletions
+  const Slice* const lower_bound_;  // Inclusive; NULL if unbounded
+  const Slice* const upper_bound_;  // Exclusive; NULL if unbounded
+  const int max_skip_;
+  const SliceTransform* const prefix_extractor_;  // NULL unless prefix seek
 
   Status status_;
   std::string saved_key_;     // == current key when direction_==kReverse
   std::string saved_value_;   // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  bool has_expiry_;           // Current entry (kForward) carries an expiry
+  bool has_prefix_;           // Limited to keys with prefix_ by Seek()
+  std::string prefix_;
 
   Random rnd_;
   ssize_t bytes_counter_;
@@ -143,6 +189,24 @@ inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
   }
 }
 
+// Return the type of the entry iter_ is positioned at, reporting an
+// expired value or one deleted by a range deletion as a deletion.
+inline ValueType DBIter::EffectiveType(const ParsedInternalKey& ikey) {
+  if (range_dels_ != NULL && range_dels_->ShouldDelete(ikey)) {
+    return kTypeDeletion;
+  }
+  if (ikey.type != kTypeValueWithExpiry) {
+    return ikey.type;
+  }
+  Slice v = iter_->value();
+  uint64_t expiry;
+  if (!ParseExpiringValue(&v, &expiry)) {
+    status_ = Status::Corruption("bad expiring value in DBIter");
+    return kTypeDeletion;
+  }
+  return (expiry > now_) ? kTypeValueWithExpiry : kTypeDeletion;
+}
+
 void DBIter::Next() {
   assert(valid_);
 
@@ -174,26 +238,57 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   // Loop until we hit an acceptable entry to yield
   assert(iter_->Valid());
   assert(direction_ == kForward);
+  int num_skipped = 0;
   do {
     ParsedInternalKey ikey;
-    if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
-      switch (ikey.type) {
-        case kTypeDeletion:
-          // Arrange to skip all upcoming entries for this key since
-          // they are hidden by this deletion.
-          SaveKey(ikey.user_key, skip);
-          skipping = true;
-          break;
-        case kTypeValue:
-          if (skipping &&
-              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
-            // Entry hidden
-          } else {
-            valid_ = true;
-            saved_key_.clear();
-            return;
-          }
-          break;
+    if (ParseKey(&ikey)) {
+      if (AtOrPastUpperBound(ikey.user_key) || OutsidePrefix(ikey.user_key)) {
+        break;
+      }
+      if (ikey.sequence <= sequence_) {
+        const ValueType type = EffectiveType(ikey);
+        switch (type) {
+          case kTypeDeletion:
+            // Arrange to skip all upcoming entries for this key since
+            // they are hidden by this deletion.
+            SaveKey(ikey.user_key, skip);
+            skipping = true;
+            break;
+          case kTypeValue:
+          case kTypeValueWithExpiry:
+            if (skipping &&
+                user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+              // Entry hidden
+            } else {
+              valid_ = true;
+              has_expiry_ = (type == kTypeValueWithExpiry);
+              saved_key_.clear();
+              return;
+            }
+            break;
+          case kTypeRangeDeletion:
+            break;  // Kept apart from point entries
+        }
+      }
+
+      // Seek over runs of skipped entries instead of stepping through
+      if (++num_skipped > max_skip_) {
+        std::string target;
+        if (ikey.sequence > sequence_) {
+          // To the newest version of this key visible at our snapshot
+          AppendInternalKey(&target, ParsedInternalKey(
+              ikey.user_key, sequence_, kValueTypeForSeek));
+        } else if (skipping &&
+                   user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+          // To the oldest possible version of the hidden key
+          AppendInternalKey(&target, ParsedInternalKey(
+              *skip, 0, kTypeDeletion));
+        }
+        if (!target.empty()) {
+          num_skipped = 0;
+          iter_->Seek(target);
+          continue;
+        }
       }
     }
     iter_->Next();
@@ -236,18 +331,25 @@ void DBIter::FindPrevUserEntry() {
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
-      if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      if (!ParseKey(&ikey)) {
+        // Skip the corrupt entry
+      } else if (BeforeLowerBound(ikey.user_key)) {
+        break;
+      } else if (ikey.sequence <= sequence_) {
         if ((value_type != kTypeDeletion) &&
             user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
-        value_type = ikey.type;
+        value_type = EffectiveType(ikey);
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
         } else {
           Slice raw_value = iter_->value();
+          if (value_type == kTypeValueWithExpiry) {
+            raw_value = Slice(raw_value.data(), raw_value.size() - 8);
+          }
           if (saved_value_.capacity() > raw_value.size() + 1048576) {
             std::string empty;
             swap(empty, saved_value_);
@@ -275,8 +377,14 @@ void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
   ClearSavedValue();
   saved_key_.clear();
+  const Slice start = BeforeLowerBound(target) ? *lower_bound_ : target;
+  has_prefix_ = prefix_extractor_ != NULL && prefix_extractor_->InDomain(start);
+  if (has_prefix_) {
+    Slice prefix = prefix_extractor_->Transform(start);
+    prefix_.assign(prefix.data(), prefix.size());
+  }
   AppendInternalKey(
-      &saved_key_, ParsedInternalKey(target, sequence_, kValueTypeForSeek));
+      &saved_key_, ParsedInternalKey(start, sequence_, kValueTypeForSeek));
   iter_->Seek(saved_key_);
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
@@ -286,8 +394,13 @@ void DBIter::Seek(const Slice& target) {
 }
 
 void DBIter::SeekToFirst() {
+  if (lower_bound_ != NULL) {
+    Seek(*lower_bound_);
+    return;
+  }
   direction_ = kForward;
   ClearSavedValue();
+  has_prefix_ = false;
   iter_->SeekToFirst();
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
@@ -299,7 +412,21 @@ void DBIter::SeekToFirst() {
 void DBIter::SeekToLast() {
   direction_ = kReverse;
   ClearSavedValue();
-  iter_->SeekToLast();
+  has_prefix_ = false;
+  if (upper_bound_ != NULL) {
+    // Position at the last entry before the upper bound
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_, ParsedInternalKey(
+        *upper_bound_, kMaxSequenceNumber, kValueTypeForSeek));
+    iter_->Seek(saved_key_);
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else {
+      iter_->SeekToLast();
+    }
+  } else {
+    iter_->SeekToLast();
+  }
   FindPrevUserEntry();
 }
 
@@ -310,8 +437,14 @@ Iterator* NewDBIterator(
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
     SequenceNumber sequence,
-    uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+    uint32_t seed,
+    uint64_t now,
+    RangeDelMap* range_dels,
+    const ReadOptions& options,
+    int max_skip,
+    const SliceTransform* prefix_extractor) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    now, range_dels, options, max_skip, prefix_extractor);
 }
 
 }  // namespace leveldb
@@ -11,17 +11,31 @@
 
 namespace leveldb {
 
+class RangeDelMap;
+
 class DBImpl;
+class SliceTransform;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Values that expired at or before time
+// "now" are skipped, as are entries deleted by "*range_dels" (may be
+// NULL), and user keys outside the iterate bounds of "options".  After
+// skipping "max_skip" consecutive entries the iterator seeks past the
+// rest.  With options.prefix_same_as_start, "prefix_extractor" (may be
+// NULL) limits each Seek() to keys that share the target's prefix.
+// Takes ownership of "range_dels".
 extern Iterator* NewDBIterator(
     DBImpl* db,
     const Comparator* user_key_comparator,
     Iterator* internal_iter,
     SequenceNumber sequence,
-    uint32_t seed);
+    uint32_t seed,
+    uint64_t now,
+    RangeDelMap* range_dels,
+    const ReadOptions& options,
+    int max_skip,
+    const SliceTransform* prefix_extractor);
 
 }  // namespace leveldb
 
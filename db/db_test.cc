@@ -3,7 +3,9 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "leveldb/db.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/slice_transform.h"
 #include "db/db_impl.h"
 #include "db/filename.h"
 #include "db/version_set.h"
@@ -369,6 +371,19 @@ class DBTest {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeValueWithExpiry: {
+              Slice value = iter->value();
+              uint64_t expiry;
+              if (ParseExpiringValue(&value, &expiry)) {
+                result += value.ToString();
+              } else {
+                result += "CORRUPTED";
+              }
+              break;
+            }
+            case kTypeRangeDeletion:
+              result += "MISPLACED";
+              break;
           }
         }
         iter->Next();
@@ -508,6 +523,48 @@ class DBTest {
     }
     return files_renamed;
   }
+
+  // Returns the number of table files in the DB directory, live or not.
+  int CountTableFiles() {
+    std::vector<std::string> filenames;
+    env_->GetChildren(dbname_, &filenames);
+    uint64_t number;
+    FileType type;
+    int result = 0;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (ParseFileName(filenames[i], &number, &type) && type == kTableFile) {
+        result++;
+      }
+    }
+    return result;
+  }
+
+  // Returns the number of data blocks in all table files.
+  int CountDataBlocks() {
+    std::vector<std::string> filenames;
+    ASSERT_OK(env_->GetChildren(dbname_, &filenames));
+    uint64_t number;
+    FileType type;
+    int blocks = 0;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (ParseFileName(filenames[i], &number, &type) && type == kTableFile) {
+        const std::string fname = TableFileName(dbname_, number);
+        uint64_t size;
+        RandomAccessFile* file;
+        ASSERT_OK(env_->GetFileSize(fname, &size));
+        ASSERT_OK(env_->NewRandomAccessFile(fname, &file));
+        Table* table;
+        ASSERT_OK(Table::Open(Options(), file, size, &table));
+        std::vector<std::string> keys;
+        std::vector<std::string> handles;
+        table->GetDataBlockHandles(&keys, &handles);
+        blocks += handles.size();
+        delete table;
+        delete file;
+      }
+    }
+    return blocks;
+  }
 };
 
 
@@ -703,193 +760,1371 @@ TEST(DBTest, IterSingle) {
   iter->Prev();
   ASSERT_EQ(IterStatus(iter), "(invalid)");
 
-  iter->Seek("");
-  ASSERT_EQ(IterStatus(iter), "a->va");
-  iter->Next();
-  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  iter->Seek("");
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+  iter->Seek("a");
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+  iter->Seek("b");
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+  delete iter;
+}
+
+TEST(DBTest, IterMulti) {
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("b", "vb"));
+  ASSERT_OK(Put("c", "vc"));
+  Iterator* iter = db_->NewIterator(ReadOptions());
+
+  iter->SeekToFirst();
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "b->vb");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "c->vc");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  iter->SeekToFirst();
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+  iter->SeekToLast();
+  ASSERT_EQ(IterStatus(iter), "c->vc");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b->vb");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  iter->SeekToLast();
+  ASSERT_EQ(IterStatus(iter), "c->vc");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+  iter->Seek("");
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Seek("a");
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Seek("ax");
+  ASSERT_EQ(IterStatus(iter), "b->vb");
+  iter->Seek("b");
+  ASSERT_EQ(IterStatus(iter), "b->vb");
+  iter->Seek("z");
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+  // Switch from reverse to forward
+  iter->SeekToLast();
+  iter->Prev();
+  iter->Prev();
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "b->vb");
+
+  // Switch from forward to reverse
+  iter->SeekToFirst();
+  iter->Next();
+  iter->Next();
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b->vb");
+
+  // Make sure iter stays at snapshot
+  ASSERT_OK(Put("a",  "va2"));
+  ASSERT_OK(Put("a2", "va3"));
+  ASSERT_OK(Put("b",  "vb2"));
+  ASSERT_OK(Put("c",  "vc2"));
+  ASSERT_OK(Delete("b"));
+  iter->SeekToFirst();
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "b->vb");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "c->vc");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  iter->SeekToLast();
+  ASSERT_EQ(IterStatus(iter), "c->vc");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b->vb");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+  delete iter;
+}
+
+TEST(DBTest, IterSmallAndLargeMix) {
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("b", std::string(100000, 'b')));
+  ASSERT_OK(Put("c", "vc"));
+  ASSERT_OK(Put("d", std::string(100000, 'd')));
+  ASSERT_OK(Put("e", std::string(100000, 'e')));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+
+  iter->SeekToFirst();
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "b->" + std::string(100000, 'b'));
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "c->vc");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "d->" + std::string(100000, 'd'));
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "e->" + std::string(100000, 'e'));
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+  iter->SeekToLast();
+  ASSERT_EQ(IterStatus(iter), "e->" + std::string(100000, 'e'));
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "d->" + std::string(100000, 'd'));
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "c->vc");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b->" + std::string(100000, 'b'));
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+  delete iter;
+}
+
+TEST(DBTest, IterMultiWithDelete) {
+  do {
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("b", "vb"));
+    ASSERT_OK(Put("c", "vc"));
+    ASSERT_OK(Delete("b"));
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    iter->Seek("c");
+    ASSERT_EQ(IterStatus(iter), "c->vc");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "a->va");
+    delete iter;
+  } while (ChangeOptions());
+}
+#endif
+
+TEST(DBTest, Recover) {
+  do {
+    ASSERT_OK(Put("foo", "v1"));
+    ASSERT_OK(Put("baz", "v5"));
+
+    Reopen();
+    ASSERT_EQ("v1", Get("foo"));
+
+    ASSERT_EQ("v1", Get("foo"));
+    ASSERT_EQ("v5", Get("baz"));
+    ASSERT_OK(Put("bar", "v2"));
+    ASSERT_OK(Put("foo", "v3"));
+
+    Reopen();
+    ASSERT_EQ("v3", Get("foo"));
+    ASSERT_OK(Put("foo", "v4"));
+    ASSERT_EQ("v4", Get("foo"));
+    ASSERT_EQ("v2", Get("bar"));
+    ASSERT_EQ("v5", Get("baz"));
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, RecoveryWithEmptyLog) {
+  do {
+    ASSERT_OK(Put("foo", "v1"));
+    ASSERT_OK(Put("foo", "v2"));
+    Reopen();
+    Reopen();
+    ASSERT_OK(Put("foo", "v3"));
+    Reopen();
+    ASSERT_EQ("v3", Get("foo"));
+  } while (ChangeOptions());
+}
+
+static std::string Key(int i) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "key%06d", i);
+  return std::string(buf);
+}
+
+TEST(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 1000000;
+  options.max_subcompactions = 4;
+  Reopen(&options);
+
+  // Write in random order so that every level-0 file spans the key range
+  Random rnd(301);
+  const int N = 10000;
+  std::vector<int> order;
+  for (int i = 0; i < N; i++) {
+    order.push_back(i);
+  }
+  for (int i = N - 1; i > 0; i--) {
+    std::swap(order[i], order[rnd.Uniform(i + 1)]);
+  }
+  std::vector<std::string> values(N);
+  for (int i = 0; i < N; i++) {
+    values[order[i]] = RandomString(&rnd, 1000);
+    ASSERT_OK(Put(Key(order[i]), values[order[i]]));
+  }
+  for (int i = 0; i < N; i += 7) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  ASSERT_GT(NumTableFilesAtLevel(1), 1);
+
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Get(Key(i)), (i % 7 == 0) ? "NOT_FOUND" : values[i]);
+  }
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  std::string last;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_GT(iter->key().ToString(), last);
+    last = iter->key().ToString();
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  delete iter;
+  ASSERT_EQ(count, N - (N + 6) / 7);
+}
+
+TEST(DBTest, DynamicLevelBytes) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  options.dynamic_level_bytes = true;
+  Reopen(&options);
+
+  Random rnd(301);
+  const int N = 2000;
+  std::vector<std::string> values(N);
+  for (int i = 0; i < N; i++) {
+    values[i] = RandomString(&rnd, 1000);
+    ASSERT_OK(Put(Key(i), values[i]));
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+
+  // A small database is compacted straight into the last level
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  ASSERT_EQ(TotalTableFiles(), NumTableFilesAtLevel(config::kNumLevels - 1));
+
+  Reopen(&options);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+  }
+}
+
+TEST(DBTest, ShapeOptionDefaults) {
+  Options options;
+  ASSERT_EQ(config::kL0_CompactionTrigger,
+            options.level0_file_num_compaction_trigger);
+  ASSERT_EQ(config::kL0_SlowdownWritesTrigger,
+            options.level0_slowdown_writes_trigger);
+  ASSERT_EQ(config::kL0_StopWritesTrigger, options.level0_stop_writes_trigger);
+  ASSERT_EQ(config::kMaxMemCompactLevel, options.max_mem_compact_level);
+}
+
+TEST(DBTest, SetOptions) {
+  std::map<std::string, std::string> opts;
+  opts["no_such_option"] = "1";
+  ASSERT_TRUE(!db_->SetOptions(opts).ok());
+  opts.clear();
+  opts["level0_file_num_compaction_trigger"] = "four";
+  ASSERT_TRUE(!db_->SetOptions(opts).ok());
+  opts.clear();
+  opts["level0_stop_writes_trigger"] = "1";  // Below the slowdown trigger
+  ASSERT_TRUE(!db_->SetOptions(opts).ok());
+
+  // Memtables are no longer pushed past level-0
+  opts.clear();
+  opts["max_mem_compact_level"] = "0";
+  ASSERT_OK(db_->SetOptions(opts));
+  ASSERT_OK(Put("bar", "v1"));
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("1", FilesPerLevel());
+
+  // Lowering the trigger schedules a compaction of the level-0 files
+  ASSERT_OK(Put("bar", "v2"));
+  ASSERT_OK(Put("foo", "v2"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("2", FilesPerLevel());
+  opts.clear();
+  opts["level0_file_num_compaction_trigger"] = "2";
+  ASSERT_OK(db_->SetOptions(opts));
+  for (int i = 0; i < 100 && NumTableFilesAtLevel(0) > 0; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ("0,1", FilesPerLevel());
+  ASSERT_EQ("v2", Get("foo"));
+  ASSERT_EQ("v2", Get("bar"));
+}
+
+namespace {
+// Deletes values equal to "expired" and rewrites "old" to "new"
+class ExpiringFilter : public CompactionFilter {
+ public:
+  virtual const char* Name() const { return "ExpiringFilter"; }
+  virtual bool Filter(int level, const Slice& key, const Slice& existing_value,
+                      std::string* new_value, bool* value_changed) const {
+    if (existing_value == "expired") {
+      return true;
+    }
+    if (existing_value == "old") {
+      new_value->assign("new");
+      *value_changed = true;
+    }
+    return false;
+  }
+};
+}  // namespace
+
+TEST(DBTest, CompactionFilter) {
+  ExpiringFilter filter;
+  Options options = CurrentOptions();
+  options.compaction_filter = &filter;
+  options.max_mem_compact_level = 0;
+  Reopen(&options);
+
+  ASSERT_OK(Put("d", "v1"));
+  ASSERT_OK(Put("d", "expired"));
+  ASSERT_OK(Put("e", "expired"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Put("a", "expired"));
+  ASSERT_OK(Put("b", "old"));
+  ASSERT_OK(Put("c", "live"));
+
+  // Flushing the memtable does not filter
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("expired", Get("a"));
+  ASSERT_EQ("old", Get("b"));
+
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ("0,1", FilesPerLevel());
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("[ DEL ]", AllEntriesFor("a"));
+  ASSERT_EQ("new", Get("b"));
+  ASSERT_EQ("live", Get("c"));
+
+  // Values visible to the snapshot are kept
+  ASSERT_EQ("expired", Get("d"));
+  ASSERT_EQ("expired", Get("d", snapshot));
+  ASSERT_EQ("expired", Get("e", snapshot));
+
+  // A deleted key does not expose its older values
+  db_->ReleaseSnapshot(snapshot);
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_EQ("NOT_FOUND", Get("d"));
+  ASSERT_EQ("[ ]", AllEntriesFor("a"));
+  ASSERT_EQ("[ ]", AllEntriesFor("d"));
+  ASSERT_EQ("[ ]", AllEntriesFor("e"));
+  ASSERT_EQ("new", Get("b"));
+}
+
+TEST(DBTest, ExpiringValues) {
+  Options options = CurrentOptions();
+  options.max_mem_compact_level = 0;
+  Reopen(&options);
+
+  const uint64_t now = env_->NowMicros();
+  const uint64_t kHour = 3600;
+  ASSERT_OK(Put("a", "v1"));
+  WriteBatch batch;
+  batch.PutWithExpiry("a", "v2", now - 1);
+  batch.PutWithExpiry("b", "v2", now + kHour * 1000000);
+  ASSERT_OK(db_->Write(WriteOptions(), &batch));
+  WriteOptions write_options;
+  write_options.ttl = kHour;
+  ASSERT_OK(db_->Put(write_options, "c", "v3"));
+
+  // An expired value hides older values like a deletion
+  for (int i = 0; i < 2; i++) {
+    ASSERT_EQ("NOT_FOUND", Get("a"));
+    ASSERT_EQ("v2", Get("b"));
+    ASSERT_EQ("v3", Get("c"));
+    ASSERT_EQ("(b->v2)(c->v3)", Contents());
+    Reopen(&options);  // Recover from the log into a level-0 table
+  }
+  ASSERT_EQ("1", FilesPerLevel());
+  ASSERT_EQ("[ v2, v1 ]", AllEntriesFor("a"));
+
+  // Compaction discards the expired value along with what it hides
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ("[ ]", AllEntriesFor("a"));
+  ASSERT_EQ("[ v2 ]", AllEntriesFor("b"));
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("(b->v2)(c->v3)", Contents());
+}
+
+TEST(DBTest, IntraL0Compaction) {
+  Options options = CurrentOptions();
+  options.max_mem_compact_level = 0;
+  options.level0_file_num_compaction_trigger = 4;
+  options.level0_slowdown_writes_trigger = 4;
+  Reopen(&options);
+
+  // Level-1 data overlapping every level-0 file
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), "old"));
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ("0,1", FilesPerLevel());
+
+  // At the slowdown trigger the level-0 files are merged among
+  // themselves instead of into level-1
+  for (int f = 0; f < 4; f++) {
+    ASSERT_OK(Put(Key(0), "new" + NumberToString(f)));
+    ASSERT_OK(Put(Key(99), "new" + NumberToString(f)));
+    dbfull()->TEST_CompactMemTable();
+  }
+  for (int i = 0; i < 100 && NumTableFilesAtLevel(0) > 1; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ("1,1", FilesPerLevel());
+  ASSERT_EQ("new3", Get(Key(0)));
+  ASSERT_EQ("old", Get(Key(50)));
+  ASSERT_EQ("new3", Get(Key(99)));
+}
+
+TEST(DBTest, DeletionTriggeredCompaction) {
+  Options options = CurrentOptions();
+  options.deletion_compaction_ratio = 0.5;
+  options.deletion_compaction_min_entries = 10;
+  Reopen(&options);
+
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  // No level is over its size target, but the file of deletion markers
+  // is pushed into level-2, where it is dropped along with the values
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < 100 && FilesPerLevel() != ""; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ("", FilesPerLevel());
+  ASSERT_EQ("NOT_FOUND", Get(Key(50)));
+}
+
+TEST(DBTest, DeletionTriggeredCompactionWithoutOverlap) {
+  Options options = CurrentOptions();
+  options.deletion_compaction_ratio = 0.5;
+  options.deletion_compaction_min_entries = 10;
+  options.max_mem_compact_level = 0;
+  Reopen(&options);
+
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  // The deletion markers overlap nothing below them.  The file is
+  // rewritten rather than moved down level by level, which drops them.
+  for (int i = 200; i < 300; i++) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < 100 && FilesPerLevel() != "0,0,1"; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_EQ("[ ]", AllEntriesFor(Key(250)));
+  ASSERT_EQ("v", Get(Key(50)));
+}
+
+TEST(DBTest, MoveNonOverlappingFiles) {
+  Options options = CurrentOptions();
+  options.max_mem_compact_level = 0;
+  Reopen(&options);
+
+  // Level-0 files that overlap neither each other nor level-1 are moved
+  // to level-1 together instead of being merged
+  for (int f = 0; f < 4; f++) {
+    ASSERT_OK(Put(Key(10 * f), "v" + NumberToString(f)));
+    ASSERT_OK(Put(Key(10 * f + 1), "v" + NumberToString(f)));
+    dbfull()->TEST_CompactMemTable();
+  }
+  for (int i = 0; i < 100 && NumTableFilesAtLevel(0) > 0; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ("0,4", FilesPerLevel());
+
+  for (int f = 0; f < 4; f++) {
+    ASSERT_EQ("v" + NumberToString(f), Get(Key(10 * f)));
+    ASSERT_EQ("v" + NumberToString(f), Get(Key(10 * f + 1)));
+  }
+}
+
+TEST(DBTest, CompactionCopiesBlocks) {
+  Options options = CurrentOptions();
+  options.max_mem_compact_level = 0;
+  Reopen(&options);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_OK(Put(Key(i), std::string(100, 'a' + i % 26)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ("0,1", FilesPerLevel());
+  const int blocks = CountDataBlocks();
+
+  // With small blocks, a merged file would have many more of them.
+  // Only the block holding the new entry is rebuilt.
+  options.block_size = 256;
+  Reopen(&options);
+  ASSERT_OK(Put(Key(500), "new"));
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ("0,1", FilesPerLevel());
+  ASSERT_LT(CountDataBlocks(), blocks + 20);
+
+  ASSERT_EQ("new", Get(Key(500)));
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    const int i = count++;
+    if (i != 500) {
+      ASSERT_EQ(Key(i), iter->key().ToString());
+      ASSERT_EQ(std::string(100, 'a' + i % 26), iter->value().ToString());
+    }
+  }
+  ASSERT_EQ(1000, count);
+  delete iter;
+}
+
+TEST(DBTest, MultiGet) {
+  // Spread the keys over a deeper level, level-0 and the memtable.
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), "old" + Key(i)));
+  }
+  Compact(Key(0), Key(99));
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  for (int i = 0; i < 100; i += 3) {
+    ASSERT_OK(Put(Key(i), "l0" + Key(i)));
+  }
+  ASSERT_OK(Delete(Key(10)));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put(Key(20), "mem"));
+  ASSERT_OK(Delete(Key(21)));
+
+  std::vector<std::string> keys;
+  for (int i = 99; i >= 0; i -= 7) {
+    keys.push_back(Key(i));
+  }
+  keys.push_back(Key(10));
+  keys.push_back(Key(20));
+  keys.push_back(Key(21));
+  keys.push_back(Key(20));
+  keys.push_back("missing");
+  std::vector<Slice> slices(keys.begin(), keys.end());
+
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db_->MultiGet(ReadOptions(), slices, &values, &statuses);
+  ASSERT_EQ(keys.size(), values.size());
+  ASSERT_EQ(keys.size(), statuses.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    std::string expected = Get(keys[i]);
+    if (expected == "NOT_FOUND") {
+      ASSERT_TRUE(statuses[i].IsNotFound()) << keys[i];
+    } else {
+      ASSERT_OK(statuses[i]);
+      ASSERT_EQ(expected, values[i]);
+    }
+  }
+  ASSERT_EQ("mem", values[keys.size() - 2]);
+  ASSERT_TRUE(statuses[keys.size() - 3].IsNotFound());
+  ASSERT_TRUE(statuses[keys.size() - 1].IsNotFound());
+
+  // A snapshot sees the values from before the later writes.
+  ReadOptions options;
+  options.snapshot = snapshot;
+  db_->MultiGet(options, slices, &values, &statuses);
+  for (size_t i = 0; i + 1 < keys.size(); i++) {
+    ASSERT_OK(statuses[i]);
+    ASSERT_EQ("old" + keys[i], values[i]);
+  }
+  ASSERT_TRUE(statuses[keys.size() - 1].IsNotFound());
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST(DBTest, IterateBounds) {
+  // Three tables with disjoint key ranges
+  const char* prefixes[] = { "a", "m", "z" };
+  for (int t = 0; t < 3; t++) {
+    for (int i = 0; i < 10; i++) {
+      ASSERT_OK(Put(std::string(prefixes[t]) + static_cast<char>('0' + i),
+                    "v"));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+
+  Slice lower("m3");
+  Slice upper("m6");
+  ReadOptions options;
+  options.iterate_lower_bound = &lower;
+  options.iterate_upper_bound = &upper;
+  Iterator* iter = db_->NewIterator(options);
+  iter->SeekToFirst();
+  ASSERT_EQ("m3->v", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("m4->v", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("m5->v", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  iter->SeekToLast();
+  ASSERT_EQ("m5->v", IterStatus(iter));
+  iter->Prev();
+  iter->Prev();
+  ASSERT_EQ("m3->v", IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  iter->Seek("a");
+  ASSERT_EQ("m3->v", IterStatus(iter));
+  iter->Seek("m55");
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  delete iter;
+
+  // Files outside the bounds are not read, including those holding
+  // range deletions
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "z2", "z4"));
+  dbfull()->TEST_CompactMemTable();
+  Options reopen_options = CurrentOptions();
+  reopen_options.env = env_;
+  env_->count_random_reads_ = true;
+  Reopen(&reopen_options);
+  Slice empty_lower("b");
+  Slice empty_upper("c");
+  options.iterate_lower_bound = &empty_lower;
+  options.iterate_upper_bound = &empty_upper;
+  env_->random_read_counter_.Reset();
+  iter = db_->NewIterator(options);
+  iter->SeekToFirst();
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  iter->SeekToLast();
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  delete iter;
+  ASSERT_EQ(0, env_->random_read_counter_.Read());
+  env_->count_random_reads_ = false;
+}
+
+TEST(DBTest, IteratorReseeksOverSkippedEntries) {
+  Options options = CurrentOptions();
+  options.max_sequential_skip_in_iterations = 3;
+  Reopen(&options);
+
+  ASSERT_OK(Put("a", "va"));
+  for (int i = 0; i < 50; i++) {
+    ASSERT_OK(Put("b", "vb" + NumberToString(i)));
+    ASSERT_OK(Put("c", "vc" + NumberToString(i)));
+  }
+  ASSERT_OK(Delete("c"));
+  ASSERT_OK(Put("d", "vd"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  for (int i = 0; i < 50; i++) {
+    ASSERT_OK(Put("a", "new" + NumberToString(i)));
+    ASSERT_OK(Put("d", "new" + NumberToString(i)));
+  }
+
+  for (int pass = 0; pass < 2; pass++) {
+    ReadOptions read_options;
+    Iterator* iter = db_->NewIterator(read_options);
+    iter->SeekToFirst();
+    ASSERT_EQ("a->new49", IterStatus(iter));
+    iter->Next();
+    ASSERT_EQ("b->vb49", IterStatus(iter));
+    iter->Next();
+    ASSERT_EQ("d->new49", IterStatus(iter));
+    iter->Next();
+    ASSERT_EQ("(invalid)", IterStatus(iter));
+    iter->SeekToLast();
+    iter->Prev();
+    ASSERT_EQ("b->vb49", IterStatus(iter));
+    delete iter;
+
+    read_options.snapshot = snapshot;
+    iter = db_->NewIterator(read_options);
+    iter->SeekToFirst();
+    ASSERT_EQ("a->va", IterStatus(iter));
+    iter->Next();
+    ASSERT_EQ("b->vb49", IterStatus(iter));
+    iter->Next();
+    ASSERT_EQ("d->vd", IterStatus(iter));
+    iter->Next();
+    ASSERT_EQ("(invalid)", IterStatus(iter));
+    delete iter;
+
+    // Again with the versions in a table file
+    dbfull()->TEST_CompactMemTable();
+  }
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST(DBTest, PrefixSeek) {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  const SliceTransform* extractor = NewFixedPrefixTransform(3);
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.filter_policy = policy;
+  options.prefix_extractor = extractor;
+  Reopen(&options);
+
+  ASSERT_OK(Put("aaa1", "v1"));
+  ASSERT_OK(Put("aaa2", "v2"));
+  ASSERT_OK(Put("ccc1", "v3"));
+  ASSERT_OK(Put("ccc2", "v4"));
+  ASSERT_OK(Put("zz", "v5"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("eee1", "v6"));
+  dbfull()->TEST_CompactMemTable();
+
+  // Open the tables without caching any data blocks
+  env_->count_random_reads_ = true;
+  Reopen(&options);
+  ReadOptions scan_options;
+  scan_options.fill_cache = false;
+  Iterator* iter = db_->NewIterator(scan_options);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(6, count);
+  delete iter;
+
+  ReadOptions prefix_options;
+  prefix_options.prefix_same_as_start = true;
+  prefix_options.fill_cache = false;
+  iter = db_->NewIterator(prefix_options);
+  env_->random_read_counter_.Reset();
+  iter->Seek("bbb1");
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  iter->Seek("ddd");
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  ASSERT_EQ(0, env_->random_read_counter_.Read());
+
+  iter->Seek("ccc");
+  ASSERT_EQ("ccc1->v3", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("ccc2->v4", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+
+  // Keys outside the domain of the extractor are not limited
+  iter->Seek("zz");
+  ASSERT_EQ("zz->v5", IterStatus(iter));
+  delete iter;
+
+  // Without the prefix mode the same seek reads data blocks
+  iter = db_->NewIterator(scan_options);
+  env_->random_read_counter_.Reset();
+  iter->Seek("bbb1");
+  ASSERT_EQ("ccc1->v3", IterStatus(iter));
+  ASSERT_GT(env_->random_read_counter_.Read(), 0);
+  iter->Seek("ccc2");
+  iter->Next();
+  ASSERT_EQ("eee1->v6", IterStatus(iter));
+  delete iter;
+  env_->count_random_reads_ = false;
+
+  // A level of several files is not read past the prefix either
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  const char* prefixes[] = { "aaa", "ccc", "eee" };
+  for (int f = 0; f < 3; f++) {
+    ASSERT_OK(Put(std::string(prefixes[f]) + "1", "v1"));
+    ASSERT_OK(Put(std::string(prefixes[f]) + "2", "v2"));
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_EQ("0,0,3", FilesPerLevel());
+  env_->count_random_reads_ = true;
+  Reopen(&options);
+  iter = db_->NewIterator(scan_options);
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) { }
+  delete iter;
+
+  iter = db_->NewIterator(prefix_options);
+  env_->random_read_counter_.Reset();
+  iter->Seek("bbb1");
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  iter->Seek("ddd");
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  ASSERT_EQ(0, env_->random_read_counter_.Read());
+  iter->Seek("ccc1");
+  ASSERT_EQ("ccc1->v1", IterStatus(iter));
+  env_->random_read_counter_.Reset();
+  iter->Next();
+  ASSERT_EQ("ccc2->v2", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  ASSERT_EQ(0, env_->random_read_counter_.Read());
+  delete iter;
+  env_->count_random_reads_ = false;
+
+  Close();
+  delete extractor;
+  delete policy;
+}
+
+TEST(DBTest, WholeTableFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.whole_table_filter = true;
+  Reopen(&options);
+
+  // Populate multiple layers
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_sstable_sync_.Release_Store(env_);
+
+  // Lookup present keys.  Should rarely read from small sstable.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  ASSERT_GE(reads, N);
+  ASSERT_LE(reads, N + 2*N/100);
+
+  // Lookup missing keys.  Should rarely read from either sstable.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  ASSERT_LE(reads, 3*N/100);
+
+  // The filters are used whatever the option is set to on reopen
+  env_->delay_sstable_sync_.Release_Store(NULL);
+  options.whole_table_filter = false;
+  Reopen(&options);
+  env_->delay_sstable_sync_.Release_Store(env_);
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  ASSERT_LE(env_->random_read_counter_.Read(), 3*N/100);
+
+  env_->delay_sstable_sync_.Release_Store(NULL);
+  env_->count_random_reads_ = false;
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST(DBTest, DataBlockHashIndex) {
+  Options options = CurrentOptions();
+  options.data_block_hash_index = true;
+  options.block_restart_interval = 4;
+  Reopen(&options);
+
+  // Versions of some keys span restart intervals and snapshots
+  const Snapshot* snapshot = NULL;
+  for (int v = 0; v < 3; v++) {
+    for (int i = 0; i < 200; i += (v + 1)) {
+      ASSERT_OK(Put(Key(i), Key(i) + "v" + NumberToString(v)));
+    }
+    if (v == 1) {
+      snapshot = db_->GetSnapshot();
+    }
+  }
+  ASSERT_OK(Delete(Key(6)));
+  dbfull()->TEST_CompactMemTable();
+
+  for (int i = 0; i < 200; i++) {
+    std::string expected = Key(i) + "v0";
+    if (i % 3 == 0) {
+      expected = Key(i) + "v2";
+    } else if (i % 2 == 0) {
+      expected = Key(i) + "v1";
+    }
+    ASSERT_EQ(i == 6 ? "NOT_FOUND" : expected, Get(Key(i)));
+    ASSERT_EQ(i % 2 == 0 ? Key(i) + "v1" : Key(i) + "v0",
+              Get(Key(i), snapshot));
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + "x"));
+  }
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST(DBTest, PartitionedIndexAndFilter) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_size = 1024;
+  options.index_partition_size = 256;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  env_->count_random_reads_ = true;
+  Reopen(&options);
+
+  const int N = 2000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), Key(i) + std::string(100, 'v')));
+  }
+  dbfull()->TEST_CompactMemTable();
+  env_->delay_sstable_sync_.Release_Store(env_);  // Prevent seek compactions
+
+  // A hit reads its filter partition, index partition and data block
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i) + std::string(100, 'v'), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, 3 * N);
+  ASSERT_LE(reads, 3 * N + 2 * N / 100);
+
+  // A miss normally stops at its filter partition
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_GE(reads, N);
+  ASSERT_LE(reads, N + 3 * 2 * N / 100);
+  env_->count_random_reads_ = false;
+
+  // Iteration walks every partition
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(N, count);
+  delete iter;
+
+  env_->delay_sstable_sync_.Release_Store(NULL);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST(DBTest, CacheIndexAndFilterBlocks) {
+  for (int pin = 0; pin < 2; pin++) {
+    Options options = CurrentOptions();
+    options.filter_policy = NewBloomFilterPolicy(10);
+    options.block_cache = NewLRUCache(8 << 20, 0.5);
+    options.cache_index_and_filter_blocks = true;
+    options.pin_l0_filter_and_index_blocks_in_cache = (pin == 1);
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    const int N = 1000;
+    for (int i = 0; i < N; i++) {
+      ASSERT_OK(Put(Key(i), Key(i) + std::string(100, 'v')));
+    }
+    dbfull()->TEST_CompactMemTable();
+    for (int i = N / 2; i < N; i++) {
+      ASSERT_OK(Put(Key(i), Key(i) + std::string(100, 'w')));
+    }
+    dbfull()->TEST_CompactMemTable();
+
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(Key(i) + std::string(100, i < N / 2 ? 'v' : 'w'),
+                Get(Key(i)));
+      ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+    }
+    std::vector<Slice> keys;
+    std::vector<std::string> values;
+    std::vector<std::string> key_strings;
+    for (int i = 0; i < N; i += 7) {
+      key_strings.push_back(Key(i));
+    }
+    for (size_t i = 0; i < key_strings.size(); i++) {
+      keys.push_back(key_strings[i]);
+    }
+    std::vector<Status> statuses;
+    db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+    for (size_t i = 0; i < keys.size(); i++) {
+      ASSERT_OK(statuses[i]);
+      ASSERT_EQ(key_strings[i] + std::string(100, i * 7 < N / 2 ? 'v' : 'w'),
+                values[i]);
+    }
+
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    ASSERT_EQ(N, count);
+    delete iter;
+
+    Close();
+    delete options.block_cache;
+    delete options.filter_policy;
+  }
+}
 
-  iter->Seek("a");
-  ASSERT_EQ(IterStatus(iter), "a->va");
-  iter->Next();
-  ASSERT_EQ(IterStatus(iter), "(invalid)");
+TEST(DBTest, GetPinned) {
+  const std::string big(10000, 'x');
+  ASSERT_OK(Put("foo", big));
+  ASSERT_OK(Put("bar", "v1"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("baz", "mem"));
+
+  PinnableSlice value;
+  ASSERT_OK(db_->Get(ReadOptions(), "foo", &value));
+  ASSERT_TRUE(value.IsPinned());
+  ASSERT_EQ(big, value.ToString());
+
+  PinnableSlice mem_value;
+  ASSERT_OK(db_->Get(ReadOptions(), "baz", &mem_value));
+  ASSERT_TRUE(!mem_value.IsPinned());
+  ASSERT_EQ("mem", mem_value.ToString());
+  ASSERT_TRUE(db_->Get(ReadOptions(), "missing", &mem_value).IsNotFound());
+  ASSERT_TRUE(mem_value.empty());
+
+  // The pinned value outlives the file it was read from.
+  ASSERT_OK(Delete("foo"));
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ(big, value.ToString());
+  value.Reset();
+  ASSERT_TRUE(value.empty());
+  ASSERT_EQ("v1", Get("bar"));
+}
 
-  iter->Seek("b");
-  ASSERT_EQ(IterStatus(iter), "(invalid)");
+namespace {
+struct SuperVersionReader {
+  DB* db;
+  port::AtomicPointer read;     // Set after the thread's Get()
+  port::AtomicPointer release;  // Set to let the thread finish
+  port::AtomicPointer done;
+};
 
-  delete iter;
+static void SuperVersionReaderBody(void* arg) {
+  SuperVersionReader* r = reinterpret_cast<SuperVersionReader*>(arg);
+  std::string value;
+  ASSERT_OK(r->db->Get(ReadOptions(), "foo", &value));
+  ASSERT_EQ("v1", value);
+  r->read.Release_Store(r);
+  while (r->release.Acquire_Load() == NULL) {
+    DelayMilliseconds(10);
+  }
+  r->done.Release_Store(r);
 }
+}  // namespace
 
-TEST(DBTest, IterMulti) {
-  ASSERT_OK(Put("a", "va"));
-  ASSERT_OK(Put("b", "vb"));
-  ASSERT_OK(Put("c", "vc"));
-  Iterator* iter = db_->NewIterator(ReadOptions());
+TEST(DBTest, GetFromThreadCachedState) {
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_EQ("v1", Get("foo"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_OK(Put("foo", "v2"));
+  ASSERT_EQ("v2", Get("foo"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("v2", Get("foo"));
 
-  iter->SeekToFirst();
-  ASSERT_EQ(IterStatus(iter), "a->va");
-  iter->Next();
-  ASSERT_EQ(IterStatus(iter), "b->vb");
-  iter->Next();
-  ASSERT_EQ(IterStatus(iter), "c->vc");
-  iter->Next();
-  ASSERT_EQ(IterStatus(iter), "(invalid)");
-  iter->SeekToFirst();
-  ASSERT_EQ(IterStatus(iter), "a->va");
-  iter->Prev();
-  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  // The state this thread read from last must not keep the compaction
+  // inputs alive.
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ("v2", Get("foo"));
+  ASSERT_EQ(TotalTableFiles(), CountTableFiles());
 
-  iter->SeekToLast();
-  ASSERT_EQ(IterStatus(iter), "c->vc");
-  iter->Prev();
-  ASSERT_EQ(IterStatus(iter), "b->vb");
-  iter->Prev();
-  ASSERT_EQ(IterStatus(iter), "a->va");
-  iter->Prev();
-  ASSERT_EQ(IterStatus(iter), "(invalid)");
-  iter->SeekToLast();
-  ASSERT_EQ(IterStatus(iter), "c->vc");
-  iter->Next();
-  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  // A thread that read from the DB may exit after the DB is closed.
+  Reopen();
+  ASSERT_OK(Put("foo", "v1"));
+  SuperVersionReader reader;
+  reader.db = db_;
+  reader.read.Release_Store(NULL);
+  reader.release.Release_Store(NULL);
+  reader.done.Release_Store(NULL);
+  env_->StartThread(SuperVersionReaderBody, &reader);
+  while (reader.read.Acquire_Load() == NULL) {
+    DelayMilliseconds(10);
+  }
+  Reopen();
+  ASSERT_EQ("v1", Get("foo"));
+  reader.release.Release_Store(&reader);
+  while (reader.done.Acquire_Load() == NULL) {
+    DelayMilliseconds(10);
+  }
+  Close();
+}
 
-  iter->Seek("");
-  ASSERT_EQ(IterStatus(iter), "a->va");
-  iter->Seek("a");
-  ASSERT_EQ(IterStatus(iter), "a->va");
-  iter->Seek("ax");
-  ASSERT_EQ(IterStatus(iter), "b->vb");
-  iter->Seek("b");
-  ASSERT_EQ(IterStatus(iter), "b->vb");
-  iter->Seek("z");
-  ASSERT_EQ(IterStatus(iter), "(invalid)");
+TEST(DBTest, DeleteRange) {
+  Options options = CurrentOptions();
+  options.max_mem_compact_level = 0;
+  Reopen(&options);
 
-  // Switch from reverse to forward
-  iter->SeekToLast();
-  iter->Prev();
-  iter->Prev();
-  iter->Next();
-  ASSERT_EQ(IterStatus(iter), "b->vb");
+  for (int i = 0; i < 8; i++) {
+    ASSERT_OK(Put(Key(i), "v1"));
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ("0,1", FilesPerLevel());
+
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(2), Key(5)));
+  ASSERT_OK(Put(Key(3), "v2"));
+
+  // The range deletion is honored in the memtable, in a level-0 table
+  // and in a level-1 table kept for the snapshot
+  const std::string expected =
+      "(" + Key(0) + "->v1)(" + Key(1) + "->v1)(" + Key(3) + "->v2)(" +
+      Key(5) + "->v1)(" + Key(6) + "->v1)(" + Key(7) + "->v1)";
+  for (int i = 0; i < 3; i++) {
+    ASSERT_EQ("v1", Get(Key(1)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(2)));
+    ASSERT_EQ("v2", Get(Key(3)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(4)));
+    ASSERT_EQ("v1", Get(Key(5)));
+    ASSERT_EQ("v1", Get(Key(2), snapshot));
+    ASSERT_EQ("v1", Get(Key(3), snapshot));
+    ASSERT_EQ(expected, Contents());
+    if (i == 0) {
+      dbfull()->TEST_CompactMemTable();
+      ASSERT_EQ("1,1", FilesPerLevel());
+    } else if (i == 1) {
+      dbfull()->TEST_CompactRange(0, NULL, NULL);
+      ASSERT_EQ("0,1", FilesPerLevel());
+    }
+  }
+  ASSERT_EQ("[ v1 ]", AllEntriesFor(Key(2)));
 
-  // Switch from forward to reverse
-  iter->SeekToFirst();
-  iter->Next();
-  iter->Next();
-  iter->Prev();
-  ASSERT_EQ(IterStatus(iter), "b->vb");
+  // Once no snapshot needs them, the deleted entries and the range
+  // deletion are dropped
+  db_->ReleaseSnapshot(snapshot);
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_EQ("[ ]", AllEntriesFor(Key(2)));
+  ASSERT_EQ("[ v2 ]", AllEntriesFor(Key(3)));
+  ASSERT_EQ(expected, Contents());
 
-  // Make sure iter stays at snapshot
-  ASSERT_OK(Put("a",  "va2"));
-  ASSERT_OK(Put("a2", "va3"));
-  ASSERT_OK(Put("b",  "vb2"));
-  ASSERT_OK(Put("c",  "vc2"));
-  ASSERT_OK(Delete("b"));
-  iter->SeekToFirst();
-  ASSERT_EQ(IterStatus(iter), "a->va");
-  iter->Next();
-  ASSERT_EQ(IterStatus(iter), "b->vb");
-  iter->Next();
-  ASSERT_EQ(IterStatus(iter), "c->vc");
-  iter->Next();
-  ASSERT_EQ(IterStatus(iter), "(invalid)");
-  iter->SeekToLast();
-  ASSERT_EQ(IterStatus(iter), "c->vc");
-  iter->Prev();
-  ASSERT_EQ(IterStatus(iter), "b->vb");
-  iter->Prev();
-  ASSERT_EQ(IterStatus(iter), "a->va");
-  iter->Prev();
-  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  // Recovery from the log
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(5), Key(7)));
+  Reopen(&options);
+  ASSERT_EQ("NOT_FOUND", Get(Key(6)));
+  ASSERT_EQ("v1", Get(Key(7)));
 
-  delete iter;
+  // A compaction drops the files that a range deletion covers entirely
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(0), Key(8)));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("2,0,1", FilesPerLevel());
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ(0, TotalTableFiles());
+  ASSERT_EQ("", Contents());
+  ASSERT_EQ("NOT_FOUND", Get(Key(3)));
 }
 
-TEST(DBTest, IterSmallAndLargeMix) {
-  ASSERT_OK(Put("a", "va"));
-  ASSERT_OK(Put("b", std::string(100000, 'b')));
-  ASSERT_OK(Put("c", "vc"));
-  ASSERT_OK(Put("d", std::string(100000, 'd')));
-  ASSERT_OK(Put("e", std::string(100000, 'e')));
+TEST(DBTest, RangeDeletionsBetweenMemTableReads) {
+  for (int i = 0; i < 10; i++) {
+    ASSERT_OK(Put(Key(i), "v1"));
+  }
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(2), Key(5)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(3)));
+  ASSERT_EQ("v1", Get(Key(6)));
+
+  // Range deletions added after a read are seen by the next one
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(4), Key(8)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(6)));
+  ASSERT_EQ("v1", Get(Key(6), snapshot));
+  ASSERT_EQ("NOT_FOUND", Get(Key(4), snapshot));
+  ASSERT_EQ("v1", Get(Key(8)));
+  ASSERT_OK(Put(Key(6), "v2"));
+  ASSERT_EQ("v2", Get(Key(6)));
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(0), Key(1)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+  ASSERT_EQ("v1", Get(Key(1)));
+  ASSERT_EQ("v2", Get(Key(6)));
+  db_->ReleaseSnapshot(snapshot);
+}
 
-  Iterator* iter = db_->NewIterator(ReadOptions());
+TEST(DBTest, EmptyRangeDeletion) {
+  Options options = CurrentOptions();
+  options.max_mem_compact_level = 0;
+  Reopen(&options);
 
-  iter->SeekToFirst();
-  ASSERT_EQ(IterStatus(iter), "a->va");
-  iter->Next();
-  ASSERT_EQ(IterStatus(iter), "b->" + std::string(100000, 'b'));
-  iter->Next();
-  ASSERT_EQ(IterStatus(iter), "c->vc");
-  iter->Next();
-  ASSERT_EQ(IterStatus(iter), "d->" + std::string(100000, 'd'));
-  iter->Next();
-  ASSERT_EQ(IterStatus(iter), "e->" + std::string(100000, 'e'));
-  iter->Next();
-  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  ASSERT_OK(Put(Key(2), "v"));
+  ASSERT_OK(Put(Key(5), "v"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("1", FilesPerLevel());
+  const std::string sstables = DumpSSTableList();
 
-  iter->SeekToLast();
-  ASSERT_EQ(IterStatus(iter), "e->" + std::string(100000, 'e'));
-  iter->Prev();
-  ASSERT_EQ(IterStatus(iter), "d->" + std::string(100000, 'd'));
-  iter->Prev();
-  ASSERT_EQ(IterStatus(iter), "c->vc");
-  iter->Prev();
-  ASSERT_EQ(IterStatus(iter), "b->" + std::string(100000, 'b'));
-  iter->Prev();
-  ASSERT_EQ(IterStatus(iter), "a->va");
-  iter->Prev();
-  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  // An empty or inverted range is rejected
+  Status s = db_->DeleteRange(WriteOptions(), Key(5), Key(5));
+  ASSERT_TRUE(!s.ok());
+  ASSERT_TRUE(s.ToString().find("Invalid argument") == 0) << s.ToString();
+  s = db_->DeleteRange(WriteOptions(), Key(9), Key(0));
+  ASSERT_TRUE(!s.ok());
+  ASSERT_TRUE(s.ToString().find("Invalid argument") == 0) << s.ToString();
+
+  // One written through a batch deletes nothing and yields no table
+  WriteBatch batch;
+  batch.DeleteRange(Key(5), Key(5));
+  batch.DeleteRange(Key(9), Key(0));
+  ASSERT_OK(db_->Write(WriteOptions(), &batch));
+  ASSERT_EQ("v", Get(Key(2)));
+  ASSERT_EQ("v", Get(Key(5)));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("1", FilesPerLevel());
+  ASSERT_EQ(sstables, DumpSSTableList());
 
-  delete iter;
+  Reopen(&options);
+  ASSERT_EQ("v", Get(Key(5)));
+  ASSERT_EQ("1", FilesPerLevel());
 }
 
-TEST(DBTest, IterMultiWithDelete) {
-  do {
-    ASSERT_OK(Put("a", "va"));
-    ASSERT_OK(Put("b", "vb"));
-    ASSERT_OK(Put("c", "vc"));
-    ASSERT_OK(Delete("b"));
-    ASSERT_EQ("NOT_FOUND", Get("b"));
+TEST(DBTest, OverlappingRangeDeletionsInFile) {
+  Options options = CurrentOptions();
+  options.max_mem_compact_level = 0;
+  Reopen(&options);
 
-    Iterator* iter = db_->NewIterator(ReadOptions());
-    iter->Seek("c");
-    ASSERT_EQ(IterStatus(iter), "c->vc");
-    iter->Prev();
-    ASSERT_EQ(IterStatus(iter), "a->va");
-    delete iter;
-  } while (ChangeOptions());
+  const int kKeys = 40;
+  const int kDeletions = 20;
+  for (int i = 0; i < kKeys; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+  }
+  // Deletion j removes [j, j+10); snapshots[j] only sees the deletions
+  // before it
+  std::vector<const Snapshot*> snapshots;
+  for (int j = 0; j < kDeletions; j++) {
+    snapshots.push_back(db_->GetSnapshot());
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(j), Key(j + 10)));
+  }
+  snapshots.push_back(db_->GetSnapshot());
+
+  for (int pass = 0; pass < 3; pass++) {
+    for (int s = 0; s <= kDeletions; s++) {
+      for (int k = 0; k < kKeys; k++) {
+        // Deletion j < s covers k iff j <= k < j + 10
+        const bool deleted = (s > 0 && k < s + 9);
+        ASSERT_EQ(deleted ? "NOT_FOUND" : "v", Get(Key(k), snapshots[s]));
+      }
+    }
+    if (pass == 0) {
+      dbfull()->TEST_CompactMemTable();
+      ASSERT_EQ("1", FilesPerLevel());
+    } else if (pass == 1) {
+      dbfull()->TEST_CompactRange(0, NULL, NULL);
+      ASSERT_EQ("0,1", FilesPerLevel());
+    }
+  }
+  for (size_t s = 0; s < snapshots.size(); s++) {
+    db_->ReleaseSnapshot(snapshots[s]);
+  }
 }
-#endif
 
-TEST(DBTest, Recover) {
-  do {
-    ASSERT_OK(Put("foo", "v1"));
-    ASSERT_OK(Put("baz", "v5"));
+TEST(DBTest, DeleteFilesInRange) {
+  Options options = CurrentOptions();
+  options.max_mem_compact_level = 0;
+  Reopen(&options);
 
-    Reopen();
-    ASSERT_EQ("v1", Get("foo"));
+  // Three level-0 files holding keys [0,10), [10,20) and [20,30)
+  for (int f = 0; f < 3; f++) {
+    for (int i = f * 10; i < (f + 1) * 10; i++) {
+      ASSERT_OK(Put(Key(i), "v"));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_EQ("3", FilesPerLevel());
+  ASSERT_OK(Put(Key(15), "mem"));
 
-    ASSERT_EQ("v1", Get("foo"));
-    ASSERT_EQ("v5", Get("baz"));
-    ASSERT_OK(Put("bar", "v2"));
-    ASSERT_OK(Put("foo", "v3"));
+  // Only files entirely inside the range are removed
+  std::string begin = Key(5);
+  std::string end = Key(19);
+  Slice b(begin), e(end);
+  ASSERT_OK(db_->DeleteFilesInRange(&b, &e));
+  ASSERT_EQ("2", FilesPerLevel());
+  ASSERT_EQ("v", Get(Key(5)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(10)));
+  ASSERT_EQ("mem", Get(Key(15)));
+  ASSERT_EQ("v", Get(Key(20)));
 
-    Reopen();
-    ASSERT_EQ("v3", Get("foo"));
-    ASSERT_OK(Put("foo", "v4"));
-    ASSERT_EQ("v4", Get("foo"));
-    ASSERT_EQ("v2", Get("bar"));
-    ASSERT_EQ("v5", Get("baz"));
-  } while (ChangeOptions());
+  ASSERT_OK(db_->DeleteFilesInRange(&b, NULL));
+  ASSERT_EQ("1", FilesPerLevel());
+  ASSERT_EQ("NOT_FOUND", Get(Key(20)));
+
+  Reopen(&options);
+  ASSERT_EQ("v", Get(Key(5)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(25)));
+  ASSERT_OK(db_->DeleteFilesInRange(NULL, NULL));
+  ASSERT_EQ(0, TotalTableFiles());
+  ASSERT_EQ("NOT_FOUND", Get(Key(5)));
 }
 
-TEST(DBTest, RecoveryWithEmptyLog) {
-  do {
-    ASSERT_OK(Put("foo", "v1"));
-    ASSERT_OK(Put("foo", "v2"));
-    Reopen();
-    Reopen();
-    ASSERT_OK(Put("foo", "v3"));
-    Reopen();
-    ASSERT_EQ("v3", Get("foo"));
-  } while (ChangeOptions());
+TEST(DBTest, UniversalCompaction) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  options.compaction_style = kCompactionStyleUniversal;
+  Reopen(&options);
+
+  Random rnd(301);
+  const int N = 500;
+  std::vector<std::string> values(N);
+  for (int round = 0; round < 4; round++) {
+    for (int i = 0; i < N; i++) {
+      values[i] = RandomString(&rnd, 500);
+      ASSERT_OK(Put(Key(i), values[i]));
+    }
+  }
+  for (int i = 0; i < N; i += 3) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+
+  // All sorted runs stay in level-0
+  ASSERT_EQ(TotalTableFiles(), NumTableFilesAtLevel(0));
+  ASSERT_LT(NumTableFilesAtLevel(0), config::kL0_SlowdownWritesTrigger);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Get(Key(i)), (i % 3 == 0) ? "NOT_FOUND" : values[i]);
+  }
+
+  // A full compaction leaves a single run without deletion markers
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("1", FilesPerLevel());
+  ASSERT_EQ(AllEntriesFor(Key(0)), "[ ]");
+  ASSERT_EQ(AllEntriesFor(Key(1)), "[ " + values[1] + " ]");
+
+  Reopen(&options);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Get(Key(i)), (i % 3 == 0) ? "NOT_FOUND" : values[i]);
+  }
+
+  // A database with files beyond level-0 cannot switch styles
+  Options level_options = CurrentOptions();
+  Reopen(&level_options);
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ("0,1", FilesPerLevel());
+  Close();
+  ASSERT_TRUE(!TryReopen(&options).ok());
 }
 
 #if 0
@@ -917,12 +2152,6 @@ TEST(DBTest, RecoverDuringMemtableCompaction) {
 }
 //#endif
 
-static std::string Key(int i) {
-  char buf[100];
-  snprintf(buf, sizeof(buf), "key%06d", i);
-  return std::string(buf);
-}
-
 TEST(DBTest, MinorCompactionsHappen) {
   Options options = CurrentOptions();
   options.write_buffer_size = 10000;
@@ -1886,6 +3115,10 @@ class ModelDB: public DB {
       virtual void Delete(const Slice& key) {
         map_->erase(key.ToString());
       }
+      virtual void DeleteRange(const Slice& begin, const Slice& end) {
+        map_->erase(map_->lower_bound(begin.ToString()),
+                    map_->lower_bound(end.ToString()));
+      }
     };
     Handler handler;
     handler.map_ = &map_;
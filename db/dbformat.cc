@@ -3,6 +3,7 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include <stdio.h>
+#include <vector>
 #include "db/dbformat.h"
 #include "port/port.h"
 #include "util/coding.h"
@@ -20,6 +21,12 @@ void AppendInternalKey(std::string* result, const ParsedInternalKey& key) {
   PutFixed64(result, PackSequenceAndType(key.sequence, key.type));
 }
 
+void AppendExpiringValue(std::string* result, const Slice& value,
+                         uint64_t expiry) {
+  result->append(value.data(), value.size());
+  PutFixed64(result, expiry);
+}
+
 std::string ParsedInternalKey::DebugString() const {
   char buf[50];
   snprintf(buf, sizeof(buf), "' @ %llu : %d",
@@ -98,8 +105,21 @@ void InternalKeyComparator::FindShortSuccessor(std::string* key) const {
   }
 }
 
+InternalFilterPolicy::InternalFilterPolicy(
+    const FilterPolicy* p, const SliceTransform* prefix_extractor)
+    : user_policy_(p),
+      prefix_extractor_(p != NULL ? prefix_extractor : NULL) {
+  if (prefix_extractor_ != NULL) {
+    // Filters holding prefixes must not be mistaken for ones that do
+    // not, or for ones built with a different extractor.
+    name_ = user_policy_->Name();
+    name_.append(".prefix.");
+    name_.append(prefix_extractor_->Name());
+  }
+}
+
 const char* InternalFilterPolicy::Name() const {
-  return user_policy_->Name();
+  return prefix_extractor_ != NULL ? name_.c_str() : user_policy_->Name();
 }
 
 void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
@@ -111,13 +131,42 @@ void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
     mkey[i] = ExtractUserKey(keys[i]);
     // TODO(sanjay): Suppress dups?
   }
-  user_policy_->CreateFilter(keys, n, dst);
+  if (prefix_extractor_ == NULL) {
+    user_policy_->CreateFilter(keys, n, dst);
+    return;
+  }
+
+  // Keys arrive sorted, so equal prefixes are adjacent
+  std::vector<Slice> with_prefixes(keys, keys + n);
+  Slice last_prefix;
+  bool has_last = false;
+  for (int i = 0; i < n; i++) {
+    if (prefix_extractor_->InDomain(keys[i])) {
+      Slice prefix = prefix_extractor_->Transform(keys[i]);
+      if (!has_last || prefix != last_prefix) {
+        with_prefixes.push_back(prefix);
+        last_prefix = prefix;
+        has_last = true;
+      }
+    }
+  }
+  user_policy_->CreateFilter(&with_prefixes[0],
+                             static_cast<int>(with_prefixes.size()), dst);
 }
 
 bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
   return user_policy_->KeyMayMatch(ExtractUserKey(key), f);
 }
 
+bool InternalFilterPolicy::PrefixMayMatch(const Slice& key,
+                                          const Slice& f) const {
+  Slice user_key = ExtractUserKey(key);
+  if (prefix_extractor_ == NULL || !prefix_extractor_->InDomain(user_key)) {
+    return true;
+  }
+  return user_policy_->KeyMayMatch(prefix_extractor_->Transform(user_key), f);
+}
+
 LookupKey::LookupKey(const Slice& user_key, SequenceNumber s) {
   size_t usize = user_key.size();
   size_t needed = usize + 13;  // A conservative estimate
@@ -9,6 +9,7 @@
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/slice.h"
 #include "leveldb/table_builder.h"
 #include "util/coding.h"
@@ -16,8 +17,9 @@
 
 namespace leveldb {
 
-// Grouping of constants.  We may want to make some of these
-// parameters set via options.
+// Grouping of constants.  The level-0 triggers and kMaxMemCompactLevel
+// must match the defaults of the Options fields that replace them (see
+// util/options.cc).
 namespace config {
 static const int kNumLevels = 7;
 
@@ -30,6 +32,10 @@ static const int kL0_SlowdownWritesTrigger = 8;
 // Maximum number of level-0 files.  We stop writes at this point.
 static const int kL0_StopWritesTrigger = 12;
 
+// Minimum number of level-0 files that are merged into one level-0 file
+// when compactions into level-1 fall behind.
+static const int kMinFilesForIntraL0Compaction = 4;
+
 // Maximum level to which a new compacted memtable is pushed if it
 // does not create overlap.  We try to push to level 2 to avoid the
 // relatively expensive level 0=>1 compactions and to avoid some
@@ -50,7 +56,9 @@ class InternalKey;
 // data structures.
 enum ValueType {
   kTypeDeletion = 0x0,
-  kTypeValue = 0x1
+  kTypeValue = 0x1,
+  kTypeValueWithExpiry = 0x2,
+  kTypeRangeDeletion = 0x3    // See db/range_del.h
 };
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
@@ -58,7 +66,7 @@ enum ValueType {
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeRangeDeletion;
 
 typedef uint64_t SequenceNumber;
 
@@ -127,15 +135,21 @@ class InternalKeyComparator : public Comparator {
   int Compare(const InternalKey& a, const InternalKey& b) const;
 };
 
-// Filter policy wrapper that converts from internal keys to user keys
+// Filter policy wrapper that converts from internal keys to user keys.
+// If a prefix extractor is given, the prefixes of the user keys are
+// added to the filters too.
 class InternalFilterPolicy : public FilterPolicy {
  private:
   const FilterPolicy* const user_policy_;
+  const SliceTransform* const prefix_extractor_;
+  std::string name_;
  public:
-  explicit InternalFilterPolicy(const FilterPolicy* p) : user_policy_(p) { }
+  explicit InternalFilterPolicy(const FilterPolicy* p,
+                                const SliceTransform* prefix_extractor = NULL);
   virtual const char* Name() const;
   virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const;
   virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const;
+  virtual bool PrefixMayMatch(const Slice& key, const Slice& filter) const;
 };
 
 // Modules in this directory should keep internal keys wrapped inside
@@ -182,7 +196,28 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<unsigned char>(kTypeValue));
+  return (c <= static_cast<unsigned char>(kTypeRangeDeletion));
+}
+
+// The value of a kTypeValueWithExpiry entry is followed by the time at
+// which the entry expires, in microseconds as returned by
+// Env::NowMicros(), encoded as a fixed64.  An expired entry hides
+// older entries for its user key just like a deletion.
+
+// Append the encoding of "value" expiring at "expiry" to *result.
+extern void AppendExpiringValue(std::string* result, const Slice& value,
+                                uint64_t expiry);
+
+// Strip the expiry time from the stored value of a kTypeValueWithExpiry
+// entry.  On success, shortens *value to the user value, stores the
+// expiry time in *expiry and returns true.  Returns false if the stored
+// value is too short.
+inline bool ParseExpiringValue(Slice* value, uint64_t* expiry) {
+  const size_t n = value->size();
+  if (n < 8) return false;
+  *expiry = DecodeFixed64(value->data() + n - 8);
+  *value = Slice(value->data(), n - 8);
+  return true;
 }
 
 // A helper class useful for DBImpl::Get()
@@ -4,10 +4,12 @@
 
 #include "db/memtable.h"
 #include "db/dbformat.h"
+#include "db/range_del.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -21,11 +23,16 @@ static Slice GetLengthPrefixedSlice(const char* data) {
 MemTable::MemTable(const InternalKeyComparator& cmp)
     : comparator_(cmp),
       refs_(0),
-      table_(comparator_, &arena_) {
+      table_(comparator_, &arena_),
+      range_del_table_(comparator_, &arena_),
+      num_range_deletions_(0),
+      num_fragmented_(0),
+      fragments_(NULL) {
 }
 
 MemTable::~MemTable() {
   assert(refs_ == 0);
+  delete fragments_;
 }
 
 size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
@@ -91,9 +98,18 @@ Iterator* MemTable::NewIterator() {
   return new MemTableIterator(&table_);
 }
 
+Iterator* MemTable::NewRangeDeletionIterator() {
+  return new MemTableIterator(&range_del_table_);
+}
+
 void MemTable::Add(SequenceNumber s, ValueType type,
                    const Slice& key,
                    const Slice& value) {
+  if (type == kTypeRangeDeletion &&
+      comparator_.comparator.user_comparator()->Compare(key, value) >= 0) {
+    return;  // An empty range deletes nothing
+  }
+
   // Format of an entry is concatenation of:
   //  key_size     : varint32 of internal_key.size()
   //  key bytes    : char[internal_key.size()]
@@ -114,11 +130,41 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   p = EncodeVarint32(p, val_size);
   memcpy(p, value.data(), val_size);
   assert((p + val_size) - buf == encoded_len);
-  table_.Insert(buf);
+  if (type == kTypeRangeDeletion) {
+    range_del_table_.Insert(buf);
+    MutexLock l(&range_del_mutex_);
+    num_range_deletions_++;
+  } else {
+    table_.Insert(buf);
+  }
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+bool MemTable::Get(const LookupKey& key, uint64_t now, std::string* value,
+                   Status* s) {
   Slice memkey = key.memtable_key();
+
+  // Find the newest visible range deletion covering the key
+  SequenceNumber covering = 0;
+  Table::Iterator range_iter(&range_del_table_);
+  range_iter.SeekToFirst();
+  if (range_iter.Valid()) {
+    Slice ikey = key.internal_key();
+    const SequenceNumber snapshot =
+        DecodeFixed64(ikey.data() + ikey.size() - 8) >> 8;
+    MutexLock l(&range_del_mutex_);
+    if (fragments_ == NULL || num_fragmented_ != num_range_deletions_) {
+      delete fragments_;
+      fragments_ = new FragmentedRangeTombstones(
+          comparator_.comparator.user_comparator());
+      num_fragmented_ = num_range_deletions_;
+      Iterator* iter = NewRangeDeletionIterator();
+      Status build = fragments_->Build(iter);
+      delete iter;
+      assert(build.ok());  // Memtable entries are well formed
+    }
+    covering = fragments_->MaxCoveringSequence(key.user_key(), snapshot);
+  }
+
   Table::Iterator iter(&table_);
   iter.Seek(memkey.data());
   if (iter.Valid()) {
@@ -139,6 +185,10 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
             key.user_key()) == 0) {
       // Correct user key
       const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+      if ((tag >> 8) < covering) {
+        *s = Status::NotFound(Slice());
+        return true;
+      }
       switch (static_cast<ValueType>(tag & 0xff)) {
         case kTypeValue: {
           Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
@@ -148,9 +198,27 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
         case kTypeDeletion:
           *s = Status::NotFound(Slice());
           return true;
+        case kTypeValueWithExpiry: {
+          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+          uint64_t expiry;
+          if (!ParseExpiringValue(&v, &expiry)) {
+            *s = Status::Corruption("bad expiring value");
+          } else if (expiry <= now) {
+            *s = Status::NotFound(Slice());
+          } else {
+            value->assign(v.data(), v.size());
+          }
+          return true;
+        }
+        case kTypeRangeDeletion:
+          break;  // Kept in range_del_table_
       }
     }
   }
+  if (covering > 0) {
+    *s = Status::NotFound(Slice());
+    return true;
+  }
   return false;
 }
 
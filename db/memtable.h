@@ -9,10 +9,12 @@
 #include "leveldb/db.h"
 #include "db/dbformat.h"
 #include "db/skiplist.h"
+#include "port/port.h"
 #include "util/arena.h"
 
 namespace leveldb {
 
+class FragmentedRangeTombstones;
 class InternalKeyComparator;
 class Mutex;
 class MemTableIterator;
@@ -50,18 +52,26 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator over the range deletions in the memtable (see
+  // db/range_del.h).  The same lifetime rules as for NewIterator()
+  // apply.
+  Iterator* NewRangeDeletionIterator();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
-  // Typically value will be empty if type==kTypeDeletion.
+  // Typically value will be empty if type==kTypeDeletion.  For
+  // type==kTypeRangeDeletion, key and value are the start and end of
+  // the deleted range; an empty range is dropped.
   void Add(SequenceNumber seq, ValueType type,
            const Slice& key,
            const Slice& value);
 
   // If memtable contains a value for key, store it in *value and return true.
-  // If memtable contains a deletion for key, store a NotFound() error
-  // in *status and return true.
+  // If memtable contains a deletion for key, a range deletion covering
+  // it, or a value that expired at or before time "now", store a
+  // NotFound() error in *status and return true.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  bool Get(const LookupKey& key, uint64_t now, std::string* value, Status* s);
 
  private:
   ~MemTable();  // Private since only Unref() should be used to delete it
@@ -80,6 +90,14 @@ class MemTable {
   int refs_;
   Arena arena_;
   Table table_;
+  Table range_del_table_;
+
+  // Get() looks range deletions up in fragments built from
+  // range_del_table_, rebuilt when Add() has inserted more since.
+  port::Mutex range_del_mutex_;
+  uint64_t num_range_deletions_;         // Guarded by range_del_mutex_
+  uint64_t num_fragmented_;              // Guarded by range_del_mutex_
+  FragmentedRangeTombstones* fragments_;  // Guarded by range_del_mutex_
 
   // No copying allowed
   MemTable(const MemTable&);
@@ -0,0 +1,255 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del.h"
+
+#include <algorithm>
+#include <functional>
+#include <set>
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+
+namespace leveldb {
+
+void AddTombstoneToRange(const Comparator* icmp,
+                         const Slice& begin_key,
+                         const Slice& end,
+                         bool empty,
+                         InternalKey* smallest,
+                         InternalKey* largest) {
+  InternalKey limit(end, kMaxSequenceNumber, kTypeRangeDeletion);
+  if (empty || icmp->Compare(begin_key, smallest->Encode()) < 0) {
+    smallest->DecodeFrom(begin_key);
+  }
+  if (empty || icmp->Compare(limit.Encode(), largest->Encode()) > 0) {
+    *largest = limit;
+  }
+}
+
+RangeDelMap::RangeDelMap(const Comparator* user_comparator,
+                         SequenceNumber snapshot)
+    : ucmp_(user_comparator),
+      snapshot_(snapshot),
+      built_(true) {
+}
+
+Status RangeDelMap::AddTombstones(Iterator* iter) {
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey begin;
+    if (!ParseInternalKey(iter->key(), &begin)) {
+      return Status::Corruption("corrupted range deletion key");
+    }
+    if (begin.sequence <= snapshot_ &&
+        ucmp_->Compare(begin.user_key, iter->value()) < 0) {
+      RangeTombstone t;
+      t.begin = begin.user_key.ToString();
+      t.end = iter->value().ToString();
+      t.sequence = begin.sequence;
+      tombstones_.push_back(t);
+      built_ = false;
+    }
+  }
+  return iter->status();
+}
+
+namespace {
+struct TombstoneBeginOrder {
+  const Comparator* ucmp;
+  bool operator()(const RangeTombstone& a, const RangeTombstone& b) const {
+    const int r = ucmp->Compare(a.begin, b.begin);
+    if (r != 0) {
+      return r < 0;
+    }
+    return a.sequence > b.sequence;
+  }
+};
+
+// A range deletion starts (sequence added) or ends (sequence removed)
+// at a boundary key.
+struct BoundaryEvent {
+  Slice key;
+  SequenceNumber sequence;
+  bool start;
+};
+
+struct BoundaryEventOrder {
+  const Comparator* ucmp;
+  bool operator()(const BoundaryEvent& a, const BoundaryEvent& b) const {
+    return ucmp->Compare(a.key, b.key) < 0;
+  }
+};
+
+// Sort the begin and end events of "tombstones" by key
+void SortBoundaryEvents(const Comparator* ucmp,
+                        const std::vector<RangeTombstone>& tombstones,
+                        std::vector<BoundaryEvent>* events) {
+  events->reserve(2 * tombstones.size());
+  for (size_t i = 0; i < tombstones.size(); i++) {
+    BoundaryEvent e;
+    e.sequence = tombstones[i].sequence;
+    e.key = tombstones[i].begin;
+    e.start = true;
+    events->push_back(e);
+    e.key = tombstones[i].end;
+    e.start = false;
+    events->push_back(e);
+  }
+  BoundaryEventOrder event_order;
+  event_order.ucmp = ucmp;
+  std::stable_sort(events->begin(), events->end(), event_order);
+}
+
+// Index of the last of "boundaries" <= user_key, plus one; zero if
+// user_key precedes them all
+size_t UpperBoundary(const Comparator* ucmp,
+                     const std::vector<std::string>& boundaries,
+                     const Slice& user_key) {
+  size_t left = 0;
+  size_t right = boundaries.size();
+  while (left < right) {
+    const size_t mid = (left + right) / 2;
+    if (ucmp->Compare(boundaries[mid], user_key) <= 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  return left;
+}
+}  // namespace
+
+void SortTombstones(const Comparator* user_comparator,
+                    std::vector<RangeTombstone>* tombstones) {
+  TombstoneBeginOrder order;
+  order.ucmp = user_comparator;
+  std::sort(tombstones->begin(), tombstones->end(), order);
+}
+
+void RangeDelMap::Build() {
+  SortTombstones(ucmp_, &tombstones_);
+
+  std::vector<BoundaryEvent> events;
+  SortBoundaryEvents(ucmp_, tombstones_, &events);
+
+  // Sweep over the boundaries keeping the set of covering sequences
+  boundaries_.clear();
+  max_sequences_.clear();
+  std::multiset<SequenceNumber> active;
+  size_t i = 0;
+  while (i < events.size()) {
+    const Slice key = events[i].key;
+    for (; i < events.size() && ucmp_->Compare(events[i].key, key) == 0; i++) {
+      if (events[i].start) {
+        active.insert(events[i].sequence);
+      } else {
+        active.erase(active.find(events[i].sequence));
+      }
+    }
+    boundaries_.push_back(key.ToString());
+    max_sequences_.push_back(active.empty() ? 0 : *active.rbegin());
+  }
+  built_ = true;
+}
+
+const std::vector<RangeTombstone>& RangeDelMap::tombstones() {
+  if (!built_) {
+    Build();
+  }
+  return tombstones_;
+}
+
+SequenceNumber RangeDelMap::MaxCoveringSequence(const Slice& user_key) {
+  if (!built_) {
+    Build();
+  }
+  const size_t i = UpperBoundary(ucmp_, boundaries_, user_key);
+  return (i == 0) ? 0 : max_sequences_[i - 1];
+}
+
+SequenceNumber RangeDelMap::MinCoveringSequence(const Slice& begin,
+                                                const Slice& end,
+                                                bool end_exclusive) {
+  if (!built_) {
+    Build();
+  }
+  size_t i = 0;
+  while (i < boundaries_.size() && ucmp_->Compare(boundaries_[i], begin) <= 0) {
+    i++;
+  }
+  if (i == 0) {
+    return 0;  // begin precedes all range deletions
+  }
+  SequenceNumber result = max_sequences_[i - 1];
+  for (; i < boundaries_.size() && result > 0; i++) {
+    const int r = ucmp_->Compare(boundaries_[i], end);
+    if (r > 0 || (r == 0 && end_exclusive)) {
+      break;
+    }
+    result = std::min(result, max_sequences_[i]);
+  }
+  return result;
+}
+
+FragmentedRangeTombstones::FragmentedRangeTombstones(
+    const Comparator* user_comparator)
+    : ucmp_(user_comparator) {
+}
+
+Status FragmentedRangeTombstones::Build(Iterator* iter) {
+  assert(empty());
+  std::vector<RangeTombstone> tombstones;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey begin;
+    if (!ParseInternalKey(iter->key(), &begin)) {
+      return Status::Corruption("corrupted range deletion key");
+    }
+    if (ucmp_->Compare(begin.user_key, iter->value()) < 0) {
+      RangeTombstone t;
+      t.begin = begin.user_key.ToString();
+      t.end = iter->value().ToString();
+      t.sequence = begin.sequence;
+      tombstones.push_back(t);
+    }
+  }
+  if (!iter->status().ok()) {
+    return iter->status();
+  }
+
+  std::vector<BoundaryEvent> events;
+  SortBoundaryEvents(ucmp_, tombstones, &events);
+
+  // Sweep over the boundaries keeping the set of covering sequences
+  std::multiset<SequenceNumber> active;
+  size_t i = 0;
+  while (i < events.size()) {
+    const Slice key = events[i].key;
+    for (; i < events.size() && ucmp_->Compare(events[i].key, key) == 0; i++) {
+      if (events[i].start) {
+        active.insert(events[i].sequence);
+      } else {
+        active.erase(active.find(events[i].sequence));
+      }
+    }
+    boundaries_.push_back(key.ToString());
+    starts_.push_back(sequences_.size());
+    sequences_.insert(sequences_.end(), active.rbegin(), active.rend());
+  }
+  starts_.push_back(sequences_.size());
+  return Status::OK();
+}
+
+SequenceNumber FragmentedRangeTombstones::MaxCoveringSequence(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  const size_t i = UpperBoundary(ucmp_, boundaries_, user_key);
+  if (i == 0) {
+    return 0;
+  }
+  // The first sequence number <= snapshot, searching from the largest
+  std::vector<SequenceNumber>::const_iterator pos = std::lower_bound(
+      sequences_.begin() + starts_[i - 1], sequences_.begin() + starts_[i],
+      snapshot, std::greater<SequenceNumber>());
+  return (pos == sequences_.begin() + starts_[i]) ? 0 : *pos;
+}
+
+}  // namespace leveldb
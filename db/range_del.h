@@ -0,0 +1,132 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A range deletion ("range tombstone") written at sequence number S
+// deletes every entry with a user key in [begin, end) and a sequence
+// number below S.  Range deletions are kept apart from point entries:
+// each memtable holds them in a skiplist of their own and each table
+// in a meta block.  Both are keyed by the internal key
+// (begin, S, kTypeRangeDeletion) and hold "end" as the value.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_DEL_H_
+#define STORAGE_LEVELDB_DB_RANGE_DEL_H_
+
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+
+namespace leveldb {
+
+class Iterator;
+
+struct RangeTombstone {
+  std::string begin;  // Inclusive
+  std::string end;    // Exclusive
+  SequenceNumber sequence;
+};
+
+// Sort *tombstones by begin key, and those with the same begin key by
+// decreasing sequence number: the order of their internal keys.
+extern void SortTombstones(const Comparator* user_comparator,
+                           std::vector<RangeTombstone>* tombstones);
+
+// Widen the key range [*smallest, *largest] of a table to take in the
+// range deletion with internal key "begin_key" and end key "end".  The
+// range ends just before the first entry for "end".  "icmp" must order
+// internal keys; "empty" says whether the table has no range yet.
+// Requires: the begin user key precedes "end".
+extern void AddTombstoneToRange(const Comparator* icmp,
+                                const Slice& begin_key,
+                                const Slice& end,
+                                bool empty,
+                                InternalKey* smallest,
+                                InternalKey* largest);
+
+// A set of range deletions that answers which entries they delete.
+// Not thread-safe.
+class RangeDelMap {
+ public:
+  // Range deletions with sequence numbers above "snapshot" are ignored.
+  RangeDelMap(const Comparator* user_comparator, SequenceNumber snapshot);
+
+  // Add the range deletions yielded by *iter.  Does not take ownership
+  // of iter.
+  Status AddTombstones(Iterator* iter);
+
+  bool empty() const { return tombstones_.empty(); }
+
+  // The range deletions added so far, in the order of SortTombstones().
+  const std::vector<RangeTombstone>& tombstones();
+
+  // Return the largest sequence number of a range deletion covering
+  // user_key, or zero if there is none.
+  SequenceNumber MaxCoveringSequence(const Slice& user_key);
+
+  // Return the smallest MaxCoveringSequence(k) over the user keys k in
+  // [begin, end], or in [begin, end) if "end_exclusive".
+  SequenceNumber MinCoveringSequence(const Slice& begin, const Slice& end,
+                                     bool end_exclusive);
+
+  // Return true iff the entry "ikey" is deleted by a range deletion.
+  bool ShouldDelete(const ParsedInternalKey& ikey) {
+    return !empty() && ikey.sequence < MaxCoveringSequence(ikey.user_key);
+  }
+
+ private:
+  void Build();
+
+  const Comparator* const ucmp_;
+  const SequenceNumber snapshot_;
+  std::vector<RangeTombstone> tombstones_;
+  bool built_;
+
+  // After Build(): the distinct begin and end keys of all range
+  // deletions in order, and for each the largest sequence number of a
+  // range deletion covering [boundaries_[i], boundaries_[i+1]).
+  std::vector<std::string> boundaries_;
+  std::vector<SequenceNumber> max_sequences_;
+
+  // No copying allowed
+  RangeDelMap(const RangeDelMap&);
+  void operator=(const RangeDelMap&);
+};
+
+// The range deletions of one table, split at their begin and end keys
+// into fragments that do not overlap.  Each fragment keeps the sequence
+// numbers of all range deletions covering it, so that a lookup at any
+// snapshot costs a binary search instead of a pass over the table's
+// range deletions.  Immutable once built, so threads may share it.
+class FragmentedRangeTombstones {
+ public:
+  explicit FragmentedRangeTombstones(const Comparator* user_comparator);
+
+  // Build from all the range deletions yielded by *iter.  Does not take
+  // ownership of iter.  Must be called at most once.
+  Status Build(Iterator* iter);
+
+  bool empty() const { return boundaries_.empty(); }
+
+  // Return the largest sequence number <= snapshot of a range deletion
+  // covering user_key, or zero if there is none.
+  SequenceNumber MaxCoveringSequence(const Slice& user_key,
+                                     SequenceNumber snapshot) const;
+
+ private:
+  const Comparator* const ucmp_;
+
+  // The distinct begin and end keys in order.  The range deletions
+  // covering [boundaries_[i], boundaries_[i+1]) have the sequence numbers
+  // sequences_[starts_[i]..starts_[i+1]-1], largest first.
+  std::vector<std::string> boundaries_;
+  std::vector<size_t> starts_;
+  std::vector<SequenceNumber> sequences_;
+
+  // No copying allowed
+  FragmentedRangeTombstones(const FragmentedRangeTombstones&);
+  void operator=(const FragmentedRangeTombstones&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_DEL_H_
@@ -31,6 +31,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "db/write_batch_internal.h"
@@ -48,7 +49,7 @@ class Repairer {
       : dbname_(dbname),
         env_(options.env),
         icmp_(options.comparator),
-        ipolicy_(options.filter_policy),
+        ipolicy_(options.filter_policy, options.prefix_extractor),
         options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
@@ -224,8 +225,11 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_del_iter = mem->NewRangeDeletionIterator();
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                        range_del_iter, &meta);
     delete iter;
+    delete range_del_iter;
     mem->Unref();
     mem = NULL;
     if (status.ok()) {
@@ -293,6 +297,9 @@ class Repairer {
       }
 
       counter++;
+      if (parsed.type == kTypeDeletion) {
+        t.meta.num_deletions++;
+      }
       if (empty) {
         empty = false;
         t.meta.smallest.DecodeFrom(key);
@@ -306,6 +313,35 @@ class Repairer {
       status = iter->status();
     }
     delete iter;
+
+    // Range deletions widen the table's key range
+    iter = table_cache_->NewRangeDeletionIterator(t.meta.number,
+                                                  t.meta.file_size);
+    for (iter->SeekToFirst(); status.ok() && iter->Valid(); iter->Next()) {
+      if (!ParseInternalKey(iter->key(), &parsed)) {
+        Log(options_.info_log, "Table #%llu: unparsable range deletion %s",
+            (unsigned long long) t.meta.number,
+            EscapeString(iter->key()).c_str());
+        continue;
+      }
+      if (icmp_.user_comparator()->Compare(parsed.user_key,
+                                           iter->value()) >= 0) {
+        continue;  // Empty range; deletes nothing
+      }
+      AddTombstoneToRange(&icmp_, iter->key(), iter->value(), empty,
+                          &t.meta.smallest, &t.meta.largest);
+      empty = false;
+      t.meta.num_range_deletions++;
+      if (parsed.sequence > t.max_sequence) {
+        t.max_sequence = parsed.sequence;
+      }
+    }
+    if (status.ok() && !iter->status().ok()) {
+      status = iter->status();
+    }
+    delete iter;
+    t.meta.largest_seqno = t.max_sequence;
+    t.meta.num_entries = counter;
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long) t.meta.number,
         counter,
@@ -339,6 +375,13 @@ class Repairer {
       counter++;
     }
     delete iter;
+    iter = table_cache_->NewRangeDeletionIterator(t.meta.number,
+                                                  t.meta.file_size);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      builder->AddRangeDeletion(iter->key(), iter->value());
+      counter++;
+    }
+    delete iter;
 
     ArchiveFile(src);
     if (counter == 0) {
@@ -395,14 +438,14 @@ class Repairer {
     for (size_t i = 0; i < tables_.size(); i++) {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
-      edit_.AddFile(0, t.meta.number, t.meta.file_size,
-                    t.meta.smallest, t.meta.largest);
+      edit_.AddFile(0, t.meta);
     }
 
     //fprintf(stderr, "NewDescriptor:\n%s\n", edit_.DebugString().c_str());
     {
       log::Writer log(file);
       std::string record;
+      edit_.SetRecordDeletionCounts(options_.deletion_compaction_ratio > 0);
       edit_.EncodeTo(&record);
       status = log.AddRecord(record);
     }
@@ -5,7 +5,9 @@
 #include "db/table_cache.h"
 
 #include "db/filename.h"
+#include "db/range_del.h"
 #include "leveldb/env.h"
+#include "leveldb/pinnable_slice.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
 
@@ -14,10 +16,12 @@ namespace leveldb {
 struct TableAndFile {
 	RandomAccessFile* file;
 	Table* table;
+	FragmentedRangeTombstones* range_dels;  // NULL if the table has none
 };
 
 static void DeleteEntry(const Slice& key, void* value) {
 	TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+	delete tf->range_dels;
 	delete tf->table;
 	delete tf->file;
 	delete tf;
@@ -43,7 +47,7 @@ TableCache::~TableCache() {
 }
 
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
-		Cache::Handle** handle) {
+		Cache::Handle** handle, int level) {
 	Status s;
 	char buf[sizeof(file_number)];
 	EncodeFixed64(buf, file_number);
@@ -68,7 +72,31 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 		}
 
 		if (s.ok()) {
-			s = Table::Open(*options_, file, file_size, &table);
+			const bool pin = (level == 0 &&
+					options_->pin_l0_filter_and_index_blocks_in_cache);
+			s = Table::Open(*options_, file, file_size, pin, &table);
+		}
+
+		// Fragment the range deletions once, so that point lookups need
+		// not scan them
+		FragmentedRangeTombstones* range_dels = NULL;
+		if (s.ok()) {
+			Iterator* iter = table->NewRangeDeletionIterator();
+			iter->SeekToFirst();
+			if (iter->Valid() || !iter->status().ok()) {
+				// The DB hands us its InternalKeyComparator
+				const Comparator* ucmp = static_cast<const InternalKeyComparator*>(
+						options_->comparator)->user_comparator();
+				range_dels = new FragmentedRangeTombstones(ucmp);
+				s = range_dels->Build(iter);
+				if (!s.ok()) {
+					delete range_dels;
+					range_dels = NULL;
+					delete table;
+					table = NULL;
+				}
+			}
+			delete iter;
 		}
 
 		if (!s.ok()) {
@@ -80,6 +108,7 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 			TableAndFile* tf = new TableAndFile;
 			tf->file = file;
 			tf->table = table;
+			tf->range_dels = range_dels;
 			*handle = cache_->Insert(key, tf, 1, &DeleteEntry);
 		}
 	}
@@ -89,13 +118,14 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 Iterator* TableCache::NewIterator(const ReadOptions& options,
 		uint64_t file_number,
 		uint64_t file_size,
-		Table** tableptr) {
+		Table** tableptr,
+		int level) {
 	if (tableptr != NULL) {
 		*tableptr = NULL;
 	}
 
 	Cache::Handle* handle = NULL;
-	Status s = FindTable(file_number, file_size, &handle);
+	Status s = FindTable(file_number, file_size, &handle, level);
 	if (!s.ok()) {
 		return NewErrorIterator(s);
 	}
@@ -109,22 +139,91 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
 	return result;
 }
 
+Iterator* TableCache::NewRangeDeletionIterator(uint64_t file_number,
+		uint64_t file_size) {
+	Cache::Handle* handle = NULL;
+	Status s = FindTable(file_number, file_size, &handle);
+	if (!s.ok()) {
+		return NewErrorIterator(s);
+	}
+
+	Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+	Iterator* result = table->NewRangeDeletionIterator();
+	result->RegisterCleanup(&UnrefEntry, cache_, handle);
+	return result;
+}
+
+Status TableCache::MaxCoveringTombstone(uint64_t file_number,
+		uint64_t file_size,
+		const Slice& user_key,
+		SequenceNumber snapshot,
+		SequenceNumber* result) {
+	*result = 0;
+	Cache::Handle* handle = NULL;
+	Status s = FindTable(file_number, file_size, &handle);
+	if (s.ok()) {
+		const FragmentedRangeTombstones* range_dels =
+				reinterpret_cast<TableAndFile*>(cache_->Value(handle))->range_dels;
+		if (range_dels != NULL) {
+			*result = range_dels->MaxCoveringSequence(user_key, snapshot);
+		}
+		cache_->Release(handle);
+	}
+	return s;
+}
+
 Status TableCache::Get(const ReadOptions& options,
 		uint64_t file_number,
 		uint64_t file_size,
 		const Slice& k,
 		void* arg,
-		void (*saver)(void*, const Slice&, const Slice&)) {
+		void (*saver)(void*, const Slice&, const Slice&),
+		PinnableSlice* pinned,
+		int level) {
 	Cache::Handle* handle = NULL;
-	Status s = FindTable(file_number, file_size, &handle);
+	Status s = FindTable(file_number, file_size, &handle, level);
 	if (s.ok()) {
 		Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-		s = t->InternalGet(options, k, arg, saver);
+		s = t->InternalGet(options, k, arg, saver, pinned);
+		if (pinned != NULL) {
+			// Blocks read through mmap point into the file
+			pinned->RegisterCleanup(&UnrefEntry, cache_, handle);
+		} else {
+			cache_->Release(handle);
+		}
+	}
+	return s;
+}
+
+Status TableCache::MultiGet(const ReadOptions& options,
+		uint64_t file_number,
+		uint64_t file_size,
+		const std::vector<Slice>& keys,
+		const std::vector<void*>& args,
+		void (*saver)(void*, const Slice&, const Slice&),
+		int level) {
+	Cache::Handle* handle = NULL;
+	Status s = FindTable(file_number, file_size, &handle, level);
+	if (s.ok()) {
+		Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+		s = t->InternalMultiGet(options, keys, args, saver);
 		cache_->Release(handle);
 	}
 	return s;
 }
 
+bool TableCache::PrefixMayMatch(uint64_t file_number, uint64_t file_size,
+		const Slice& k) {
+	Cache::Handle* handle = NULL;
+	if (!FindTable(file_number, file_size, &handle).ok()) {
+		return true;  // Let the read report the error
+	}
+	Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+	const bool may_match = Table::PrefixMayMatch(t, k);
+	cache_->Release(handle);
+	return may_match;
+}
+
 void TableCache::Evict(uint64_t file_number) {
 	char buf[sizeof(file_number)];
 	EncodeFixed64(buf, file_number);
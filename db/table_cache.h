@@ -20,6 +20,7 @@ class Env;
 
 class TableCache {
  public:
+  // options->comparator must be the InternalKeyComparator of the DB.
   TableCache(const std::string& dbname, const Options* options, int entries);
   ~TableCache();
 
@@ -30,19 +31,57 @@ class TableCache {
   // the returned iterator.  The returned "*tableptr" object is owned by
   // the cache and should not be deleted, and is valid for as long as the
   // returned iterator is live.
+  //
+  // "level" is the level of the file, or -1 if unknown, here and below.
+  // It only matters if the file is not open yet.
   Iterator* NewIterator(const ReadOptions& options,
                         uint64_t file_number,
                         uint64_t file_size,
-                        Table** tableptr = NULL);
+                        Table** tableptr = NULL,
+                        int level = -1);
+
+  // Return an iterator over the range deletions of the specified file,
+  // keyed by the internal key of each deleted range's start and
+  // holding its exclusive end user key as the value.
+  Iterator* NewRangeDeletionIterator(uint64_t file_number, uint64_t file_size);
+
+  // Set *result to the largest sequence number <= snapshot of a range
+  // deletion in the specified file that covers user_key, or to zero if
+  // there is none.  Takes O(log n) in the number of range deletions.
+  Status MaxCoveringTombstone(uint64_t file_number,
+                              uint64_t file_size,
+                              const Slice& user_key,
+                              SequenceNumber snapshot,
+                              SequenceNumber* result);
 
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value).  If "pinned" is
+  // non-NULL, the found entry and the file stay in memory until
+  // *pinned is reset.
   Status Get(const ReadOptions& options,
              uint64_t file_number,
              uint64_t file_size,
              const Slice& k,
              void* arg,
-             void (*handle_result)(void*, const Slice&, const Slice&));
+             void (*handle_result)(void*, const Slice&, const Slice&),
+             PinnableSlice* pinned = NULL,
+             int level = -1);
+
+  // For each i, if a seek to internal key keys[i] in the specified file
+  // finds an entry, call (*handle_result)(args[i], found_key,
+  // found_value).  "keys" must be sorted.
+  Status MultiGet(const ReadOptions& options,
+                  uint64_t file_number,
+                  uint64_t file_size,
+                  const std::vector<Slice>& keys,
+                  const std::vector<void*>& args,
+                  void (*handle_result)(void*, const Slice&, const Slice&),
+                  int level = -1);
+
+  // Returns false if the filter of the specified file rules out every
+  // key that shares the prefix of internal key "k" and is >= "k".
+  bool PrefixMayMatch(uint64_t file_number, uint64_t file_size,
+                      const Slice& k);
 
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
@@ -53,7 +92,8 @@ class TableCache {
   const Options* options_;
   Cache* cache_;
 
-  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**,
+                   int level = -1);
 };
 
 }  // namespace leveldb
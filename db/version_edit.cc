@@ -20,7 +20,9 @@ enum Tag {
   kDeletedFile          = 6,
   kNewFile              = 7,
   // 8 was used for large value refs
-  kPrevLogNumber        = 9
+  kPrevLogNumber        = 9,
+  kNewFile2             = 10,  // kNewFile plus range deletions and seqno
+  kNewFile3             = 11   // kNewFile2 plus entry and deletion counts
 };
 
 void VersionEdit::Clear() {
@@ -34,6 +36,7 @@ void VersionEdit::Clear() {
   has_prev_log_number_ = false;
   has_next_file_number_ = false;
   has_last_sequence_ = false;
+  record_deletion_counts_ = false;
   deleted_files_.clear();
   new_files_.clear();
 }
@@ -76,12 +79,25 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    const bool counted = (record_deletion_counts_ &&
+                          (f.num_entries != 0 || f.num_deletions != 0));
+    // Files without range deletions keep the kNewFile format that
+    // older releases read; their largest sequence number is dropped.
+    const bool extended = (counted || f.num_range_deletions != 0);
+    PutVarint32(dst, counted ? kNewFile3 : (extended ? kNewFile2 : kNewFile));
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (extended) {
+      PutVarint64(dst, f.num_range_deletions);
+      PutVarint64(dst, f.largest_seqno);
+    }
+    if (counted) {
+      PutVarint64(dst, f.num_entries);
+      PutVarint64(dst, f.num_deletions);
+    }
   }
 }
 
@@ -192,6 +208,43 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         }
         break;
 
+      case kNewFile2:
+        if (GetLevel(&input, &level) &&
+            GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint64(&input, &f.num_range_deletions) &&
+            GetVarint64(&input, &f.largest_seqno)) {
+          new_files_.push_back(std::make_pair(level, f));
+          f.num_range_deletions = 0;
+          f.largest_seqno = kMaxSequenceNumber;
+        } else {
+          msg = "new-file2 entry";
+        }
+        break;
+
+      case kNewFile3:
+        if (GetLevel(&input, &level) &&
+            GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint64(&input, &f.num_range_deletions) &&
+            GetVarint64(&input, &f.largest_seqno) &&
+            GetVarint64(&input, &f.num_entries) &&
+            GetVarint64(&input, &f.num_deletions)) {
+          new_files_.push_back(std::make_pair(level, f));
+          record_deletion_counts_ = true;
+          f.num_range_deletions = 0;
+          f.largest_seqno = kMaxSequenceNumber;
+          f.num_entries = 0;
+          f.num_deletions = 0;
+        } else {
+          msg = "new-file3 entry";
+        }
+        break;
+
       default:
         msg = "unknown tag";
         break;
@@ -258,6 +311,16 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.num_range_deletions != 0) {
+      r.append(" range deletions: ");
+      AppendNumberTo(&r, f.num_range_deletions);
+    }
+    if (f.num_deletions != 0) {
+      r.append(" deletions: ");
+      AppendNumberTo(&r, f.num_deletions);
+      r.append("/");
+      AppendNumberTo(&r, f.num_entries);
+    }
   }
   r.append("\n}\n");
   return r;
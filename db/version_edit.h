@@ -21,8 +21,17 @@ struct FileMetaData {
   uint64_t file_size;         // File size in bytes
   InternalKey smallest;       // Smallest internal key served by table
   InternalKey largest;        // Largest internal key served by table
-
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) { }
+  uint64_t num_range_deletions;  // Range tombstones in the table
+  SequenceNumber largest_seqno;  // kMaxSequenceNumber if unknown; only
+                                 // kept in the manifest for files
+                                 // with range deletions
+  uint64_t num_entries;          // Point entries in the table; 0 if unknown
+  uint64_t num_deletions;        // Deletion markers among num_entries
+
+  FileMetaData()
+      : refs(0), allowed_seeks(1 << 30), file_size(0),
+        num_range_deletions(0), largest_seqno(kMaxSequenceNumber),
+        num_entries(0), num_deletions(0) { }
 };
 
 class VersionEdit {
@@ -56,6 +65,13 @@ class VersionEdit {
     compact_pointers_.push_back(std::make_pair(level, key));
   }
 
+  // Whether EncodeTo() keeps the entry and deletion counts of new
+  // files.  Only options.deletion_compaction_ratio uses them, and
+  // releases without it cannot read a manifest that holds them.
+  void SetRecordDeletionCounts(bool record) {
+    record_deletion_counts_ = record;
+  }
+
   // Add the specified file at the specified number.
   // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
   // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
@@ -71,6 +87,23 @@ class VersionEdit {
     new_files_.push_back(std::make_pair(level, f));
   }
 
+  // Add the file described by "f", including its range deletion
+  // count, largest sequence number and entry counts, at the specified
+  // level.
+  // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
+  void AddFile(int level, const FileMetaData& f) {
+    FileMetaData copy;
+    copy.number = f.number;
+    copy.file_size = f.file_size;
+    copy.smallest = f.smallest;
+    copy.largest = f.largest;
+    copy.num_range_deletions = f.num_range_deletions;
+    copy.largest_seqno = f.largest_seqno;
+    copy.num_entries = f.num_entries;
+    copy.num_deletions = f.num_deletions;
+    new_files_.push_back(std::make_pair(level, copy));
+  }
+
   // Delete the specified "file" from the specified "level".
   void DeleteFile(int level, uint64_t file) {
     deleted_files_.insert(std::make_pair(level, file));
@@ -96,6 +129,7 @@ class VersionEdit {
   bool has_prev_log_number_;
   bool has_next_file_number_;
   bool has_last_sequence_;
+  bool record_deletion_counts_;
 
   std::vector< std::pair<int, InternalKey> > compact_pointers_;
   DeletedFileSet deleted_files_;
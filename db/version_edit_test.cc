@@ -28,6 +28,18 @@ TEST(VersionEditTest, EncodeDecode) {
     edit.AddFile(3, kBig + 300 + i, kBig + 400 + i,
                  InternalKey("foo", kBig + 500 + i, kTypeValue),
                  InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
+    FileMetaData f;
+    f.number = kBig + 800 + i;
+    f.file_size = kBig + 400 + i;
+    f.smallest = InternalKey("bar", kBig + 500 + i, kTypeRangeDeletion);
+    f.largest = InternalKey("zoo", kMaxSequenceNumber, kTypeRangeDeletion);
+    f.num_range_deletions = i + 1;
+    f.largest_seqno = kBig + 600 + i;
+    edit.AddFile(5, f);
+    f.number = kBig + 850 + i;
+    f.num_entries = kBig + 1100 + i;
+    f.num_deletions = i;
+    edit.AddFile(6, f);
     edit.DeleteFile(4, kBig + 700 + i);
     edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
   }
@@ -37,6 +49,42 @@ TEST(VersionEditTest, EncodeDecode) {
   edit.SetNextFile(kBig + 200);
   edit.SetLastSequence(kBig + 1000);
   TestEncodeDecode(edit);
+  edit.SetRecordDeletionCounts(true);
+  TestEncodeDecode(edit);
+}
+
+TEST(VersionEditTest, PlainFilesKeepOldFormat) {
+  FileMetaData f;
+  f.number = 7;
+  f.file_size = 4096;
+  f.smallest = InternalKey("foo", 5, kTypeValue);
+  f.largest = InternalKey("zoo", 9, kTypeValue);
+  f.largest_seqno = 9;
+  f.num_entries = 100;
+  f.num_deletions = 60;
+
+  // A file without range deletions is written as older releases expect,
+  // and so are its counts unless deletion-triggered compaction wants them
+  VersionEdit edit, plain;
+  edit.AddFile(2, f);
+  plain.AddFile(2, f.number, f.file_size, f.smallest, f.largest);
+  std::string encoded, plain_encoded;
+  edit.EncodeTo(&encoded);
+  plain.EncodeTo(&plain_encoded);
+  ASSERT_EQ(plain_encoded, encoded);
+  edit.SetRecordDeletionCounts(true);
+  encoded.clear();
+  edit.EncodeTo(&encoded);
+  ASSERT_NE(plain_encoded, encoded);
+  TestEncodeDecode(edit);
+
+  f.num_range_deletions = 1;
+  edit.Clear();
+  edit.AddFile(2, f);
+  encoded.clear();
+  edit.EncodeTo(&encoded);
+  ASSERT_NE(plain_encoded, encoded);
+  TestEncodeDecode(edit);
 }
 
 }  // namespace leveldb
@@ -10,8 +10,11 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
+#include "leveldb/pinnable_slice.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
@@ -20,30 +23,41 @@
 
 namespace leveldb {
 
-static const int kTargetFileSize = 2 * 1048576;
-
-// Maximum bytes of overlaps in grandparent (i.e., level+2) before we
-// stop building a single file in a level->level+1 compaction.
-static const int64_t kMaxGrandParentOverlapBytes = 10 * kTargetFileSize;
-
-// Maximum number of bytes in all compacted files.  We avoid expanding
-// the lower level file set of a compaction if it would make the
-// total compaction cover more than this many bytes.
-static const int64_t kExpandedCompactionByteSizeLimit = 25 * kTargetFileSize;
-
-static double MaxBytesForLevel(int level) {
+static double MaxBytesForLevel(const Options* options, int level) {
   // Note: the result for level zero is not really used since we set
   // the level-0 compaction threshold based on number of files.
-  double result = 10 * 1048576.0;  // Result for both level-0 and level-1
+  // Result for both level-0 and level-1
+  double result = options->max_bytes_for_level_base;
+  while (level > 1) {
+    result *= options->max_bytes_for_level_multiplier;
+    level--;
+  }
+  return result;
+}
+
+static uint64_t MaxFileSizeForLevel(const Options* options, int level) {
+  uint64_t result = options->target_file_size_base;
   while (level > 1) {
-    result *= 10;
+    result *= options->target_file_size_multiplier;
     level--;
   }
   return result;
 }
 
-static uint64_t MaxFileSizeForLevel(int level) {
-  return kTargetFileSize;  // We could vary per level to reduce number of files?
+// Maximum bytes of overlaps in grandparent (i.e., level+1) before we
+// stop building a single file in a compaction into "level".
+static int64_t MaxGrandParentOverlapBytes(const Options* options, int level) {
+  return options->max_grandparent_overlap_factor *
+      MaxFileSizeForLevel(options, level);
+}
+
+// Maximum number of bytes in all compacted files.  We avoid expanding
+// the lower level file set of a compaction into "level" if it would
+// make the total compaction cover more than this many bytes.
+static int64_t ExpandedCompactionByteSizeLimit(const Options* options,
+                                               int level) {
+  return options->expanded_compaction_factor *
+      MaxFileSizeForLevel(options, level);
 }
 
 static int64_t TotalFileSize(const std::vector<FileMetaData*>& files) {
@@ -151,27 +165,63 @@ bool SomeFileOverlapsRange(
 // is the largest key that occurs in the file, and value() is an
 // 16-byte value containing the file number and file size, both
 // encoded using EncodeFixed64.
+//
+// If "prefix_extractor" is non-NULL, Next() after a Seek() to a key in
+// its domain only moves on to files that may hold keys with the prefix
+// of that key: it stops at the first file whose smallest key has
+// another prefix, and skips files whose filters rule the prefix out.
+// The tables of the level are then never read past the prefix.
 class Version::LevelFileNumIterator : public Iterator {
  public:
   LevelFileNumIterator(const InternalKeyComparator& icmp,
-                       const std::vector<FileMetaData*>* flist)
+                       const std::vector<FileMetaData*>* flist,
+                       const SliceTransform* prefix_extractor = NULL,
+                       TableCache* table_cache = NULL)
       : icmp_(icmp),
         flist_(flist),
-        index_(flist->size()) {        // Marks as invalid
+        prefix_extractor_(prefix_extractor),
+        table_cache_(table_cache),
+        index_(flist->size()),         // Marks as invalid
+        has_prefix_(false) {
   }
   virtual bool Valid() const {
     return index_ < flist_->size();
   }
   virtual void Seek(const Slice& target) {
     index_ = FindFile(icmp_, *flist_, target);
+    const Slice user_key = ExtractUserKey(target);
+    has_prefix_ = (prefix_extractor_ != NULL &&
+                   prefix_extractor_->InDomain(user_key));
+    if (has_prefix_) {
+      target_.assign(target.data(), target.size());
+      Slice prefix = prefix_extractor_->Transform(user_key);
+      prefix_.assign(prefix.data(), prefix.size());
+    }
+  }
+  virtual void SeekToFirst() {
+    index_ = 0;
+    has_prefix_ = false;
   }
-  virtual void SeekToFirst() { index_ = 0; }
   virtual void SeekToLast() {
     index_ = flist_->empty() ? 0 : flist_->size() - 1;
+    has_prefix_ = false;
   }
   virtual void Next() {
     assert(Valid());
     index_++;
+    while (has_prefix_ && Valid()) {
+      const FileMetaData* f = (*flist_)[index_];
+      const Slice smallest = f->smallest.user_key();
+      if (!prefix_extractor_->InDomain(smallest) ||
+          prefix_extractor_->Transform(smallest) != Slice(prefix_)) {
+        index_ = flist_->size();  // No later file holds the prefix
+      } else if (!table_cache_->PrefixMayMatch(f->number, f->file_size,
+                                               target_)) {
+        index_++;
+      } else {
+        break;
+      }
+    }
   }
   virtual void Prev() {
     assert(Valid());
@@ -195,7 +245,12 @@ class Version::LevelFileNumIterator : public Iterator {
  private:
   const InternalKeyComparator icmp_;
   const std::vector<FileMetaData*>* const flist_;
+  const SliceTransform* const prefix_extractor_;
+  TableCache* const table_cache_;
   uint32_t index_;
+  bool has_prefix_;       // Limited to prefix_ by the last Seek()
+  std::string target_;    // Target of the last Seek() if has_prefix_
+  std::string prefix_;
 
   // Backing store for value().  Holds the file number and size.
   mutable char value_buf_[16];
@@ -215,28 +270,99 @@ static Iterator* GetFileIterator(void* arg,
   }
 }
 
-Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
-                                            int level) const {
+Iterator* Version::NewConcatenatingIterator(
+    const ReadOptions& options,
+    const std::vector<FileMetaData*>* files) const {
+  const SliceTransform* prefix_extractor =
+      (options.prefix_same_as_start ? vset_->options_->prefix_extractor : NULL);
   return NewTwoLevelIterator(
-      new LevelFileNumIterator(vset_->icmp_, &files_[level]),
+      new LevelFileNumIterator(vset_->icmp_, files, prefix_extractor,
+                               vset_->table_cache_),
       &GetFileIterator, vset_->table_cache_, options);
 }
 
+static void DeleteFileList(void* arg1, void* arg2) {
+  delete reinterpret_cast<std::vector<FileMetaData*>*>(arg1);
+}
+
+// Returns true iff "f" may hold user keys in [*lower, *upper).  A NULL
+// bound means the range is unbounded on that side.
+static bool FileInBounds(const Comparator* ucmp, const FileMetaData* f,
+                         const Slice* lower, const Slice* upper) {
+  return (lower == NULL || ucmp->Compare(f->largest.user_key(), *lower) >= 0) &&
+         (upper == NULL || ucmp->Compare(f->smallest.user_key(), *upper) < 0);
+}
+
 void Version::AddIterators(const ReadOptions& options,
                            std::vector<Iterator*>* iters) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  const Slice* lower = options.iterate_lower_bound;
+  const Slice* upper = options.iterate_upper_bound;
+
   // Merge all level zero files together since they may overlap
   for (size_t i = 0; i < files_[0].size(); i++) {
+    FileMetaData* f = files_[0][i];
+    if (!FileInBounds(ucmp, f, lower, upper)) {
+      continue;  // Holds no key within the iterate bounds
+    }
     iters->push_back(
-        vset_->table_cache_->NewIterator(
-            options, files_[0][i]->number, files_[0][i]->file_size));
+        vset_->table_cache_->NewIterator(options, f->number, f->file_size,
+                                         NULL, 0));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
   // walks through the non-overlapping files in the level, opening them
   // lazily.
   for (int level = 1; level < config::kNumLevels; level++) {
-    if (!files_[level].empty()) {
-      iters->push_back(NewConcatenatingIterator(options, level));
+    const std::vector<FileMetaData*>& files = files_[level];
+    if (files.empty()) {
+      continue;
+    }
+    if (lower == NULL && upper == NULL) {
+      iters->push_back(NewConcatenatingIterator(options, &files));
+      continue;
+    }
+
+    // Only walk the files that hold keys within the iterate bounds
+    size_t first = 0;
+    if (lower != NULL) {
+      InternalKey start(*lower, kMaxSequenceNumber, kValueTypeForSeek);
+      first = FindFile(vset_->icmp_, files, start.Encode());
+    }
+    size_t last = first;
+    while (last < files.size() &&
+           (upper == NULL ||
+            ucmp->Compare(files[last]->smallest.user_key(), *upper) < 0)) {
+      last++;
+    }
+    if (last - first == 1) {
+      iters->push_back(vset_->table_cache_->NewIterator(
+          options, files[first]->number, files[first]->file_size));
+    } else if (last - first > 1) {
+      std::vector<FileMetaData*>* in_bounds = new std::vector<FileMetaData*>(
+          files.begin() + first, files.begin() + last);
+      Iterator* iter = NewConcatenatingIterator(options, in_bounds);
+      iter->RegisterCleanup(&DeleteFileList, in_bounds, NULL);
+      iters->push_back(iter);
+    }
+  }
+}
+
+void Version::AddRangeDeletionIterators(const ReadOptions& options,
+                                        std::vector<Iterator*>* iters) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  const Slice* lower = options.iterate_lower_bound;
+  const Slice* upper = options.iterate_upper_bound;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (size_t i = 0; i < files_[level].size(); i++) {
+      const FileMetaData* f = files_[level][i];
+      // The key range of a file takes in its range deletions, so a file
+      // outside the bounds deletes nothing within them
+      if (f->num_range_deletions > 0 &&
+          FileInBounds(ucmp, f, lower, upper)) {
+        iters->push_back(vset_->table_cache_->NewRangeDeletionIterator(
+            f->number, f->file_size));
+      }
     }
   }
 }
@@ -253,7 +379,10 @@ struct Saver {
   SaverState state;
   const Comparator* ucmp;
   Slice user_key;
-  std::string* value;
+  uint64_t now;
+  SequenceNumber covering;  // Of a range deletion in the same file
+  std::string* value;       // Receives a copy of the value, or
+  PinnableSlice* pinned;    // refers to it in place if non-NULL
 };
 }
 static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
@@ -263,9 +392,36 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+      Slice value = v;
+      uint64_t expiry;
+      if (parsed_key.sequence < s->covering) {
+        s->state = kDeleted;
+        return;
+      }
+      switch (parsed_key.type) {
+        case kTypeValue:
+          s->state = kFound;
+          break;
+        case kTypeDeletion:
+          s->state = kDeleted;
+          break;
+        case kTypeValueWithExpiry:
+          if (!ParseExpiringValue(&value, &expiry)) {
+            s->state = kCorrupt;
+          } else {
+            s->state = (expiry > s->now) ? kFound : kDeleted;
+          }
+          break;
+        case kTypeRangeDeletion:
+          s->state = kCorrupt;  // Never stored with point entries
+          break;
+      }
       if (s->state == kFound) {
-        s->value->assign(v.data(), v.size());
+        if (s->pinned != NULL) {
+          s->pinned->PinSlice(value);
+        } else {
+          s->value->assign(value.data(), value.size());
+        }
       }
     }
   }
@@ -322,10 +478,13 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key,
 
 Status Version::Get(const ReadOptions& options,
                     const LookupKey& k,
-                    std::string* value,
+                    uint64_t now,
+                    PinnableSlice* value,
                     GetStats* stats) {
   Slice ikey = k.internal_key();
   Slice user_key = k.user_key();
+  const SequenceNumber snapshot =
+      DecodeFixed64(ikey.data() + ikey.size() - 8) >> 8;
   const Comparator* ucmp = vset_->icmp_.user_comparator();
   Status s;
 
@@ -391,18 +550,38 @@ Status Version::Get(const ReadOptions& options,
       last_file_read = f;
       last_file_read_level = level;
 
+      // A range deletion in this file hides the older entries for
+      // user_key in this file and in all the files searched after it.
+      SequenceNumber covering = 0;
+      if (f->num_range_deletions > 0) {
+        s = vset_->table_cache_->MaxCoveringTombstone(
+            f->number, f->file_size, user_key, snapshot, &covering);
+        if (!s.ok()) {
+          return s;
+        }
+      }
+
       Saver saver;
       saver.state = kNotFound;
       saver.ucmp = ucmp;
       saver.user_key = user_key;
-      saver.value = value;
+      saver.now = now;
+      saver.covering = covering;
+      saver.value = NULL;
+      saver.pinned = value;
       s = vset_->table_cache_->Get(options, f->number, f->file_size,
-                                   ikey, &saver, SaveValue);
+                                   ikey, &saver, SaveValue, value, level);
+      if (saver.state != kFound || !s.ok()) {
+        value->Reset();  // Release the file and the block searched
+      }
       if (!s.ok()) {
         return s;
       }
       switch (saver.state) {
         case kNotFound:
+          if (covering > 0) {
+            return Status::NotFound(Slice());
+          }
           break;      // Keep searching in other files
         case kFound:
           return s;
@@ -419,9 +598,166 @@ Status Version::Get(const ReadOptions& options,
   return Status::NotFound(Slice());  // Use an empty error message for speed
 }
 
+void Version::MultiGet(const ReadOptions& options,
+                       const std::vector<LookupKey*>& keys,
+                       uint64_t now,
+                       const std::vector<std::string*>& vals,
+                       std::vector<Status>* statuses,
+                       std::vector<GetStats>* stats) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  const size_t n = keys.size();
+  statuses->assign(n, Status::NotFound(Slice()));
+  stats->resize(n);
+  std::vector<Saver> savers(n);
+  std::vector<bool> done(n, false);
+  std::vector<FileMetaData*> last_file_read(n, NULL);
+  std::vector<int> last_file_read_level(n, -1);
+  std::vector<size_t> pending;
+  for (size_t i = 0; i < n; i++) {
+    (*stats)[i].seek_file = NULL;
+    (*stats)[i].seek_file_level = -1;
+    savers[i].ucmp = ucmp;
+    savers[i].user_key = keys[i]->user_key();
+    savers[i].now = now;
+    savers[i].value = vals[i];
+    savers[i].pinned = NULL;
+    pending.push_back(i);
+  }
+
+  // As in Get(), search level-by-level; within a level, the pending
+  // keys that fall in the same file are looked up together.
+  std::vector<FileMetaData*> group_files;
+  std::vector<std::vector<size_t> > group_keys;
+  for (int level = 0; level < config::kNumLevels && !pending.empty();
+       level++) {
+    const std::vector<FileMetaData*>& files = files_[level];
+    if (files.empty()) continue;
+
+    group_files.clear();
+    group_keys.clear();
+    if (level == 0) {
+      // Files are searched from newest to oldest, each for the keys it
+      // may hold that an earlier file did not resolve.
+      std::vector<FileMetaData*> tmp(files);
+      std::sort(tmp.begin(), tmp.end(), NewestFirst);
+      for (size_t i = 0; i < tmp.size(); i++) {
+        FileMetaData* f = tmp[i];
+        std::vector<size_t> in_file;
+        for (size_t j = 0; j < pending.size(); j++) {
+          const Slice user_key = keys[pending[j]]->user_key();
+          if (ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+              ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+            in_file.push_back(pending[j]);
+          }
+        }
+        if (!in_file.empty()) {
+          group_files.push_back(f);
+          group_keys.push_back(in_file);
+        }
+      }
+    } else {
+      for (size_t j = 0; j < pending.size(); j++) {
+        const size_t k = pending[j];
+        uint32_t index = FindFile(vset_->icmp_, files,
+                                  keys[k]->internal_key());
+        if (index >= files.size() ||
+            ucmp->Compare(keys[k]->user_key(),
+                          files[index]->smallest.user_key()) < 0) {
+          continue;  // No file in this level can hold the key
+        }
+        if (group_files.empty() || group_files.back() != files[index]) {
+          group_files.push_back(files[index]);
+          group_keys.push_back(std::vector<size_t>());
+        }
+        group_keys.back().push_back(k);
+      }
+    }
+
+    for (size_t g = 0; g < group_files.size(); g++) {
+      FileMetaData* f = group_files[g];
+      std::vector<size_t> probed;
+      std::vector<Slice> ikeys;
+      std::vector<void*> args;
+      for (size_t j = 0; j < group_keys[g].size(); j++) {
+        const size_t k = group_keys[g][j];
+        if (done[k]) continue;
+        GetStats* st = &(*stats)[k];
+        if (last_file_read[k] != NULL && st->seek_file == NULL) {
+          // More than one seek for this key.  Charge the 1st file.
+          st->seek_file = last_file_read[k];
+          st->seek_file_level = last_file_read_level[k];
+        }
+        last_file_read[k] = f;
+        last_file_read_level[k] = level;
+
+        const Slice ikey = keys[k]->internal_key();
+        SequenceNumber covering = 0;
+        if (f->num_range_deletions > 0) {
+          const SequenceNumber snapshot =
+              DecodeFixed64(ikey.data() + ikey.size() - 8) >> 8;
+          Status s = vset_->table_cache_->MaxCoveringTombstone(
+              f->number, f->file_size, keys[k]->user_key(), snapshot,
+              &covering);
+          if (!s.ok()) {
+            (*statuses)[k] = s;
+            done[k] = true;
+            continue;
+          }
+        }
+        savers[k].state = kNotFound;
+        savers[k].covering = covering;
+        probed.push_back(k);
+        ikeys.push_back(ikey);
+        args.push_back(&savers[k]);
+      }
+      if (probed.empty()) continue;
+
+      Status s = vset_->table_cache_->MultiGet(options, f->number,
+                                               f->file_size, ikeys, args,
+                                               SaveValue, level);
+      for (size_t j = 0; j < probed.size(); j++) {
+        const size_t k = probed[j];
+        if (!s.ok()) {
+          (*statuses)[k] = s;
+          done[k] = true;
+          continue;
+        }
+        switch (savers[k].state) {
+          case kNotFound:
+            if (savers[k].covering > 0) {
+              done[k] = true;
+            }
+            break;      // Keep searching in other files
+          case kFound:
+            (*statuses)[k] = Status::OK();
+            done[k] = true;
+            break;
+          case kDeleted:
+            done[k] = true;
+            break;
+          case kCorrupt:
+            (*statuses)[k] = Status::Corruption("corrupted key for ",
+                                                keys[k]->user_key());
+            done[k] = true;
+            break;
+        }
+      }
+    }
+
+    std::vector<size_t> still_pending;
+    for (size_t j = 0; j < pending.size(); j++) {
+      if (!done[pending[j]]) {
+        still_pending.push_back(pending[j]);
+      }
+    }
+    pending.swap(still_pending);
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
-  if (f != NULL) {
+  if (f != NULL &&
+      vset_->options_->compaction_style != kCompactionStyleUniversal) {
     f->allowed_seeks--;
     if (f->allowed_seeks <= 0 && file_to_compact_ == NULL) {
       file_to_compact_ = f;
@@ -494,13 +830,19 @@ int Version::PickLevelForMemTableOutput(
     const Slice& smallest_user_key,
     const Slice& largest_user_key) {
   int level = 0;
+  if (vset_->options_->compaction_style == kCompactionStyleUniversal ||
+      vset_->options_->dynamic_level_bytes) {
+    // Every sorted run lives in level-0, or levels above the base level
+    // must stay empty
+    return level;
+  }
   if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
     // Push to next level if there is no overlap in next level,
     // and the #bytes overlapping in the level after that are limited.
     InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
     InternalKey limit(largest_user_key, 0, static_cast<ValueType>(0));
     std::vector<FileMetaData*> overlaps;
-    while (level < config::kMaxMemCompactLevel) {
+    while (level < vset_->options_->max_mem_compact_level) {
       if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
         break;
       }
@@ -508,7 +850,7 @@ int Version::PickLevelForMemTableOutput(
         // Check that file does not overlap too many grandparent bytes.
         GetOverlappingInputs(level + 2, &start, &limit, &overlaps);
         const int64_t sum = TotalFileSize(overlaps);
-        if (sum > kMaxGrandParentOverlapBytes) {
+        if (sum > MaxGrandParentOverlapBytes(vset_->options_, level + 1)) {
           break;
         }
       }
@@ -518,6 +860,26 @@ int Version::PickLevelForMemTableOutput(
   return level;
 }
 
+// Store in "*files" only the files in "level" that lie entirely within
+// [begin,end]; files that merely overlap it are left out
+void Version::GetFilesInRange(int level,
+                              const Slice* begin,
+                              const Slice* end,
+                              std::vector<FileMetaData*>* files) {
+  assert(level >= 0);
+  assert(level < config::kNumLevels);
+  files->clear();
+  const Comparator* user_cmp = vset_->icmp_.user_comparator();
+  for (size_t i = 0; i < files_[level].size(); i++) {
+    FileMetaData* f = files_[level][i];
+    if ((begin == NULL ||
+         user_cmp->Compare(f->smallest.user_key(), *begin) >= 0) &&
+        (end == NULL || user_cmp->Compare(f->largest.user_key(), *end) <= 0)) {
+      files->push_back(f);
+    }
+  }
+}
+
 // Store in "*inputs" all files in "level" that overlap [begin,end]
 void Version::GetOverlappingInputs(
     int level,
@@ -855,6 +1217,7 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
     // Write new record to MANIFEST log
     if (s.ok()) {
       std::string record;
+      edit->SetRecordDeletionCounts(options_->deletion_compaction_ratio > 0);
       edit->EncodeTo(&record);
       s = descriptor_log_->AddRecord(record);
       if (s.ok()) {
@@ -1018,7 +1381,73 @@ void VersionSet::MarkFileNumberUsed(uint64_t number) {
   }
 }
 
+void VersionSet::ComputeLevelTargets(Version* v) {
+  v->base_level_ = 1;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    v->max_bytes_for_level_[level] = MaxBytesForLevel(options_, level);
+  }
+  if (!options_->dynamic_level_bytes ||
+      options_->compaction_style != kCompactionStyleLevel) {
+    return;
+  }
+
+  // Size the levels backwards from the largest one so that every level
+  // holds about a tenth of the next, and make the base level the level
+  // whose target fits max_bytes_for_level_base.  Levels above it stay empty.
+  const int multiplier = options_->max_bytes_for_level_multiplier;
+  const double base_bytes_max = options_->max_bytes_for_level_base;
+  const double base_bytes_min = base_bytes_max / multiplier;
+  double max_level_size = 0;
+  int first_non_empty_level = -1;
+  for (int level = 1; level < config::kNumLevels; level++) {
+    const double level_bytes = TotalFileSize(v->files_[level]);
+    if (level_bytes > 0 && first_non_empty_level == -1) {
+      first_non_empty_level = level;
+    }
+    if (level_bytes > max_level_size) {
+      max_level_size = level_bytes;
+    }
+  }
+
+  double base_level_size;
+  if (first_non_empty_level == -1) {
+    // Level-0 data goes straight to the last level
+    v->base_level_ = config::kNumLevels - 1;
+    base_level_size = base_bytes_max;
+  } else {
+    double cur_level_size = max_level_size;
+    for (int level = config::kNumLevels - 2; level >= first_non_empty_level;
+         level--) {
+      cur_level_size /= multiplier;
+    }
+    v->base_level_ = first_non_empty_level;
+    if (cur_level_size <= base_bytes_min) {
+      // The first non-empty level would get a tiny target
+      base_level_size = base_bytes_min + 1;
+    } else {
+      while (v->base_level_ > 1 && cur_level_size > base_bytes_max) {
+        v->base_level_--;
+        cur_level_size /= multiplier;
+      }
+      // Even level-1 may get a larger target than we want
+      base_level_size = std::min(cur_level_size, base_bytes_max);
+    }
+  }
+
+  double level_size = base_level_size;
+  for (int level = v->base_level_; level < config::kNumLevels; level++) {
+    if (level > v->base_level_) {
+      level_size *= multiplier;
+    }
+    // Do not let any level get a smaller target than the base level,
+    // or levels could end up smaller than level-0.
+    v->max_bytes_for_level_[level] = std::max(level_size, base_bytes_max);
+  }
+}
+
 void VersionSet::Finalize(Version* v) {
+  ComputeLevelTargets(v);
+
   // Precomputed best level for next compaction
   int best_level = -1;
   double best_score = -1;
@@ -1038,11 +1467,16 @@ void VersionSet::Finalize(Version* v) {
       // setting, or very high compression ratios, or lots of
       // overwrites/deletions).
       score = v->files_[level].size() /
-          static_cast<double>(config::kL0_CompactionTrigger);
+          static_cast<double>(options_->level0_file_num_compaction_trigger);
+      if (options_->compaction_style == kCompactionStyleUniversal &&
+          v->files_[level].size() < 2) {
+        // A single sorted run has nothing to be merged with
+        score = 0;
+      }
     } else {
       // Compute the ratio of current size to size limit.
       const uint64_t level_bytes = TotalFileSize(v->files_[level]);
-      score = static_cast<double>(level_bytes) / MaxBytesForLevel(level);
+      score = static_cast<double>(level_bytes) / v->max_bytes_for_level_[level];
     }
 
     if (score > best_score) {
@@ -1053,6 +1487,32 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+
+  // Find the file with the largest share of deletion markers.  Files in
+  // the last level are skipped since there is no level to push them to.
+  if (options_->compaction_style == kCompactionStyleLevel &&
+      options_->deletion_compaction_ratio > 0) {
+    double best_ratio = -1;
+    for (int level = 0; level < config::kNumLevels-1; level++) {
+      for (size_t i = 0; i < v->files_[level].size(); i++) {
+        FileMetaData* f = v->files_[level][i];
+        const uint64_t entries = f->num_entries + f->num_range_deletions;
+        if (entries == 0 ||
+            entries < options_->deletion_compaction_min_entries) {
+          continue;
+        }
+        const double ratio =
+            static_cast<double>(f->num_deletions + f->num_range_deletions) /
+            entries;
+        if (ratio >= options_->deletion_compaction_ratio &&
+            ratio > best_ratio) {
+          best_ratio = ratio;
+          v->deletion_file_to_compact_ = f;
+          v->deletion_file_to_compact_level_ = level;
+        }
+      }
+    }
+  }
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
@@ -1076,11 +1536,12 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, *f);
     }
   }
 
   std::string record;
+  edit.SetRecordDeletionCounts(options_->deletion_compaction_ratio > 0);
   edit.EncodeTo(&record);
   return log->AddRecord(record);
 }
@@ -1223,9 +1684,9 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   Iterator** list = new Iterator*[space];
   int num = 0;
   for (int which = 0; which < 2; which++) {
-    if (!c->inputs_[which].empty()) {
+    const std::vector<FileMetaData*>& files = c->live_inputs(which);
+    if (!files.empty()) {
       if (c->level() + which == 0) {
-        const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
           list[num++] = table_cache_->NewIterator(
               options, files[i]->number, files[i]->file_size);
@@ -1233,7 +1694,7 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
       } else {
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
-            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
+            new Version::LevelFileNumIterator(icmp_, &files),
             &GetFileIterator, table_cache_, options);
       }
     }
@@ -1244,19 +1705,80 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   return result;
 }
 
+Iterator* VersionSet::MakeRangeDeletionIterator(Compaction* c) {
+  std::vector<Iterator*> list;
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < c->inputs_[which].size(); i++) {
+      const FileMetaData* f = c->inputs_[which][i];
+      if (f->num_range_deletions > 0) {
+        list.push_back(table_cache_->NewRangeDeletionIterator(
+            f->number, f->file_size));
+      }
+    }
+  }
+  if (list.empty()) {
+    return NewEmptyIterator();
+  }
+  return NewMergingIterator(&icmp_, &list[0], list.size());
+}
+
+int VersionSet::DropCoveredInputs(Compaction* c,
+                                  SequenceNumber smallest_snapshot) {
+  RangeDelMap range_dels(icmp_.user_comparator(), smallest_snapshot);
+  Iterator* iter = MakeRangeDeletionIterator(c);
+  Status s = range_dels.AddTombstones(iter);
+  delete iter;
+  if (!s.ok() || range_dels.empty()) {
+    return 0;  // Read every input
+  }
+
+  int dropped = 0;
+  for (int which = 0; which < 2; which++) {
+    c->live_inputs_[which].clear();
+    for (size_t i = 0; i < c->inputs_[which].size(); i++) {
+      FileMetaData* f = c->inputs_[which][i];
+      // A largest key made by AddTombstoneToRange() excludes its user key
+      ParsedInternalKey largest;
+      const bool exclusive = ParseInternalKey(f->largest.Encode(), &largest) &&
+          largest.sequence == kMaxSequenceNumber;
+      if (f->largest_seqno < range_dels.MinCoveringSequence(
+              f->smallest.user_key(), f->largest.user_key(), exclusive)) {
+        dropped++;
+      } else {
+        c->live_inputs_[which].push_back(f);
+      }
+    }
+  }
+  c->has_live_inputs_ = true;
+  return dropped;
+}
+
 Compaction* VersionSet::PickCompaction() {
+  if (options_->compaction_style == kCompactionStyleUniversal) {
+    return PickUniversalCompaction();
+  }
+
   Compaction* c;
   int level;
 
   // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
+  // the compactions triggered by deletion markers, and those over the
+  // compactions triggered by seeks.
   const bool size_compaction = (current_->compaction_score_ >= 1);
+  const bool deletion_compaction =
+      (current_->deletion_file_to_compact_ != NULL);
   const bool seek_compaction = (current_->file_to_compact_ != NULL);
   if (size_compaction) {
     level = current_->compaction_level_;
     assert(level >= 0);
     assert(level+1 < config::kNumLevels);
-    c = new Compaction(level);
+    if (level == 0) {
+      c = PickIntraLevel0Compaction();
+      if (c != NULL) {
+        return c;
+      }
+    }
+    c = new Compaction(options_, level, OutputLevel(level));
 
     // Pick the first file that comes after compact_pointer_[level]
     for (size_t i = 0; i < current_->files_[level].size(); i++) {
@@ -1271,9 +1793,20 @@ Compaction* VersionSet::PickCompaction() {
       // Wrap-around to the beginning of the key space
       c->inputs_[0].push_back(current_->files_[level][0]);
     }
+  } else if (deletion_compaction) {
+    level = current_->deletion_file_to_compact_level_;
+    FileMetaData* f = current_->deletion_file_to_compact_;
+    Log(options_->info_log,
+        "Compacting #%llu@%d for %llu deletions in %llu entries\n",
+        (unsigned long long) f->number, level,
+        (unsigned long long) (f->num_deletions + f->num_range_deletions),
+        (unsigned long long) (f->num_entries + f->num_range_deletions));
+    c = new Compaction(options_, level, OutputLevel(level));
+    c->deletion_triggered_ = true;
+    c->inputs_[0].push_back(f);
   } else if (seek_compaction) {
     level = current_->file_to_compact_level_;
-    c = new Compaction(level);
+    c = new Compaction(options_, level, OutputLevel(level));
     c->inputs_[0].push_back(current_->file_to_compact_);
   } else {
     return NULL;
@@ -1300,17 +1833,19 @@ Compaction* VersionSet::PickCompaction() {
 
 void VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
+  const int output_level = c->output_level();
   InternalKey smallest, largest;
   GetRange(c->inputs_[0], &smallest, &largest);
 
-  current_->GetOverlappingInputs(level+1, &smallest, &largest, &c->inputs_[1]);
+  current_->GetOverlappingInputs(output_level, &smallest, &largest,
+                                 &c->inputs_[1]);
 
   // Get entire range covered by compaction
   InternalKey all_start, all_limit;
   GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
 
   // See if we can grow the number of inputs in "level" without
-  // changing the number of "level+1" files we pick up.
+  // changing the number of "output_level" files we pick up.
   if (!c->inputs_[1].empty()) {
     std::vector<FileMetaData*> expanded0;
     current_->GetOverlappingInputs(level, &all_start, &all_limit, &expanded0);
@@ -1318,11 +1853,12 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     const int64_t inputs1_size = TotalFileSize(c->inputs_[1]);
     const int64_t expanded0_size = TotalFileSize(expanded0);
     if (expanded0.size() > c->inputs_[0].size() &&
-        inputs1_size + expanded0_size < kExpandedCompactionByteSizeLimit) {
+        inputs1_size + expanded0_size <
+            ExpandedCompactionByteSizeLimit(options_, output_level)) {
       InternalKey new_start, new_limit;
       GetRange(expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
-      current_->GetOverlappingInputs(level+1, &new_start, &new_limit,
+      current_->GetOverlappingInputs(output_level, &new_start, &new_limit,
                                      &expanded1);
       if (expanded1.size() == c->inputs_[1].size()) {
         Log(options_->info_log,
@@ -1344,9 +1880,9 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   }
 
   // Compute the set of grandparent files that overlap this compaction
-  // (parent == level+1; grandparent == level+2)
-  if (level + 2 < config::kNumLevels) {
-    current_->GetOverlappingInputs(level + 2, &all_start, &all_limit,
+  // (parent == output_level; grandparent == output_level+1)
+  if (output_level + 1 < config::kNumLevels) {
+    current_->GetOverlappingInputs(output_level + 1, &all_start, &all_limit,
                                    &c->grandparents_);
   }
 
@@ -1365,6 +1901,117 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   c->edit_.SetCompactPointer(level, largest);
 }
 
+Compaction* VersionSet::PickUniversalCompaction() {
+  // Order the sorted runs from newest to oldest
+  std::vector<FileMetaData*> runs = current_->files_[0];
+  std::sort(runs.begin(), runs.end(), NewestFirst);
+  const size_t n = runs.size();
+  if (current_->compaction_score_ < 1 || n < 2) {
+    return NULL;
+  }
+
+  size_t count = 0;
+  const char* reason = "";
+
+  // Bound the space amplification: merge everything once the newer runs
+  // hold too many bytes compared to the oldest run.
+  uint64_t newer_bytes = 0;
+  for (size_t i = 0; i + 1 < n; i++) {
+    newer_bytes += runs[i]->file_size;
+  }
+  const uint64_t oldest_bytes = runs[n - 1]->file_size;
+  if (newer_bytes * 100 >=
+      oldest_bytes * options_->universal_max_size_amplification_percent) {
+    count = n;
+    reason = "size amplification";
+  }
+
+  // Merge the newest runs for as long as the next run is of similar size
+  // to the runs picked so far.
+  if (count == 0) {
+    uint64_t candidate_bytes = runs[0]->file_size;
+    size_t i = 1;
+    while (i < n &&
+           candidate_bytes * (100 + options_->universal_size_ratio) / 100 >=
+           runs[i]->file_size) {
+      candidate_bytes += runs[i]->file_size;
+      i++;
+    }
+    if (i >= static_cast<size_t>(options_->universal_min_merge_width)) {
+      count = i;
+      reason = "size ratio";
+    }
+  }
+
+  // Otherwise merge just enough of the newest runs to get below the
+  // trigger again.
+  if (count == 0) {
+    const int excess =
+        static_cast<int>(n) - options_->level0_file_num_compaction_trigger;
+    count = std::min(n, static_cast<size_t>(std::max(excess + 2, 2)));
+    reason = "run count";
+  }
+
+  Log(options_->info_log, "Universal compaction of %d of %d runs (%s)",
+      static_cast<int>(count), static_cast<int>(n), reason);
+  return NewLevel0MergeCompaction(count);
+}
+
+Compaction* VersionSet::PickIntraLevel0Compaction() {
+  // Once level-0 holds enough files to slow down writes, compactions
+  // into the next level are not keeping up.  Merging the newest level-0
+  // files costs only their own bytes, and every read then checks fewer
+  // level-0 files.
+  std::vector<FileMetaData*> files = current_->files_[0];
+  if (files.size() <
+      static_cast<size_t>(options_->level0_slowdown_writes_trigger)) {
+    return NULL;
+  }
+  std::sort(files.begin(), files.end(), NewestFirst);
+
+  // Stop before a file that would raise the bytes rewritten per file
+  // removed, such as the output of an earlier merge.
+  const uint64_t limit = ExpandedCompactionByteSizeLimit(options_, 1);
+  uint64_t bytes = files[0]->file_size;
+  uint64_t bytes_per_removed_file = ~static_cast<uint64_t>(0);
+  size_t n = 1;
+  while (n < files.size()) {
+    const uint64_t new_bytes = bytes + files[n]->file_size;
+    const uint64_t new_bytes_per_removed_file = new_bytes / n;
+    if (new_bytes > limit ||
+        new_bytes_per_removed_file > bytes_per_removed_file) {
+      break;
+    }
+    bytes = new_bytes;
+    bytes_per_removed_file = new_bytes_per_removed_file;
+    n++;
+  }
+  if (n < static_cast<size_t>(config::kMinFilesForIntraL0Compaction)) {
+    return NULL;
+  }
+
+  Log(options_->info_log, "Intra level-0 compaction of %d of %d files",
+      static_cast<int>(n), static_cast<int>(files.size()));
+  return NewLevel0MergeCompaction(n);
+}
+
+Compaction* VersionSet::NewLevel0MergeCompaction(size_t n) {
+  std::vector<FileMetaData*> runs = current_->files_[0];
+  std::sort(runs.begin(), runs.end(), NewestFirst);
+  assert(n <= runs.size());
+
+  // Level-0 files are ordered by file number, so the output needs a
+  // number above every run it replaces.  It is allocated now so that
+  // runs flushed while the compaction is running are still newer.
+  Compaction* c = new Compaction(options_, 0, 0);
+  c->output_number_ = NewFileNumber();
+  c->max_output_file_size_ = ~static_cast<uint64_t>(0);
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+  c->inputs_[0].assign(runs.begin(), runs.begin() + n);
+  return c;
+}
+
 Compaction* VersionSet::CompactRange(
     int level,
     const InternalKey* begin,
@@ -1375,12 +2022,17 @@ Compaction* VersionSet::CompactRange(
     return NULL;
   }
 
+  if (options_->compaction_style == kCompactionStyleUniversal) {
+    // Only the newest runs may be merged, so merge all of them
+    return NewLevel0MergeCompaction(current_->files_[0].size());
+  }
+
   // Avoid compacting too much in one shot in case the range is large.
   // But we cannot do this for level-0 since level-0 files can overlap
   // and we must not pick one file and drop another older file if the
   // two files overlap.
   if (level > 0) {
-    const uint64_t limit = MaxFileSizeForLevel(level);
+    const uint64_t limit = MaxFileSizeForLevel(options_, level);
     uint64_t total = 0;
     for (size_t i = 0; i < inputs.size(); i++) {
       uint64_t s = inputs[i]->file_size;
@@ -1392,7 +2044,7 @@ Compaction* VersionSet::CompactRange(
     }
   }
 
-  Compaction* c = new Compaction(level);
+  Compaction* c = new Compaction(options_, level, OutputLevel(level));
   c->input_version_ = current_;
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
@@ -1400,15 +2052,25 @@ Compaction* VersionSet::CompactRange(
   return c;
 }
 
-Compaction::Compaction(int level)
+Compaction::Compaction(const Options* options, int level, int output_level)
     : level_(level),
-      max_output_file_size_(MaxFileSizeForLevel(level)),
+      output_level_(output_level),
+      output_number_(0),
+      max_output_file_size_(MaxFileSizeForLevel(options, output_level)),
+      max_grandparent_overlap_bytes_(
+          MaxGrandParentOverlapBytes(options, output_level)),
+      deletion_triggered_(false),
       input_version_(NULL),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
+      has_live_inputs_(false) {
+}
+
+Compaction::Cursor::Cursor()
+    : grandparent_index(0),
+      seen_key(false),
+      overlapped_bytes(0),
+      moved_index(0) {
   for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
+    level_ptrs[i] = 0;
   }
 }
 
@@ -1418,30 +2080,118 @@ Compaction::~Compaction() {
   }
 }
 
-bool Compaction::IsTrivialMove() const {
-  // Avoid a move if there is lots of overlapping grandparent data.
-  // Otherwise, the move could create a parent file that will require
-  // a very expensive merge later on.
-  return (num_input_files(0) == 1 &&
-          num_input_files(1) == 0 &&
-          TotalFileSize(grandparents_) <= kMaxGrandParentOverlapBytes);
+// Returns true iff the user keys of "f" overlap [lo, hi].
+static bool FileOverlaps(const Comparator* ucmp, const FileMetaData* f,
+                         const Slice& lo, const Slice& hi) {
+  return !AfterFile(ucmp, &lo, f) && !BeforeFile(ucmp, &hi, f);
+}
+
+namespace {
+struct BySmallestKey {
+  const InternalKeyComparator* icmp;
+  explicit BySmallestKey(const InternalKeyComparator* c) : icmp(c) { }
+  bool operator()(FileMetaData* a, FileMetaData* b) const {
+    return icmp->Compare(a->smallest, b->smallest) < 0;
+  }
+};
+}  // namespace
+
+int Compaction::MoveNonOverlappingInputs() {
+  if (output_level_ == level_ || deletion_triggered_) {
+    // A moved file would keep its deletion markers
+    return 0;
+  }
+  const InternalKeyComparator* icmp = &input_version_->vset_->icmp_;
+  const Comparator* user_cmp = icmp->user_comparator();
+
+  // A level-0 file may only pass below the level-0 files that it does
+  // not overlap, whether they are inputs or not.  Level-0 files that
+  // are not inputs are moved along if they overlap nothing either.
+  std::vector<FileMetaData*> candidates = inputs_[0];
+  if (level_ == 0) {
+    for (size_t i = 0; i < input_version_->files_[0].size(); i++) {
+      FileMetaData* f = input_version_->files_[0][i];
+      if (std::find(inputs_[0].begin(), inputs_[0].end(), f) ==
+          inputs_[0].end()) {
+        candidates.push_back(f);
+      }
+    }
+  }
+  const std::vector<FileMetaData*>& siblings =
+      (level_ == 0 ? input_version_->files_[0] : inputs_[0]);
+  std::vector<FileMetaData*> kept;
+  for (size_t i = 0; i < candidates.size(); i++) {
+    FileMetaData* f = candidates[i];
+    const bool is_input = (i < inputs_[0].size());
+    const Slice smallest = f->smallest.user_key();
+    const Slice largest = f->largest.user_key();
+    bool overlap = false;
+    for (size_t j = 0; !overlap && j < siblings.size(); j++) {
+      overlap = (siblings[j] != f &&
+                 FileOverlaps(user_cmp, siblings[j], smallest, largest));
+    }
+    if (is_input) {
+      for (size_t j = 0; !overlap && j < inputs_[1].size(); j++) {
+        overlap = FileOverlaps(user_cmp, inputs_[1][j], smallest, largest);
+      }
+    } else if (!overlap) {
+      overlap = input_version_->OverlapInLevel(output_level_, &smallest,
+                                               &largest);
+    }
+    if (!overlap && output_level_ + 1 < config::kNumLevels) {
+      // Avoid a move if there is lots of overlapping grandparent data.
+      // Otherwise, the move could create a parent file that will require
+      // a very expensive merge later on.
+      std::vector<FileMetaData*> grandparents;
+      input_version_->GetOverlappingInputs(output_level_ + 1, &f->smallest,
+                                           &f->largest, &grandparents);
+      overlap = (TotalFileSize(grandparents) > max_grandparent_overlap_bytes_);
+    }
+    if (overlap) {
+      if (is_input) {
+        kept.push_back(f);
+      }
+    } else {
+      edit_.DeleteFile(level_, f->number);
+      edit_.AddFile(output_level_, *f);
+      moved_.push_back(f);
+    }
+  }
+  if (moved_.empty()) {
+    return 0;
+  }
+  std::sort(moved_.begin(), moved_.end(), BySmallestKey(icmp));
+  inputs_[0].swap(kept);
+  if (inputs_[0].empty()) {
+    // The files of output_level_ have nothing left to be merged with
+    inputs_[1].clear();
+  }
+  return moved_.size();
 }
 
 void Compaction::AddInputDeletions(VersionEdit* edit) {
   for (int which = 0; which < 2; which++) {
     for (size_t i = 0; i < inputs_[which].size(); i++) {
-      edit->DeleteFile(level_ + which, inputs_[which][i]->number);
+      edit->DeleteFile(which == 0 ? level_ : output_level_,
+                       inputs_[which][i]->number);
     }
   }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+bool Compaction::IsBaseLevelForKey(const Slice& user_key,
+                                   Cursor* cursor) const {
+  if (output_level_ == level_ &&
+      inputs_[0].size() < input_version_->files_[level_].size()) {
+    // Older runs that are not being compacted may hold the key
+    return false;
+  }
+
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
-  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+  for (int lvl = output_level_ + 1; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    for (; level_ptrs_[lvl] < files.size(); ) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    for (; cursor->level_ptrs[lvl] < files.size(); ) {
+      FileMetaData* f = files[cursor->level_ptrs[lvl]];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1450,34 +2200,236 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      cursor->level_ptrs[lvl]++;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
-  // Scan to find earliest grandparent file that contains key.
+bool Compaction::IsBaseLevelForRange(const Slice& begin,
+                                     const Slice& end) const {
+  if (output_level_ == level_ &&
+      inputs_[0].size() < input_version_->files_[level_].size()) {
+    // Older runs that are not being compacted may hold the keys
+    return false;
+  }
+  for (int lvl = output_level_ + 1; lvl < config::kNumLevels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  Cursor* cursor) const {
   const InternalKeyComparator* icmp = &input_version_->vset_->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
+
+  // Start a new output after every moved file, since the outputs and
+  // the moved files end up in the same level.
+  bool passed_moved = false;
+  while (cursor->moved_index < moved_.size() &&
+      icmp->Compare(internal_key,
+                    moved_[cursor->moved_index]->largest.Encode()) > 0) {
+    passed_moved = cursor->seen_key;
+    cursor->moved_index++;
+  }
+
+  // Scan to find earliest grandparent file that contains key.
+  while (cursor->grandparent_index < grandparents_.size() &&
       icmp->Compare(internal_key,
-                    grandparents_[grandparent_index_]->largest.Encode()) > 0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+                    grandparents_[cursor->grandparent_index]->largest.Encode())
+      > 0) {
+    if (cursor->seen_key) {
+      cursor->overlapped_bytes +=
+          grandparents_[cursor->grandparent_index]->file_size;
     }
-    grandparent_index_++;
+    cursor->grandparent_index++;
   }
-  seen_key_ = true;
+  cursor->seen_key = true;
 
-  if (overlapped_bytes_ > kMaxGrandParentOverlapBytes) {
+  if (passed_moved ||
+      cursor->overlapped_bytes > max_grandparent_overlap_bytes_) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    cursor->overlapped_bytes = 0;
     return true;
   } else {
     return false;
   }
 }
 
+namespace {
+// A data block of a compaction input, identified by the user key of its
+// index entry.
+struct InputBlock {
+  Slice user_key;
+  uint64_t size;
+};
+
+struct ByUserKey {
+  const Comparator* user_cmp;
+  explicit ByUserKey(const Comparator* c) : user_cmp(c) { }
+  bool operator()(const InputBlock& a, const InputBlock& b) const {
+    return user_cmp->Compare(a.user_key, b.user_key) < 0;
+  }
+};
+}  // namespace
+
+void Compaction::GetBoundaries(int n,
+                               std::vector<std::string>* boundaries) const {
+  boundaries->clear();
+  if (n <= 1 || num_input_files(0) + num_input_files(1) <= 1 ||
+      output_number_ != 0) {
+    return;
+  }
+  VersionSet* vset = input_version_->vset_;
+  const Comparator* user_cmp = vset->icmp_.user_comparator();
+
+  // Collect the data blocks of every input file.  Files whose index
+  // cannot be read are treated as a single block.
+  std::vector<std::string> keys;
+  std::vector<uint64_t> sizes;
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      const FileMetaData* f = inputs_[which][i];
+      Table* tableptr;
+      Iterator* iter = vset->table_cache_->NewIterator(
+          ReadOptions(), f->number, f->file_size, &tableptr);
+      if (tableptr != NULL) {
+        tableptr->GetDataBlockBoundaries(&keys, &sizes);
+      } else {
+        keys.push_back(f->largest.Encode().ToString());
+        sizes.push_back(f->file_size);
+      }
+      delete iter;
+    }
+  }
+  std::vector<InputBlock> blocks;
+  uint64_t total_bytes = 0;
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (keys[i].size() < 8) {
+      continue;  // Not an internal key
+    }
+    InputBlock b;
+    b.user_key = ExtractUserKey(keys[i]);
+    b.size = sizes[i];
+    blocks.push_back(b);
+    total_bytes += b.size;
+  }
+  // Every range should hold enough input to fill at least one output file
+  if (static_cast<uint64_t>(n) > total_bytes / max_output_file_size_) {
+    n = total_bytes / max_output_file_size_;
+    if (n <= 1) {
+      return;
+    }
+  }
+  std::sort(blocks.begin(), blocks.end(), ByUserKey(user_cmp));
+
+  // Walk the blocks in key order and cut after the block at which the
+  // next multiple of total_bytes/n has been reached.  Every key of a
+  // block is <= the user key of its index entry, so the cut is placed
+  // at the user key of the following block.
+  uint64_t bytes = 0;
+  for (size_t i = 0; i + 1 < blocks.size(); i++) {
+    bytes += blocks[i].size;
+    const uint64_t target = total_bytes / n * (boundaries->size() + 1);
+    if (bytes < target) {
+      continue;
+    }
+    const Slice& next = blocks[i + 1].user_key;
+    if (user_cmp->Compare(blocks[i].user_key, next) == 0 ||
+        (!boundaries->empty() &&
+         user_cmp->Compare(next, Slice(boundaries->back())) <= 0)) {
+      continue;
+    }
+    boundaries->push_back(next.ToString());
+    if (static_cast<int>(boundaries->size()) == n - 1) {
+      break;
+    }
+  }
+}
+
+namespace {
+struct ByUpperKey {
+  const InternalKeyComparator* icmp;
+  explicit ByUpperKey(const InternalKeyComparator* c) : icmp(c) { }
+  bool operator()(const Compaction::IsolatedBlock& a,
+                  const Compaction::IsolatedBlock& b) const {
+    return icmp->Compare(a.upper, b.upper) < 0;
+  }
+};
+}  // namespace
+
+void Compaction::GetIsolatedBlocks(const std::string* start,
+                                   const std::string* end,
+                                   std::vector<IsolatedBlock>* blocks,
+                                   std::vector<Iterator*>* pins) const {
+  VersionSet* vset = input_version_->vset_;
+  const Comparator* user_cmp = vset->icmp_.user_comparator();
+  std::vector<FileMetaData*> files = live_inputs(0);
+  files.insert(files.end(), live_inputs(1).begin(), live_inputs(1).end());
+
+  for (size_t i = 0; i < files.size(); i++) {
+    const FileMetaData* f = files[i];
+    if (f->num_range_deletions > 0) {
+      continue;  // The file's bounds may not be those of its entries
+    }
+    const Slice file_smallest = f->smallest.user_key();
+    const Slice file_largest = f->largest.user_key();
+    std::vector<FileMetaData*> neighbors;
+    for (size_t j = 0; j < files.size(); j++) {
+      if (j != i && FileOverlaps(user_cmp, files[j],
+                                 file_smallest, file_largest)) {
+        neighbors.push_back(files[j]);
+      }
+    }
+
+    Table* tableptr;
+    Iterator* pin = vset->table_cache_->NewIterator(
+        ReadOptions(), f->number, f->file_size, &tableptr);
+    std::vector<std::string> keys;
+    std::vector<std::string> handles;
+    if (tableptr != NULL) {
+      tableptr->GetDataBlockHandles(&keys, &handles);
+    }
+    const size_t first = blocks->size();
+    IsolatedBlock b;
+    b.lower = f->smallest.Encode().ToString();
+    b.lower_inclusive = true;
+    b.table = tableptr;
+    for (size_t k = 0; k < keys.size(); k++) {
+      if (keys[k].size() < 8) {
+        break;  // Not an internal key
+      }
+      const Slice lo = ExtractUserKey(b.lower);
+      Slice hi = ExtractUserKey(keys[k]);
+      if (user_cmp->Compare(hi, file_largest) > 0) {
+        hi = file_largest;  // The last index key may lie past the file
+      }
+      bool isolated =
+          (start == NULL || user_cmp->Compare(lo, *start) >= 0) &&
+          (end == NULL || user_cmp->Compare(hi, *end) < 0);
+      for (size_t j = 0; isolated && j < neighbors.size(); j++) {
+        isolated = !FileOverlaps(user_cmp, neighbors[j], lo, hi);
+      }
+      if (isolated) {
+        b.upper = keys[k];
+        b.handle = handles[k];
+        b.index = k;
+        blocks->push_back(b);
+      }
+      b.lower = keys[k];
+      b.lower_inclusive = false;
+    }
+    if (blocks->size() > first) {
+      pins->push_back(pin);
+    } else {
+      delete pin;
+    }
+  }
+  std::sort(blocks->begin(), blocks->end(), ByUpperKey(&vset->icmp_));
+}
+
 void Compaction::ReleaseInputs() {
   if (input_version_ != NULL) {
     input_version_->Unref();
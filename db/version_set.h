@@ -30,6 +30,8 @@ namespace log { class Writer; }
 class Compaction;
 class Iterator;
 class MemTable;
+class PinnableSlice;
+class Table;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -63,15 +65,33 @@ class Version {
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
+  // Append to *iters an iterator over the range deletions of every
+  // file in this Version that has any and holds keys within the
+  // iterate bounds of the options.
+  // REQUIRES: This version has been saved (see VersionSet::SaveTo)
+  void AddRangeDeletionIterators(const ReadOptions&,
+                                 std::vector<Iterator*>* iters);
+
   // Lookup the value for key.  If found, store it in *val and
-  // return OK.  Else return a non-OK status.  Fills *stats.
+  // return OK.  Else return a non-OK status.  A value found in a table
+  // is pinned in place rather than copied.  Values that expired at
+  // or before time "now" are not found.  Fills *stats.
   // REQUIRES: lock is not held
   struct GetStats {
     FileMetaData* seek_file;
     int seek_file_level;
   };
-  Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+  Status Get(const ReadOptions&, const LookupKey& key, uint64_t now,
+             PinnableSlice* val, GetStats* stats);
+
+  // Look up each of "keys", which must be sorted by user key, as Get()
+  // would, storing the results in (*vals)[i] and (*statuses)[i] and
+  // filling (*stats)[i].  Keys that fall in the same file are looked
+  // up in a single pass over that file.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, const std::vector<LookupKey*>& keys,
+                uint64_t now, const std::vector<std::string*>& vals,
+                std::vector<Status>* statuses, std::vector<GetStats>* stats);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -95,6 +115,14 @@ class Version {
       const InternalKey* end,           // NULL means after all keys
       std::vector<FileMetaData*>* inputs);
 
+  // Store in "*files" the files in the specified level whose user keys
+  // all lie in [*begin,*end].  A NULL bound means the range is
+  // unbounded on that side.
+  void GetFilesInRange(int level,
+                       const Slice* begin,
+                       const Slice* end,
+                       std::vector<FileMetaData*>* files);
+
   // Returns true iff some file in the specified level overlaps
   // some part of [*smallest_user_key,*largest_user_key].
   // smallest_user_key==NULL represents a key smaller than all keys in the DB.
@@ -118,7 +146,8 @@ class Version {
   friend class VersionSet;
 
   class LevelFileNumIterator;
-  Iterator* NewConcatenatingIterator(const ReadOptions&, int level) const;
+  Iterator* NewConcatenatingIterator(
+      const ReadOptions&, const std::vector<FileMetaData*>* files) const;
 
   // Call func(arg, level, f) for every file that overlaps user_key in
   // order from newest to oldest.  If an invocation of func returns
@@ -141,18 +170,33 @@ class Version {
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
 
+  // File with the largest share of deletion markers past
+  // options.deletion_compaction_ratio, or NULL.  These fields are
+  // initialized by Finalize().
+  FileMetaData* deletion_file_to_compact_;
+  int deletion_file_to_compact_level_;
+
   // Level that should be compacted next and its compaction score.
   // Score < 1 means compaction is not strictly needed.  These fields
   // are initialized by Finalize().
   double compaction_score_;
   int compaction_level_;
 
+  // Level that receives the output of level-0 compactions, and the
+  // target size of each level.  Levels between 0 and base_level_ are
+  // empty.  These fields are initialized by Finalize().
+  int base_level_;
+  double max_bytes_for_level_[config::kNumLevels];
+
   explicit Version(VersionSet* vset)
       : vset_(vset), next_(this), prev_(this), refs_(0),
         file_to_compact_(NULL),
         file_to_compact_level_(-1),
+        deletion_file_to_compact_(NULL),
+        deletion_file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {
+        compaction_level_(-1),
+        base_level_(1) {
   }
 
   ~Version();
@@ -199,6 +243,11 @@ class VersionSet {
     }
   }
 
+  // Recompute the level targets and compaction score of the current
+  // version after the options they depend on have changed.
+  // REQUIRES: the DB mutex is held
+  void UpdateCompactionScore() { Finalize(current_); }
+
   // Return the number of Table files at the specified level.
   int NumLevelFiles(int level) const;
 
@@ -247,10 +296,24 @@ class VersionSet {
   // The caller should delete the iterator when no longer needed.
   Iterator* MakeInputIterator(Compaction* c);
 
+  // Create an iterator over the range deletions of the compaction
+  // inputs for "*c".  The caller should delete the iterator when no
+  // longer needed.
+  Iterator* MakeRangeDeletionIterator(Compaction* c);
+
+  // Stop MakeInputIterator() from reading the inputs of "*c" whose
+  // entries are all deleted by a range deletion in another input at or
+  // below "smallest_snapshot", so that no snapshot can see them.  Such
+  // files are still removed by Compaction::AddInputDeletions().
+  // Returns the number of inputs left out.  Does not require the mutex.
+  int DropCoveredInputs(Compaction* c, SequenceNumber smallest_snapshot);
+
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction() const {
     Version* v = current_;
-    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != NULL);
+    return (v->compaction_score_ >= 1) ||
+           (v->file_to_compact_ != NULL) ||
+           (v->deletion_file_to_compact_ != NULL);
   }
 
   // Add all files listed in any live version to *live.
@@ -276,6 +339,14 @@ class VersionSet {
 
   void Finalize(Version* v);
 
+  // Compute the base level and the target size of every level of *v.
+  void ComputeLevelTargets(Version* v);
+
+  // Return the level that receives the output of compacting "level".
+  int OutputLevel(int level) const {
+    return (level == 0) ? current_->base_level_ : level + 1;
+  }
+
   void GetRange(const std::vector<FileMetaData*>& inputs,
                 InternalKey* smallest,
                 InternalKey* largest);
@@ -287,6 +358,17 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Pick a compaction for kCompactionStyleUniversal.
+  Compaction* PickUniversalCompaction();
+
+  // Pick a compaction that merges level-0 files into one level-0 file,
+  // or return NULL if a level-0 compaction should go to the next level.
+  Compaction* PickIntraLevel0Compaction();
+
+  // Return a compaction that merges the "n" newest level-0 files into
+  // one level-0 file.
+  Compaction* NewLevel0MergeCompaction(size_t n);
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
@@ -324,9 +406,19 @@ class Compaction {
   ~Compaction();
 
   // Return the level that is being compacted.  Inputs from "level"
-  // and "level+1" will be merged to produce a set of "level+1" files.
+  // and output_level() will be merged to produce a set of files in
+  // output_level().
   int level() const { return level_; }
 
+  // Return the level that receives the output files: usually "level+1",
+  // the base level for a level-0 compaction with dynamic level sizes,
+  // or "level" for a universal compaction.
+  int output_level() const { return output_level_; }
+
+  // If non-zero, the compaction writes a single output file with this
+  // number, which was allocated when the compaction was picked.
+  uint64_t output_number() const { return output_number_; }
+
   // Return the object that holds the edits to the descriptor done
   // by this compaction.
   VersionEdit* edit() { return &edit_; }
@@ -334,27 +426,100 @@ class Compaction {
   // "which" must be either 0 or 1
   int num_input_files(int which) const { return inputs_[which].size(); }
 
-  // Return the ith input file at "level()+which" ("which" must be 0 or 1).
+  // Return the ith input file at level() or output_level() ("which"
+  // must be 0 or 1).
   FileMetaData* input(int which, int i) const { return inputs_[which][i]; }
 
   // Maximum size of files to build during this compaction.
   uint64_t MaxOutputFileSize() const { return max_output_file_size_; }
 
-  // Is this a trivial compaction that can be implemented by just
-  // moving a single input file to the next level (no merging or splitting)
-  bool IsTrivialMove() const;
+  // Returns true iff the compaction was picked for the share of
+  // deletion markers in its input.  Its inputs are always rewritten, so
+  // that the markers are dropped where nothing lies below them.
+  bool deletion_triggered() const { return deletion_triggered_; }
+
+  // Move to output_level(), in edit(), every input in level() that
+  // overlaps no other input and not too much data in the level below
+  // output_level(), and stop treating it as an input.  A level-0
+  // compaction also moves the level-0 files that are not inputs and
+  // overlap no other file in level-0 or output_level().  Returns the
+  // number of files moved.  If no input is left in level(), the
+  // compaction is done once edit() is applied.  Moves nothing for a
+  // compaction that is deletion_triggered().
+  int MoveNonOverlappingInputs();
 
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // Position of one pass over the compaction inputs.  The checks below
+  // advance a cursor and expect to see keys in increasing order, so
+  // passes over disjoint key ranges that run concurrently must each use
+  // their own cursor.
+  struct Cursor {
+    // State used to check for number of of overlapping grandparent files
+    size_t grandparent_index;  // Index in grandparents_
+    bool seen_key;             // Some output key has been seen
+    int64_t overlapped_bytes;  // Bytes of overlap between current output
+                               // and grandparent files
+
+    // State for implementing IsBaseLevelForKey
+
+    // level_ptrs holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L > output_level_).
+    size_t level_ptrs[config::kNumLevels];
+
+    // Index in moved_ of the first moved file not passed yet
+    size_t moved_index;
+
+    Cursor();
+  };
+
   // Returns true if the information we have available guarantees that
-  // the compaction is producing data in "level+1" for which no data exists
-  // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  // the compaction is producing data in output_level() for which no data
+  // exists in levels greater than output_level().
+  bool IsBaseLevelForKey(const Slice& user_key, Cursor* cursor) const;
+
+  // Like IsBaseLevelForKey() for every user key in [begin, end).
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end) const;
 
   // Returns true iff we should stop building the current output
-  // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  // before processing "internal_key".  An output never spans a file
+  // moved by MoveNonOverlappingInputs().
+  bool ShouldStopBefore(const Slice& internal_key, Cursor* cursor) const;
+
+  // A data block of an input file that overlaps no other input.  The
+  // entries of the block are all after "lower", or at or after it for
+  // the first block of a table, and at or before "upper".
+  struct IsolatedBlock {
+    std::string lower;
+    bool lower_inclusive;
+    std::string upper;   // Index key of the block
+    std::string handle;  // Encoded BlockHandle of the block
+    Table* table;        // Table that holds the block
+    int index;           // Position of the block in its table
+  };
+
+  // Store in *blocks, in key order, the data blocks of the inputs whose
+  // user keys lie in [*start, *end) and overlap no other input, so that
+  // they can be copied to the outputs as long as none of their entries
+  // has to be dropped.  Iterators that keep the tables of the blocks
+  // open are appended to *pins; the caller deletes them once done with
+  // *blocks.  A NULL bound means the range is unbounded on that side.
+  // Does not require the DB mutex.
+  void GetIsolatedBlocks(const std::string* start, const std::string* end,
+                         std::vector<IsolatedBlock>* blocks,
+                         std::vector<Iterator*>* pins) const;
+
+  // Split the inputs into at most "n" contiguous key ranges that hold
+  // roughly the same number of input bytes.  Stores in *boundaries the
+  // user keys that separate the ranges, in increasing order: range i
+  // holds the user keys in [(*boundaries)[i-1], (*boundaries)[i]).
+  // Splits are only made at data block boundaries and every range gets
+  // at least MaxOutputFileSize() bytes, so fewer ranges may be produced.
+  // Does not require the DB mutex.
+  void GetBoundaries(int n, std::vector<std::string>* boundaries) const;
 
   // Release the input version for the compaction, once the compaction
   // is successful.
@@ -364,31 +529,36 @@ class Compaction {
   friend class Version;
   friend class VersionSet;
 
-  explicit Compaction(int level);
+  Compaction(const Options* options, int level, int output_level);
 
   int level_;
+  int output_level_;
+  uint64_t output_number_;
   uint64_t max_output_file_size_;
+  int64_t max_grandparent_overlap_bytes_;
+  bool deletion_triggered_;
   Version* input_version_;
   VersionEdit edit_;
 
-  // Each compaction reads inputs from "level_" and "level_+1"
+  // Each compaction reads inputs from "level_" and "output_level_"
   std::vector<FileMetaData*> inputs_[2];      // The two sets of inputs
 
-  // State used to check for number of of overlapping grandparent files
-  // (parent == level_ + 1, grandparent == level_ + 2)
+  // The inputs that have to be read, if some were found to be
+  // obsolete by VersionSet::DropCoveredInputs()
+  bool has_live_inputs_;
+  std::vector<FileMetaData*> live_inputs_[2];
+
+  const std::vector<FileMetaData*>& live_inputs(int which) const {
+    return has_live_inputs_ ? live_inputs_[which] : inputs_[which];
+  }
+
+  // Files that are checked for overlap with the outputs
+  // (parent == output_level_, grandparent == output_level_ + 1)
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
+
+  // Inputs moved to output_level_ by MoveNonOverlappingInputs(), in
+  // key order
+  std::vector<FileMetaData*> moved_;
 };
 
 }  // namespace leveldb
@@ -8,7 +8,11 @@
 //    data: record[count]
 // record :=
 //    kTypeValue varstring varstring         |
-//    kTypeDeletion varstring
+//    kTypeDeletion varstring                |
+//    kTypeValueWithExpiry varstring varstring |
+//    kTypeRangeDeletion varstring varstring
+// (the value of a kTypeValueWithExpiry record ends in the fixed64
+// expiry time, see AppendExpiringValue())
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
@@ -34,6 +38,14 @@ WriteBatch::~WriteBatch() { }
 
 WriteBatch::Handler::~Handler() { }
 
+void WriteBatch::Handler::PutWithExpiry(const Slice& key, const Slice& value,
+                                        uint64_t expiry) {
+  Put(key, value);
+}
+
+void WriteBatch::Handler::DeleteRange(const Slice& begin, const Slice& end) {
+}
+
 void WriteBatch::Clear() {
   rep_.clear();
   rep_.resize(kHeader);
@@ -68,6 +80,25 @@ Status WriteBatch::Iterate(Handler* handler) const {
           return Status::Corruption("bad WriteBatch Delete");
         }
         break;
+      case kTypeRangeDeletion:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->DeleteRange(key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch DeleteRange");
+        }
+        break;
+      case kTypeValueWithExpiry: {
+        uint64_t expiry;
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value) &&
+            ParseExpiringValue(&value, &expiry)) {
+          handler->PutWithExpiry(key, value, expiry);
+        } else {
+          return Status::Corruption("bad WriteBatch PutWithExpiry");
+        }
+        break;
+      }
       default:
         return Status::Corruption("unknown WriteBatch tag");
     }
@@ -102,6 +133,23 @@ void WriteBatch::Put(const Slice& key, const Slice& value) {
   PutLengthPrefixedSlice(&rep_, value);
 }
 
+void WriteBatch::DeleteRange(const Slice& begin, const Slice& end) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeRangeDeletion));
+  PutLengthPrefixedSlice(&rep_, begin);
+  PutLengthPrefixedSlice(&rep_, end);
+}
+
+void WriteBatch::PutWithExpiry(const Slice& key, const Slice& value,
+                               uint64_t expiry) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeValueWithExpiry));
+  PutLengthPrefixedSlice(&rep_, key);
+  PutVarint32(&rep_, value.size() + 8);
+  rep_.append(value.data(), value.size());
+  PutFixed64(&rep_, expiry);
+}
+
 void WriteBatch::Delete(const Slice& key) {
   WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
   rep_.push_back(static_cast<char>(kTypeDeletion));
@@ -122,6 +170,20 @@ class MemTableInserter : public WriteBatch::Handler {
     mem_->Add(sequence_, kTypeDeletion, key, Slice());
     sequence_++;
   }
+  virtual void PutWithExpiry(const Slice& key, const Slice& value,
+                             uint64_t expiry) {
+    scratch_.clear();
+    AppendExpiringValue(&scratch_, value, expiry);
+    mem_->Add(sequence_, kTypeValueWithExpiry, key, scratch_);
+    sequence_++;
+  }
+  virtual void DeleteRange(const Slice& begin, const Slice& end) {
+    mem_->Add(sequence_, kTypeRangeDeletion, begin, end);
+    sequence_++;
+  }
+
+ private:
+  std::string scratch_;
 };
 }  // namespace
 
@@ -38,11 +38,43 @@ static std::string PrintContents(WriteBatch* b) {
         state.append(")");
         count++;
         break;
+      case kTypeValueWithExpiry: {
+        Slice value = iter->value();
+        uint64_t expiry = 0;
+        ASSERT_TRUE(ParseExpiringValue(&value, &expiry));
+        state.append("PutWithExpiry(");
+        state.append(ikey.user_key.ToString());
+        state.append(", ");
+        state.append(value.ToString());
+        state.append(", ");
+        state.append(NumberToString(expiry));
+        state.append(")");
+        count++;
+        break;
+      }
+      case kTypeRangeDeletion:
+        state.append("Misplaced()");
+        break;
     }
     state.append("@");
     state.append(NumberToString(ikey.sequence));
   }
   delete iter;
+  iter = mem->NewRangeDeletionIterator();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+    ASSERT_EQ(kTypeRangeDeletion, ikey.type);
+    state.append("DeleteRange(");
+    state.append(ikey.user_key.ToString());
+    state.append(", ");
+    state.append(iter->value().ToString());
+    state.append(")");
+    count++;
+    state.append("@");
+    state.append(NumberToString(ikey.sequence));
+  }
+  delete iter;
   if (!s.ok()) {
     state.append("ParseError()");
   } else if (count != WriteBatchInternal::Count(b)) {
@@ -74,6 +106,32 @@ TEST(WriteBatchTest, Multiple) {
             PrintContents(&batch));
 }
 
+TEST(WriteBatchTest, PutWithExpiry) {
+  WriteBatch batch;
+  batch.PutWithExpiry(Slice("foo"), Slice("bar"), 1000);
+  batch.Put(Slice("baz"), Slice("boo"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(2, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ("Put(baz, boo)@101"
+            "PutWithExpiry(foo, bar, 1000)@100",
+            PrintContents(&batch));
+}
+
+TEST(WriteBatchTest, DeleteRange) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.DeleteRange(Slice("a"), Slice("m"));
+  batch.Delete(Slice("box"));
+  batch.DeleteRange(Slice("x"), Slice("z"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(4, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ("Delete(box)@102"
+            "Put(foo, bar)@100"
+            "DeleteRange(a, m)@101"
+            "DeleteRange(x, z)@103",
+            PrintContents(&batch));
+}
+
 TEST(WriteBatchTest, Corruption) {
   WriteBatch batch;
   batch.Put(Slice("foo"), Slice("bar"));
@@ -10,8 +10,8 @@
 // length strings, may use the length of the string as the charge for
 // the string.
 //
-// A builtin cache implementation with a least-recently-used eviction
-// policy is provided.  Clients may use their own implementations if
+// Builtin cache implementations with least-recently-used and CLOCK
+// eviction policies are provided.  Clients may use their own implementations if
 // they want something more sophisticated (like scan-resistance, a
 // custom eviction policy, variable cache sizing, etc.)
 
@@ -29,6 +29,34 @@ class Cache;
 // of Cache uses a least-recently-used eviction policy.
 extern Cache* NewLRUCache(size_t capacity);
 
+// Like NewLRUCache(capacity), but up to "high_pri_pool_ratio" of the
+// capacity is set aside for entries inserted with high priority.  Such
+// entries are only evicted once every entry of low priority is gone, or
+// to make room for newer entries of high priority.
+extern Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio);
+
+// Like NewLRUCache(capacity, high_pri_pool_ratio), but entries of low
+// priority are inserted at the midpoint of the LRU list: they start in
+// a probationary segment at its old end, and only move up when they
+// are looked up again.  Entries that were looked up may use up to
+// 1 - "probation_ratio" of the capacity outside the high priority
+// pool, and the oldest of them fall back into probation.  Reading many
+// entries once, as a scan does, then only evicts other entries on
+// probation.  A "probation_ratio" of zero disables the segment.
+extern Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio,
+                          double probation_ratio);
+
+// Create a new cache with a fixed size capacity that uses the CLOCK
+// eviction policy, an approximation of least-recently-used.  Lookups
+// and releases take no lock, which helps when many threads read through
+// the same cache; inserts and erases still lock one of its shards.
+// Each shard holds a fixed number of entries, sized for entries of
+// about "estimated_entry_charge" (4KB, the default block size, unless
+// given).  Much smaller entries are evicted before the capacity is used
+// up.
+extern Cache* NewClockCache(size_t capacity);
+extern Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge);
+
 class Cache {
  public:
   Cache() { }
@@ -40,6 +68,11 @@ class Cache {
   // Opaque handle to an entry stored in the cache.
   struct Handle { };
 
+  enum Priority {
+    kHighPriority,
+    kLowPriority
+  };
+
   // Insert a mapping from key->value into the cache and assign it
   // the specified charge against the total cache capacity.
   //
@@ -52,6 +85,13 @@ class Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  // Like Insert() above, but the cache may use "priority" to decide
+  // which entries to evict first.  Insert() above uses kLowPriority.
+  // The default implementation ignores "priority".
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority);
+
   // If the cache has no mapping for "key", returns NULL.
   //
   // Else return a handle that corresponds to the mapping.  The caller
@@ -81,6 +121,12 @@ class Cache {
   // its cache keys.
   virtual uint64_t NewId() = 0;
 
+  // Return the combined charge of all the entries in the cache, and of
+  // entries that are gone from it but still referenced by a handle.
+  // The default implementation, for caches that do not track it,
+  // returns 0.
+  virtual size_t TotalCharge() const;
+
  private:
   void LRU_Remove(Handle* e);
   void LRU_Append(Handle* e);
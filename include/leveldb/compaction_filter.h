@@ -0,0 +1,44 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a custom CompactionFilter object.
+// Compactions call it for the live value of every key they rewrite,
+// which lets an application expire or transform data in the background
+// instead of scanning the database and issuing deletions itself.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+
+#include <string>
+
+namespace leveldb {
+
+class Slice;
+
+class CompactionFilter {
+ public:
+  virtual ~CompactionFilter();
+
+  // Return the name of this filter.  Used only for logging.
+  virtual const char* Name() const = 0;
+
+  // Called for the newest value of "key" when no snapshot can observe
+  // it, with "level" set to the input level of the compaction.  Values
+  // that some snapshot can still read are passed through unchanged.
+  //
+  // Return true to delete the key.  Otherwise, to replace its value,
+  // store the new value in *new_value and set *value_changed to true.
+  //
+  // Compactions run on background threads, possibly several at once,
+  // so this method must be thread-safe.
+  virtual bool Filter(int level,
+                      const Slice& key,
+                      const Slice& existing_value,
+                      std::string* new_value,
+                      bool* value_changed) const = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
@@ -7,8 +7,12 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/pinnable_slice.h"
 
 namespace leveldb {
 
@@ -68,6 +72,14 @@ class DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Remove the database entries (if any) for all keys in the range
+  // [begin, end).  Returns OK on success, and a non-OK status on error;
+  // it is an error if "begin" does not precede "end".
+  // Unlike deleting each key, this writes a single record however many
+  // keys the range covers.
+  virtual Status DeleteRange(const WriteOptions& options,
+                             const Slice& begin, const Slice& end);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -83,6 +95,28 @@ class DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key, std::string* value) = 0;
 
+  // Like the Get() above, but makes *value refer to the value found.
+  // A value that sits in a table block is not copied: *value keeps the
+  // block in memory until value->Reset() is called or *value is
+  // destroyed, which must happen before this db is deleted.  Other
+  // values are copied into *value.  *value is reset first.
+  //
+  // The default implementation copies every value.
+  virtual Status Get(const ReadOptions& options,
+                     const Slice& key, PinnableSlice* value);
+
+  // Look up every key in "keys" as Get() would, storing the value found
+  // for keys[i] in (*values)[i] and the outcome in (*statuses)[i].  Both
+  // vectors are resized to keys.size().  All keys are looked up in the
+  // same state of the database, which is cheaper than separate Get()
+  // calls when there are many keys.
+  //
+  // The default implementation calls Get() for each key.
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -140,6 +174,26 @@ class DB {
   //    db->CompactRange(NULL, NULL);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
 
+  // Remove every table file whose keys all lie in [*begin,*end],
+  // without reading or rewriting any data.  A NULL bound is treated as
+  // in CompactRange().  Keys in the range that are held by memtables or
+  // by files reaching outside it are left alone, so an older value of
+  // a removed key may become visible again; follow up with
+  // DeleteRange() to remove the rest of the range.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status DeleteFilesInRange(const Slice* begin, const Slice* end);
+
+  // Change options of an open database.  Each entry of "new_options"
+  // maps the name of a field of Options to its new value in decimal,
+  // e.g. {"level0_file_num_compaction_trigger", "8"}.  Only the fields
+  // listed under "Parameters that shape the LSM tree" in options.h may
+  // be changed.  If a name is unknown or a value is out of range,
+  // returns a non-OK status and leaves every option unchanged.
+  //
+  // The default implementation returns NotSupported.
+  virtual Status SetOptions(const std::map<std::string, std::string>& new_options);
+
  private:
   // No copying allowed
   DB(const DB&);
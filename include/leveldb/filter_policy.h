@@ -47,6 +47,12 @@ class FilterPolicy {
   // This method may return true or false if the key was not on the
   // list, but it should aim to return false with a high probability.
   virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const = 0;
+
+  // Return false only if "filter" shows that no key passed to
+  // CreateFilter() shares the prefix of "key", for policies that also
+  // summarize key prefixes (see Options::prefix_extractor).  The
+  // default implementation summarizes no prefixes and returns true.
+  virtual bool PrefixMayMatch(const Slice& key, const Slice& filter) const;
 };
 
 // Return a new filter policy that uses a bloom filter with approximately
@@ -65,6 +71,35 @@ class FilterPolicy {
 // trailing spaces in keys.
 extern const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy that, like NewBloomFilterPolicy(), uses a
+// bloom filter with approximately the specified number of bits per key,
+// but keeps all the bits of a key within one 64-byte block.  A lookup
+// then costs at most one cache miss instead of one per probe.  To make
+// up for the bits of a block filling unevenly it uses one more probe,
+// for a false positive rate of ~1% at 10 bits per key.  Probes use AVX2
+// instructions when the library is built with them enabled.  The
+// filters it creates are not compatible with those of
+// NewBloomFilterPolicy().
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.  The note above about comparators that
+// ignore parts of keys applies to this policy too.
+extern const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key);
+
+// Return a new filter policy that uses a Ribbon filter, a static filter
+// with about the false positive rate of NewBloomFilterPolicy() for the
+// same bits_per_key in ~25% less space.  Building a filter takes longer
+// than building a bloom filter.  The savings hold for filters of a few
+// hundred keys or more, so the policy is best combined with
+// Options::whole_table_filter.  The filters it creates are not
+// compatible with those of the bloom filter policies, whose tables
+// keep being read with their own policy.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.  The note above about comparators that
+// ignore parts of keys applies to this policy too.
+extern const FilterPolicy* NewRibbonFilterPolicy(int bits_per_key);
+
 }
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
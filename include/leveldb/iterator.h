@@ -20,6 +20,8 @@
 
 namespace leveldb {
 
+class PinnableSlice;
+
 class Iterator {
  public:
   Iterator();
@@ -75,6 +77,11 @@ class Iterator {
   typedef void (*CleanupFunction)(void* arg1, void* arg2);
   void RegisterCleanup(CleanupFunction function, void* arg1, void* arg2);
 
+  // Hand the functions registered so far over to *pinned, which then
+  // calls them instead of this iterator.  Lets a value outlive the
+  // iterator that produced it.
+  void DelegateCleanupsTo(PinnableSlice* pinned);
+
  private:
   struct Cleanup {
     CleanupFunction function;
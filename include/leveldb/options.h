@@ -6,14 +6,18 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 namespace leveldb {
 
 class Cache;
+class CompactionFilter;
 class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class Slice;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -27,6 +31,20 @@ enum CompressionType {
   kSnappyCompression = 0x1
 };
 
+// The way compactions arrange the table files of a database.
+enum CompactionStyle {
+  // Files are organized in levels of exponentially growing size, and a
+  // compaction merges a part of one level into the next level.
+  kCompactionStyleLevel     = 0x0,
+
+  // Every file in level-0 is a sorted run, and a compaction merges
+  // runs of similar size into one larger run.  Writes much less data
+  // than kCompactionStyleLevel at the cost of more runs to read and
+  // more temporary space.  A database that has files outside of
+  // level-0 cannot be opened with this style.
+  kCompactionStyleUniversal = 0x1
+};
+
 // Options to control the behavior of a database (passed to DB::Open)
 struct Options {
   // -------------------
@@ -93,10 +111,27 @@ struct Options {
   // a block is the unit of reading from disk).
 
   // If non-NULL, use the specified cache for blocks.
-  // If NULL, leveldb will automatically create and use an 8MB internal cache.
+  // If NULL, leveldb will automatically create and use an 8MB internal cache
+  // that inserts new blocks at its midpoint (see NewLRUCache in cache.h).
   // Default: NULL
   Cache* block_cache;
 
+  // If true, the index block and filter of each table live in
+  // block_cache, with high priority (see NewLRUCache()), instead of in
+  // memory for as long as the table is open.  All table memory then
+  // counts against the capacity of block_cache, at the cost of a cache
+  // lookup, or a read if they were evicted, on every access to a table.
+  //
+  // Default: false
+  bool cache_index_and_filter_blocks;
+
+  // If true along with cache_index_and_filter_blocks, the index block
+  // and filter of tables opened while in level 0, which most reads
+  // consult, are pinned in block_cache until the table is closed.
+  //
+  // Default: false
+  bool pin_l0_filter_and_index_blocks_in_cache;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -135,6 +170,180 @@ struct Options {
   // Default: NULL
   const FilterPolicy* filter_policy;
 
+  // If non-NULL along with filter_policy, the prefix of every key in
+  // the domain of this transform is added to the filters as well, which
+  // lets iterators with ReadOptions::prefix_same_as_start skip files
+  // that hold no key with the prefix of a Seek() target.  Changing the
+  // transform makes the filters of existing files unusable until they
+  // are compacted.
+  //
+  // Default: NULL
+  const SliceTransform* prefix_extractor;
+
+  // If true, new tables carry a single filter built over all of their
+  // keys instead of one filter per 2KB of data.  A lookup then probes
+  // one better-sized filter before it even consults the index, at the
+  // cost of holding the keys of a whole table in memory while it is
+  // built.  Tables of either kind can be read regardless of this setting.
+  //
+  // Default: false
+  bool whole_table_filter;
+
+  // If true, each new data block also carries a small hash index that
+  // maps keys to their restart interval (see block_restart_interval).
+  // Point lookups in cached blocks then jump straight to the interval
+  // instead of binary searching the block, at the cost of about one
+  // byte per key.  Blocks with more than 253 restart intervals are
+  // built without the index.  Older versions of this library cannot
+  // read tables that contain such blocks.
+  //
+  // Default: false
+  bool data_block_hash_index;
+
+  // If non-zero, the index of each new table is split into partitions
+  // of about this many bytes behind a small top-level index, and the
+  // filter into one filter per partition, in the format used for
+  // whole_table_filter.  An open table then only keeps the top-level
+  // index in memory; partitions are read on demand through block_cache,
+  // so memory use follows the working set rather than the amount of
+  // data.  Older versions of this library cannot read such tables.
+  //
+  // Default: 0
+  size_t index_partition_size;
+
+  // If non-NULL, compactions pass the live value of every key they
+  // rewrite to this filter, which may delete the key or replace its
+  // value.  Values still visible to a snapshot are left alone.  Data
+  // flushed from the memtable is not filtered until it is compacted.
+  //
+  // Default: NULL
+  const CompactionFilter* compaction_filter;
+
+  // An iterator that passes over more than this many consecutive
+  // entries it does not return, such as overwritten versions of one
+  // key or entries newer than its snapshot, seeks past them instead of
+  // stepping through the rest one at a time.
+  //
+  // Default: 8
+  int max_sequential_skip_in_iterations;
+
+  // -------------------
+  // Parameters that shape the LSM tree.  These can be changed on an
+  // open database with DB::SetOptions().
+
+  // Level-0 compaction is started when we hit this many files.
+  //
+  // Default: 4
+  int level0_file_num_compaction_trigger;
+
+  // Soft limit on number of level-0 files.  We slow down writes at this
+  // point.
+  //
+  // Default: 8
+  int level0_slowdown_writes_trigger;
+
+  // Maximum number of level-0 files.  We stop writes at this point.
+  //
+  // Default: 12
+  int level0_stop_writes_trigger;
+
+  // Maximum level to which a new compacted memtable is pushed if it
+  // does not create overlap.
+  //
+  // Default: 2
+  int max_mem_compact_level;
+
+  // Size of the files written by compactions into level-1.  Each
+  // following level uses files target_file_size_multiplier times as
+  // large as the level before it.
+  //
+  // Default: 2MB and 1
+  uint64_t target_file_size_base;
+  int target_file_size_multiplier;
+
+  // A compaction output file is closed once it overlaps this many
+  // target file sizes of data in the level below its own.
+  //
+  // Default: 10
+  int max_grandparent_overlap_factor;
+
+  // A compaction is only widened to more files in its input level if
+  // it stays below this many target file sizes of input.
+  //
+  // Default: 25
+  int expanded_compaction_factor;
+
+  // Total size of the files in level-1.  Each following level may hold
+  // max_bytes_for_level_multiplier times as much as the level before it.
+  //
+  // Default: 10MB and 10
+  uint64_t max_bytes_for_level_base;
+  int max_bytes_for_level_multiplier;
+
+  // A file in which deletion markers make up at least this fraction of
+  // the entries is compacted into the next level when no level is over
+  // its size target, even if reads have not hit it yet, so that scans
+  // stop skipping the markers and the keys they hide get dropped.
+  // Files with fewer than deletion_compaction_min_entries entries are
+  // left alone.  A ratio of 0 disables this.  A database opened with a
+  // positive ratio keeps entry counts in its manifest that older
+  // releases cannot read; 0.5 is a reasonable setting.
+  //
+  // Default: 0 (disabled) and 1000
+  double deletion_compaction_ratio;
+  uint64_t deletion_compaction_min_entries;
+
+  // -------------------
+  // Parameters that control how compactions run
+
+  // Maximum number of threads that may work on a single compaction.
+  // A compaction that reads enough data to fill several output files is
+  // split into disjoint key ranges of roughly equal size, each of which
+  // is merged by its own thread, and the outputs of all ranges are
+  // installed together.  A value of 1 merges every compaction on the
+  // background thread.
+  //
+  // Default: 1
+  int max_subcompactions;
+
+  // If true, the target size of every level is derived from the size of
+  // the largest level instead of growing by a fixed factor from level-1,
+  // so that each level holds max_bytes_for_level_multiplier times less
+  // data than the next one.  Level-0 files are compacted straight into
+  // the highest level whose target fits max_bytes_for_level_base, and
+  // the levels above it stay empty.  With the default multiplier this
+  // bounds space amplification to about 1.1x at any database size.
+  // Only applies to kCompactionStyleLevel.
+  //
+  // Default: false
+  bool dynamic_level_bytes;
+
+  // Algorithm used to pick compactions.
+  //
+  // Default: kCompactionStyleLevel
+  CompactionStyle compaction_style;
+
+  // The options below only apply to kCompactionStyleUniversal.  A
+  // compaction always merges the newest sorted runs.
+
+  // Percentage of flexibility when comparing run sizes: the next older
+  // run is added to a compaction if it is no larger than the runs
+  // picked so far plus this percentage of their size.
+  //
+  // Default: 1
+  int universal_size_ratio;
+
+  // Minimum number of runs merged by a compaction picked by size ratio.
+  //
+  // Default: 2
+  int universal_min_merge_width;
+
+  // All runs are merged into one once the newer runs together hold
+  // more than this percentage of the bytes of the oldest run.
+  //
+  // Default: 200
+  int universal_max_size_amplification_percent;
+
   // Create an Options object with default values for all fields.
   Options();
 };
@@ -158,10 +367,31 @@ struct ReadOptions {
   // Default: NULL
   const Snapshot* snapshot;
 
+  // If non-NULL, an iterator created with these options only returns
+  // keys >= *iterate_lower_bound and < *iterate_upper_bound, and does
+  // not read files that hold no such keys.  Seeks before the lower
+  // bound go to the lower bound.  The bounds must stay alive as long
+  // as the iterator.  Ignored by Get().
+  // Default: NULL
+  const Slice* iterate_lower_bound;
+  const Slice* iterate_upper_bound;
+
+  // If true and Options::prefix_extractor is set, an iterator Seek()
+  // to a key in the extractor's domain only returns keys that share
+  // its prefix, and files whose filters rule the prefix out are
+  // skipped without reading any of their data blocks.  Only Seek()
+  // followed by Next() is supported in this mode: Prev() and
+  // SeekToLast() may miss keys.
+  // Default: false
+  bool prefix_same_as_start;
+
   ReadOptions()
       : verify_checksums(false),
         fill_cache(true),
-        snapshot(NULL) {
+        snapshot(NULL),
+        iterate_lower_bound(NULL),
+        iterate_upper_bound(NULL),
+        prefix_same_as_start(false) {
   }
 };
 
@@ -185,8 +415,17 @@ struct WriteOptions {
   // Default: false
   bool sync;
 
+  // If non-zero, DB::Put() stores a value that expires this many seconds
+  // after the write.  Expired values are no longer returned by reads and
+  // are discarded by compactions.  Writes through DB::Write() set expiry
+  // times per entry with WriteBatch::PutWithExpiry() instead.
+  //
+  // Default: 0
+  uint64_t ttl;
+
   WriteOptions()
-      : sync(false) {
+      : sync(false),
+        ttl(0) {
   }
 };
 
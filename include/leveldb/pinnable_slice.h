@@ -0,0 +1,71 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PinnableSlice is a Slice that can keep the storage it refers to
+// alive.  DB::Get() uses it to hand out a value where it sits in a
+// cached table block instead of copying it.  Whatever holds the storage
+// is released when the slice is Reset() or destroyed.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+#define STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+
+#include <string>
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class PinnableSlice : public Slice {
+ public:
+  // Create an empty slice that holds nothing.
+  PinnableSlice();
+
+  // Calls Reset().
+  ~PinnableSlice();
+
+  // Refer to "s" in place.  Whatever keeps the storage of "s" alive
+  // must be handed over with RegisterCleanup().
+  void PinSlice(const Slice& s) {
+    assert(!pinned_);
+    Slice::operator=(s);
+    pinned_ = true;
+  }
+
+  // Refer to the contents of *GetSelf(), which the caller has filled.
+  void PinSelf() {
+    Slice::operator=(self_);
+  }
+
+  // Return the buffer for a value that is copied into this slice.
+  std::string* GetSelf() { return &self_; }
+
+  // Return true if this slice refers to storage that it does not own.
+  bool IsPinned() const { return pinned_; }
+
+  // Arrange for (*function)(arg1, arg2) to be called when this slice
+  // is reset or destroyed.
+  typedef void (*CleanupFunction)(void* arg1, void* arg2);
+  void RegisterCleanup(CleanupFunction function, void* arg1, void* arg2);
+
+  // Run the registered cleanup functions and make this slice empty.
+  void Reset();
+
+ private:
+  struct Cleanup {
+    CleanupFunction function;
+    void* arg1;
+    void* arg2;
+    Cleanup* next;
+  };
+  Cleanup cleanup_;
+  std::string self_;
+  bool pinned_;
+
+  // No copying allowed
+  PinnableSlice(const PinnableSlice&);
+  void operator=(const PinnableSlice&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
@@ -0,0 +1,53 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SliceTransform maps a key to a prefix of it.  When one is supplied
+// in Options::prefix_extractor, the prefixes of keys are added to the
+// table filters as well, so that iterators can tell on Seek() that a
+// file holds no key with a given prefix (see
+// ReadOptions::prefix_same_as_start).
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <stddef.h>
+
+namespace leveldb {
+
+class Slice;
+
+class SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // Return the name of this transform.  The name is recorded with the
+  // filters built using the transform, so it must change whenever
+  // Transform() changes its results.  Otherwise filters built with the
+  // old transform may be consulted with the new one.
+  virtual const char* Name() const = 0;
+
+  // Return the prefix of "key".  The result must be a prefix of "key",
+  // and all keys that share a prefix must be contiguous in the order
+  // of the comparator.
+  //
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice& key) const = 0;
+
+  // Return true iff "key" has a prefix.  Keys outside the domain are
+  // only added to filters as whole keys.
+  virtual bool InDomain(const Slice& key) const = 0;
+};
+
+// Return a new transform that maps every key of at least "prefix_len"
+// bytes to its first "prefix_len" bytes.  Shorter keys are outside the
+// domain.  Only suitable for comparators that order keys by their
+// leading bytes first, such as BytewiseComparator().
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+extern const SliceTransform* NewFixedPrefixTransform(size_t prefix_len);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
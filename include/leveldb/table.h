@@ -6,6 +6,8 @@
 #define STORAGE_LEVELDB_INCLUDE_TABLE_H_
 
 #include <stdint.h>
+#include <string>
+#include <vector>
 #include "leveldb/iterator.h"
 
 namespace leveldb {
@@ -14,6 +16,7 @@ class Block;
 class BlockHandle;
 class Footer;
 struct Options;
+class PinnableSlice;
 class RandomAccessFile;
 struct ReadOptions;
 class TableCache;
@@ -55,25 +58,96 @@ class Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // Append the index key of every data block in the table to *keys, in
+  // order, and the number of file bytes used by the block to *sizes.
+  // The index key of a block is >= every key in the block and < every
+  // key in the blocks that follow it.
+  void GetDataBlockBoundaries(std::vector<std::string>* keys,
+                              std::vector<uint64_t>* sizes) const;
+
+  // Like GetDataBlockBoundaries(), but append the encoded location of
+  // every data block to *handles instead of its size.
+  void GetDataBlockHandles(std::vector<std::string>* keys,
+                           std::vector<std::string>* handles) const;
+
+  // Read the data block at "handle", as returned by
+  // GetDataBlockHandles(), without decoding it: *stored is set to the
+  // block as it is stored in the file, which TableBuilder::AddBlock()
+  // can copy to another table, and *entries to a new iterator over its
+  // entries.  The checksum of the block is always verified.
+  Status ReadDataBlock(const Slice& handle, std::string* stored,
+                       Iterator** entries) const;
+
+  // Returns a new iterator over the range deletion entries stored in
+  // the table with TableBuilder::AddRangeDeletion(), which are kept
+  // apart from the table contents.  The iterator is empty if there
+  // are none.
+  Iterator* NewRangeDeletionIterator() const;
+
  private:
   struct Rep;
   Rep* rep_;
 
   explicit Table(Rep* rep) { rep_ = rep; }
+
+  // Like Open(), but if "pin_index_and_filter" is true and the index
+  // block and filter belong in the block cache, they stay there until
+  // the table is deleted.
+  static Status Open(const Options& options,
+                     RandomAccessFile* file,
+                     uint64_t file_size,
+                     bool pin_index_and_filter,
+                     Table** table);
+
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
 
+  // Like BlockReader(), for the partitions of a partitioned index.
+  static Iterator* IndexPartitionReader(void*, const ReadOptions&,
+                                        const Slice&);
+
+  // Like BlockReader(), but if "point_lookup" is true the iterator only
+  // serves Seek() to exact keys, which lets it use the block's hash index.
+  static Iterator* BlockReader(void*, const ReadOptions&, const Slice&,
+                               bool point_lookup);
+
+  // Return false if the filter shows that the table holds no key >=
+  // "key" with the prefix of "key".
+  static bool PrefixMayMatch(void*, const Slice& key);
+
+  // Return false if the filter partition that covers "key" shows that
+  // the table does not hold it (or, if "prefix" is true, any key >=
+  // "key" with its prefix).  REQUIRES: the table has partitioned filters.
+  bool PartitionMayMatch(const ReadOptions&, const Slice& key,
+                         bool prefix) const;
+
+  // Returns an iterator over the index entries of all data blocks,
+  // which reads partitions as needed if the index is partitioned.
+  Iterator* NewIndexIterator(const ReadOptions&) const;
+
   // Calls (*handle_result)(arg, ...) with the entry found after a call
   // to Seek(key).  May not make such a call if filter policy says
-  // that key is not present.
+  // that key is not present.  If such a call is made and "pinned" is
+  // non-NULL, the entry stays in memory until *pinned is reset.
   friend class TableCache;
   Status InternalGet(
       const ReadOptions&, const Slice& key,
       void* arg,
+      void (*handle_result)(void* arg, const Slice& k, const Slice& v),
+      PinnableSlice* pinned = NULL);
+
+  // Like InternalGet() for each of the sorted "keys" in turn, passing
+  // args[i] along with the entry found for keys[i].  The index block is
+  // walked once and keys that fall in the same data block share a
+  // single read of it.
+  Status InternalMultiGet(
+      const ReadOptions&, const std::vector<Slice>& keys,
+      const std::vector<void*>& args,
       void (*handle_result)(void* arg, const Slice& k, const Slice& v));
 
 
   void ReadMeta(const Footer& footer);
-  void ReadFilter(const Slice& filter_handle_value);
+  void ReadFilter(const Slice& filter_handle_value, bool whole_table);
+  void ReadRangeDeletions(const Slice& handle_value);
 
   // No copying allowed
   Table(const Table&);
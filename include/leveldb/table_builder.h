@@ -21,6 +21,7 @@ namespace leveldb {
 
 class BlockBuilder;
 class BlockHandle;
+class Iterator;
 class WritableFile;
 
 class TableBuilder {
@@ -46,6 +47,24 @@ class TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value);
 
+  // Add a range deletion entry.  These are stored in a block of their
+  // own rather than with the table contents, and read back with
+  // Table::NewRangeDeletionIterator().
+  // REQUIRES: key is after any previously added range deletion key
+  //           according to comparator.
+  // REQUIRES: Finish(), Abandon() have not been called
+  void AddRangeDeletion(const Slice& key, const Slice& value);
+
+  // Advanced operation: append a data block of another table without
+  // decoding it.  "stored" is the block as read by
+  // Table::ReadDataBlock() and "entries" iterates over its entries,
+  // which are counted and added to the filter.  Buffered key/value
+  // pairs are flushed first.  The block keeps its own compression.
+  // REQUIRES: the entries are after any previously added key according
+  //           to comparator.
+  // REQUIRES: Finish(), Abandon() have not been called
+  void AddBlock(const Slice& stored, Iterator* entries);
+
   // Advanced operation: flush any buffered key/value pairs to file.
   // Can be used to ensure that two adjacent entries never live in
   // the same data block.  Most clients should not need to use this method.
@@ -77,6 +96,8 @@ class TableBuilder {
  private:
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+  void MaybeFlushIndexPartition();
+  void FlushIndexPartition();
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
 
   struct Rep;
@@ -21,6 +21,7 @@
 #ifndef STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_H_
 #define STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_H_
 
+#include <stdint.h>
 #include <string>
 #include "leveldb/status.h"
 
@@ -36,9 +37,19 @@ class WriteBatch {
   // Store the mapping "key->value" in the database.
   void Put(const Slice& key, const Slice& value);
 
+  // Store the mapping "key->value" until the time "expiry", in
+  // microseconds as returned by NowMicros() of the database's Env.
+  // Once that time has passed, reads no longer find the mapping and
+  // compactions discard it.
+  void PutWithExpiry(const Slice& key, const Slice& value, uint64_t expiry);
+
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Erase every mapping with a key in the range [begin, end).  Costs
+  // about as much as a single Delete() however many keys it covers.
+  void DeleteRange(const Slice& begin, const Slice& end);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
@@ -48,6 +59,11 @@ class WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    // The default implementation ignores the expiry time and calls Put().
+    virtual void PutWithExpiry(const Slice& key, const Slice& value,
+                               uint64_t expiry);
+    // The default implementation ignores range deletions.
+    virtual void DeleteRange(const Slice& begin, const Slice& end);
   };
   Status Iterate(Handler* handler) const;
 
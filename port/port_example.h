@@ -70,6 +70,21 @@ typedef intptr_t OnceType;
 #define LEVELDB_ONCE_INIT 0
 extern void InitOnce(port::OnceType*, void (*initializer)());
 
+// Holds a separate pointer for each thread, initially NULL.  When a
+// thread that has stored a non-NULL pointer exits, the "cleanup"
+// function passed to the constructor is called with that pointer.
+class ThreadLocalPtr {
+ public:
+  explicit ThreadLocalPtr(void (*cleanup)(void*));
+  ~ThreadLocalPtr();
+
+  // Return the calling thread's pointer.
+  void* Get() const;
+
+  // Replace the calling thread's pointer with "value".
+  void Set(void* value);
+};
+
 // A type that holds a pointer that can be read or written atomically
 // (i.e., without word-tearing.)
 class AtomicPointer {
@@ -50,5 +50,17 @@ void InitOnce(OnceType* once, void (*initializer)()) {
   PthreadCall("once", pthread_once(once, initializer));
 }
 
+ThreadLocalPtr::ThreadLocalPtr(void (*cleanup)(void*)) {
+  PthreadCall("create key", pthread_key_create(&key_, cleanup));
+}
+
+ThreadLocalPtr::~ThreadLocalPtr() {
+  PthreadCall("delete key", pthread_key_delete(key_));
+}
+
+void ThreadLocalPtr::Set(void* value) {
+  PthreadCall("set specific", pthread_setspecific(key_, value));
+}
+
 }  // namespace port
 }  // namespace leveldb
@@ -113,6 +113,20 @@ typedef pthread_once_t OnceType;
 #define LEVELDB_ONCE_INIT PTHREAD_ONCE_INIT
 extern void InitOnce(OnceType* once, void (*initializer)());
 
+class ThreadLocalPtr {
+ public:
+  explicit ThreadLocalPtr(void (*cleanup)(void*));
+  ~ThreadLocalPtr();
+  void* Get() const { return pthread_getspecific(key_); }
+  void Set(void* value);
+ private:
+  pthread_key_t key_;
+
+  // No copying
+  ThreadLocalPtr(const ThreadLocalPtr&);
+  void operator=(const ThreadLocalPtr&);
+};
+
 inline bool Snappy_Compress(const char* input, size_t length,
                             ::std::string* output) {
 #ifdef SNAPPY
@@ -11,29 +11,44 @@
 #include "leveldb/comparator.h"
 #include "table/format.h"
 #include "util/coding.h"
+#include "util/hash.h"
 #include "util/logging.h"
 
 namespace leveldb {
 
-inline uint32_t Block::NumRestarts() const {
-  assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
-}
-
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
+      num_restarts_(0),
+      hash_buckets_(NULL),
+      num_buckets_(0),
       owned_(contents.heap_allocated) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
-  } else {
-    size_t max_restarts_allowed = (size_-sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
-      // The size is too small for NumRestarts()
+    return;
+  }
+  size_t limit = size_ - sizeof(uint32_t);
+  num_restarts_ = DecodeFixed32(data_ + limit);
+  if (num_restarts_ & kBlockHashIndexFlag) {
+    num_restarts_ &= ~kBlockHashIndexFlag;
+    if (limit < sizeof(uint32_t)) {
       size_ = 0;
-    } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      return;
     }
+    limit -= sizeof(uint32_t);
+    num_buckets_ = DecodeFixed32(data_ + limit);
+    if (num_buckets_ == 0 || num_buckets_ > limit) {
+      size_ = 0;
+      return;
+    }
+    limit -= num_buckets_;
+    hash_buckets_ = data_ + limit;
+  }
+  if (num_restarts_ > limit / sizeof(uint32_t)) {
+    // The size is too small for num_restarts_
+    size_ = 0;
+  } else {
+    restart_offset_ = limit - num_restarts_ * sizeof(uint32_t);
   }
 }
 
@@ -79,6 +94,8 @@ class Block::Iter : public Iterator {
   const char* const data_;      // underlying block contents
   uint32_t const restarts_;     // Offset of restart array (list of fixed32)
   uint32_t const num_restarts_; // Number of uint32_t entries in restart array
+  const char* const hash_buckets_;  // Hash index; NULL if not to be used
+  uint32_t const num_buckets_;
 
   // current_ is offset in data_ of current entry.  >= restarts_ if !Valid
   uint32_t current_;
@@ -115,11 +132,15 @@ class Block::Iter : public Iterator {
   Iter(const Comparator* comparator,
        const char* data,
        uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts,
+       const char* hash_buckets,
+       uint32_t num_buckets)
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
+        hash_buckets_(hash_buckets),
+        num_buckets_(num_buckets),
         current_(restarts_),
         restart_index_(num_restarts_) {
     assert(num_restarts_ > 0);
@@ -163,6 +184,24 @@ class Block::Iter : public Iterator {
   }
 
   virtual void Seek(const Slice& target) {
+    if (hash_buckets_ != NULL && target.size() >= kBlockHashKeySuffix) {
+      const uint32_t hash = Hash(target.data(),
+                                 target.size() - kBlockHashKeySuffix,
+                                 kBlockHashSeed);
+      const uint8_t bucket = hash_buckets_[hash % num_buckets_];
+      if (bucket == kBlockHashNoEntry) {
+        // The key is not in this block
+        current_ = restarts_;
+        restart_index_ = num_restarts_;
+        return;
+      } else if (bucket < num_restarts_) {
+        SeekToRestartPoint(bucket);
+        LinearSeek(target);
+        return;
+      }
+      // Collision or bad entry: search the restart array
+    }
+
     // Binary search in restart array to find the last restart point
     // with a key < target
     uint32_t left = 0;
@@ -190,16 +229,8 @@ class Block::Iter : public Iterator {
       }
     }
 
-    // Linear search (within restart block) for first key >= target
     SeekToRestartPoint(left);
-    while (true) {
-      if (!ParseNextKey()) {
-        return;
-      }
-      if (Compare(key_, target) >= 0) {
-        return;
-      }
-    }
+    LinearSeek(target);
   }
 
   virtual void SeekToFirst() {
@@ -215,6 +246,18 @@ class Block::Iter : public Iterator {
   }
 
  private:
+  // Linear search (within restart block) for first key >= target
+  void LinearSeek(const Slice& target) {
+    while (true) {
+      if (!ParseNextKey()) {
+        return;
+      }
+      if (Compare(key_, target) >= 0) {
+        return;
+      }
+    }
+  }
+
   void CorruptionError() {
     current_ = restarts_;
     restart_index_ = num_restarts_;
@@ -253,15 +296,15 @@ class Block::Iter : public Iterator {
   }
 };
 
-Iterator* Block::NewIterator(const Comparator* cmp) {
+Iterator* Block::NewIterator(const Comparator* cmp, bool point_lookup) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
-  const uint32_t num_restarts = NumRestarts();
-  if (num_restarts == 0) {
+  if (num_restarts_ == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(cmp, data_, restart_offset_, num_restarts);
+    return new Iter(cmp, data_, restart_offset_, num_restarts_,
+                    point_lookup ? hash_buckets_ : NULL, num_buckets_);
   }
 }
 
@@ -22,14 +22,20 @@ class Block {
   ~Block();
 
   size_t size() const { return size_; }
-  Iterator* NewIterator(const Comparator* comparator);
 
- private:
-  uint32_t NumRestarts() const;
+  // If "point_lookup" is true, the iterator is only used to Seek() to
+  // exact keys: Seek() then consults the block's hash index, if it has
+  // one, and leaves the iterator invalid if the key is not in the block.
+  Iterator* NewIterator(const Comparator* comparator,
+                        bool point_lookup = false);
 
+ private:
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;     // Offset in data_ of restart array
+  uint32_t num_restarts_;
+  const char* hash_buckets_;    // NULL if the block has no hash index
+  uint32_t num_buckets_;
   bool owned_;                  // Block owns data_[]
 
   // No copying allowed
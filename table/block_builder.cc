@@ -25,19 +25,38 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// A block with a hash index instead ends with:
+//     restarts: uint32[num_restarts]
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint32
+//     num_restarts | kBlockHashIndexFlag: uint32
+// buckets[hash % num_buckets] holds the restart interval of the first
+// entry of every key that hashes there (see table/format.h).
 
 #include "table/block_builder.h"
 
 #include <algorithm>
 #include <assert.h>
+#include <string.h>
 #include "leveldb/comparator.h"
 #include "leveldb/table_builder.h"
+#include "table/format.h"
 #include "util/coding.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
-BlockBuilder::BlockBuilder(const Options* options)
+// Buckets per hashed key
+static const double kBlockHashBucketsPerKey = 1 / 0.75;
+
+static uint32_t BlockKeyHash(const Slice& key) {
+  return Hash(key.data(), key.size() - kBlockHashKeySuffix, kBlockHashSeed);
+}
+
+BlockBuilder::BlockBuilder(const Options* options, bool hash_index)
     : options_(options),
+      hash_index_(hash_index),
       restarts_(),
       counter_(0),
       finished_(false) {
@@ -52,11 +71,18 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  hashes_.clear();
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
+  size_t hash_index_size = 0;
+  if (!hashes_.empty()) {
+    hash_index_size = static_cast<size_t>(
+        hashes_.size() * kBlockHashBucketsPerKey) + 1 + sizeof(uint32_t);
+  }
   return (buffer_.size() +                        // Raw data buffer
           restarts_.size() * sizeof(uint32_t) +   // Restart array
+          hash_index_size +                       // Hash index
           sizeof(uint32_t));                      // Restart array length
 }
 
@@ -65,7 +91,25 @@ Slice BlockBuilder::Finish() {
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  if (!hashes_.empty() && restarts_.size() <= kBlockHashMaxRestarts) {
+    const uint32_t num_buckets = static_cast<uint32_t>(
+        hashes_.size() * kBlockHashBucketsPerKey) + 1;
+    std::string buckets(num_buckets, static_cast<char>(kBlockHashNoEntry));
+    for (size_t i = 0; i < hashes_.size(); i++) {
+      const uint8_t restart = static_cast<uint8_t>(hashes_[i].second);
+      char* bucket = &buckets[hashes_[i].first % num_buckets];
+      if (static_cast<uint8_t>(*bucket) == kBlockHashNoEntry) {
+        *bucket = static_cast<char>(restart);
+      } else if (static_cast<uint8_t>(*bucket) != restart) {
+        *bucket = static_cast<char>(kBlockHashCollision);
+      }
+    }
+    buffer_.append(buckets);
+    PutFixed32(&buffer_, num_buckets);
+    PutFixed32(&buffer_, restarts_.size() | kBlockHashIndexFlag);
+  } else {
+    PutFixed32(&buffer_, restarts_.size());
+  }
   finished_ = true;
   return Slice(buffer_);
 }
@@ -90,6 +134,17 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   }
   const size_t non_shared = key.size() - shared;
 
+  if (hash_index_ && key.size() >= kBlockHashKeySuffix) {
+    // Only the first entry of each key is indexed: lookups scan forward
+    // from its restart interval to later versions.
+    const size_t n = key.size() - kBlockHashKeySuffix;
+    if (buffer_.empty() || last_key_piece.size() != key.size() ||
+        memcmp(last_key_piece.data(), key.data(), n) != 0) {
+      hashes_.push_back(std::make_pair(BlockKeyHash(key),
+                                       restarts_.size() - 1));
+    }
+  }
+
   // Add "<shared><non_shared><value_size>" to buffer_
   PutVarint32(&buffer_, shared);
   PutVarint32(&buffer_, non_shared);
@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_TABLE_BLOCK_BUILDER_H_
 #define STORAGE_LEVELDB_TABLE_BLOCK_BUILDER_H_
 
+#include <utility>
 #include <vector>
 
 #include <stdint.h>
@@ -16,7 +17,9 @@ struct Options;
 
 class BlockBuilder {
  public:
-  explicit BlockBuilder(const Options* options);
+  // If "hash_index" is true, the block also gets an index from key hash
+  // to restart interval for the use of point lookups.
+  explicit BlockBuilder(const Options* options, bool hash_index = false);
 
   // Reset the contents as if the BlockBuilder was just constructed.
   void Reset();
@@ -41,11 +44,14 @@ class BlockBuilder {
 
  private:
   const Options*        options_;
+  const bool            hash_index_;
   std::string           buffer_;      // Destination buffer
   std::vector<uint32_t> restarts_;    // Restart points
   int                   counter_;     // Number of entries emitted since restart
   bool                  finished_;    // Has Finish() been called?
   std::string           last_key_;
+  // Hash and restart interval of each key to index
+  std::vector<std::pair<uint32_t, uint32_t> > hashes_;
 
   // No copying allowed
   BlockBuilder(const BlockBuilder&);
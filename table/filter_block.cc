@@ -15,11 +15,16 @@ namespace leveldb {
 static const size_t kFilterBaseLg = 11;
 static const size_t kFilterBase = 1 << kFilterBaseLg;
 
-FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy)
-    : policy_(policy) {
+FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy,
+                                       bool whole_table)
+    : policy_(policy),
+      whole_table_(whole_table) {
 }
 
 void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
+  if (whole_table_) {
+    return;
+  }
   uint64_t filter_index = (block_offset / kFilterBase);
   assert(filter_index >= filter_offsets_.size());
   while (filter_index > filter_offsets_.size()) {
@@ -34,6 +39,11 @@ void FilterBlockBuilder::AddKey(const Slice& key) {
 }
 
 Slice FilterBlockBuilder::Finish() {
+  if (whole_table_) {
+    // The filter itself, without an offset array
+    GenerateFilter();
+    return Slice(result_);
+  }
   if (!start_.empty()) {
     GenerateFilter();
   }
@@ -76,12 +86,18 @@ void FilterBlockBuilder::GenerateFilter() {
 }
 
 FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
-                                     const Slice& contents)
+                                     const Slice& contents,
+                                     bool whole_table)
     : policy_(policy),
+      whole_table_(whole_table),
       data_(NULL),
       offset_(NULL),
       num_(0),
       base_lg_(0) {
+  if (whole_table_) {
+    whole_filter_ = contents;
+    return;
+  }
   size_t n = contents.size();
   if (n < 5) return;  // 1 byte for base_lg_ and 4 for start of offset array
   base_lg_ = contents[n-1];
@@ -93,13 +109,31 @@ FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
 }
 
 bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
+  return MayMatch(block_offset, key, false);
+}
+
+bool FilterBlockReader::PrefixMayMatch(uint64_t block_offset,
+                                       const Slice& key) {
+  return MayMatch(block_offset, key, true);
+}
+
+bool FilterBlockReader::MayMatch(uint64_t block_offset, const Slice& key,
+                                 bool prefix) {
+  if (whole_table_) {
+    if (whole_filter_.empty()) {
+      return false;  // The table has no keys
+    }
+    return prefix ? policy_->PrefixMayMatch(key, whole_filter_)
+                  : policy_->KeyMayMatch(key, whole_filter_);
+  }
   uint64_t index = block_offset >> base_lg_;
   if (index < num_) {
     uint32_t start = DecodeFixed32(offset_ + index*4);
     uint32_t limit = DecodeFixed32(offset_ + index*4 + 4);
     if (start <= limit && limit <= (offset_ - data_)) {
       Slice filter = Slice(data_ + start, limit - start);
-      return policy_->KeyMayMatch(key, filter);
+      return prefix ? policy_->PrefixMayMatch(key, filter)
+                    : policy_->KeyMayMatch(key, filter);
     } else if (start == limit) {
       // Empty filters do not match any keys
       return false;
@@ -26,9 +26,12 @@ class FilterPolicy;
 //
 // The sequence of calls to FilterBlockBuilder must match the regexp:
 //      (StartBlock AddKey*)* Finish
+//
+// If "whole_table" is true, a single filter is built over every key of
+// the table and StartBlock() has no effect.
 class FilterBlockBuilder {
  public:
-  explicit FilterBlockBuilder(const FilterPolicy*);
+  explicit FilterBlockBuilder(const FilterPolicy*, bool whole_table = false);
 
   void StartBlock(uint64_t block_offset);
   void AddKey(const Slice& key);
@@ -38,6 +41,7 @@ class FilterBlockBuilder {
   void GenerateFilter();
 
   const FilterPolicy* policy_;
+  const bool whole_table_;
   std::string keys_;              // Flattened key contents
   std::vector<size_t> start_;     // Starting index in keys_ of each key
   std::string result_;            // Filter data computed so far
@@ -52,11 +56,26 @@ class FilterBlockBuilder {
 class FilterBlockReader {
  public:
  // REQUIRES: "contents" and *policy must stay live while *this is live.
-  FilterBlockReader(const FilterPolicy* policy, const Slice& contents);
+  // "whole_table" must match the builder of "contents".
+  FilterBlockReader(const FilterPolicy* policy, const Slice& contents,
+                    bool whole_table = false);
+
+  // True if a single filter covers the whole table, in which case the
+  // block offsets passed below are ignored.
+  bool whole_table() const { return whole_table_; }
+
   bool KeyMayMatch(uint64_t block_offset, const Slice& key);
 
+  // Like KeyMayMatch(), but asks whether the block may hold a key with
+  // the prefix of "key" (see FilterPolicy::PrefixMayMatch()).
+  bool PrefixMayMatch(uint64_t block_offset, const Slice& key);
+
  private:
+  bool MayMatch(uint64_t block_offset, const Slice& key, bool prefix);
+
   const FilterPolicy* policy_;
+  const bool whole_table_;
+  Slice whole_filter_;  // The filter when whole_table_
   const char* data_;    // Pointer to filter data (at block-start)
   const char* offset_;  // Pointer to beginning of offset array (at block-end)
   size_t num_;          // Number of entries in offset array
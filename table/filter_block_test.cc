@@ -121,6 +121,35 @@ TEST(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(! reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST(FilterBlockTest, WholeTable) {
+  FilterBlockBuilder builder(&policy_, true);
+  builder.StartBlock(0);
+  builder.AddKey("foo");
+  builder.StartBlock(3100);
+  builder.AddKey("box");
+  builder.StartBlock(9000);
+  builder.AddKey("hello");
+  Slice block = builder.Finish();
+
+  // One hash per key and no offset array
+  ASSERT_EQ(12, block.size());
+  FilterBlockReader reader(&policy_, block, true);
+  ASSERT_TRUE(reader.whole_table());
+  ASSERT_TRUE(reader.KeyMayMatch(0, "foo"));
+  ASSERT_TRUE(reader.KeyMayMatch(0, "hello"));
+  ASSERT_TRUE(reader.KeyMayMatch(9000, "box"));
+  ASSERT_TRUE(! reader.KeyMayMatch(0, "bar"));
+  ASSERT_TRUE(! reader.KeyMayMatch(3100, "missing"));
+}
+
+TEST(FilterBlockTest, EmptyWholeTable) {
+  FilterBlockBuilder builder(&policy_, true);
+  Slice block = builder.Finish();
+  ASSERT_EQ(0, block.size());
+  FilterBlockReader reader(&policy_, block, true);
+  ASSERT_TRUE(! reader.KeyMayMatch(0, "foo"));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -36,8 +36,10 @@ void Footer::EncodeTo(std::string* dst) const {
   metaindex_handle_.EncodeTo(dst);
   index_handle_.EncodeTo(dst);
   dst->resize(2 * BlockHandle::kMaxEncodedLength);  // Padding
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu));
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32));
+  const uint64_t magic = partitioned_index_ ? kPartitionedTableMagicNumber
+                                            : kTableMagicNumber;
+  PutFixed32(dst, static_cast<uint32_t>(magic & 0xffffffffu));
+  PutFixed32(dst, static_cast<uint32_t>(magic >> 32));
   assert(dst->size() == original_size + kEncodedLength);
 }
 
@@ -47,7 +49,11 @@ Status Footer::DecodeFrom(Slice* input) {
   const uint32_t magic_hi = DecodeFixed32(magic_ptr + 4);
   const uint64_t magic = ((static_cast<uint64_t>(magic_hi) << 32) |
                           (static_cast<uint64_t>(magic_lo)));
-  if (magic != kTableMagicNumber) {
+  if (magic == kPartitionedTableMagicNumber) {
+    partitioned_index_ = true;
+  } else if (magic == kTableMagicNumber) {
+    partitioned_index_ = false;
+  } else {
     return Status::Corruption("not an sstable (bad magic number)");
   }
 
@@ -142,4 +148,68 @@ Status ReadBlock(RandomAccessFile* file,
   return Status::OK();
 }
 
+Status ReadRawBlock(RandomAccessFile* file,
+                    const BlockHandle& handle,
+                    std::string* stored) {
+  const size_t n = static_cast<size_t>(handle.size());
+  stored->resize(n + kBlockTrailerSize);
+  Slice contents;
+  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents,
+                        &(*stored)[0]);
+  if (!s.ok()) {
+    return s;
+  }
+  if (contents.size() != n + kBlockTrailerSize) {
+    return Status::Corruption("truncated block read");
+  }
+  if (contents.data() != stored->data()) {
+    stored->assign(contents.data(), contents.size());
+  }
+
+  const char* data = stored->data();
+  const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
+  const uint32_t actual = crc32c::Value(data, n + 1);
+  if (actual != crc) {
+    return Status::Corruption("block checksum mismatch");
+  }
+  return Status::OK();
+}
+
+Status DecodeRawBlock(const Slice& stored, BlockContents* result) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+  if (stored.size() < kBlockTrailerSize) {
+    return Status::Corruption("truncated block read");
+  }
+
+  const char* data = stored.data();
+  const size_t n = stored.size() - kBlockTrailerSize;
+  char* buf;
+  size_t length;
+  switch (data[n]) {
+    case kNoCompression:
+      buf = new char[n];
+      memcpy(buf, data, n);
+      length = n;
+      break;
+    case kSnappyCompression:
+      if (!port::Snappy_GetUncompressedLength(data, n, &length)) {
+        return Status::Corruption("corrupted compressed block contents");
+      }
+      buf = new char[length];
+      if (!port::Snappy_Uncompress(data, n, buf)) {
+        delete[] buf;
+        return Status::Corruption("corrupted compressed block contents");
+      }
+      break;
+    default:
+      return Status::Corruption("bad block type");
+  }
+  result->data = Slice(buf, length);
+  result->heap_allocated = true;
+  result->cachable = true;
+  return Status::OK();
+}
+
 }  // namespace leveldb
@@ -46,7 +46,7 @@ class BlockHandle {
 // end of every table file.
 class Footer {
  public:
-  Footer() { }
+  Footer() : partitioned_index_(false) { }
 
   // The block handle for the metaindex block of the table
   const BlockHandle& metaindex_handle() const { return metaindex_handle_; }
@@ -60,6 +60,12 @@ class Footer {
     index_handle_ = h;
   }
 
+  // True if the index block is the top level of a partitioned index
+  // (see Options::index_partition_size).  Recorded in the magic number
+  // so that versions which do not know the layout refuse the table.
+  bool partitioned_index() const { return partitioned_index_; }
+  void set_partitioned_index(bool v) { partitioned_index_ = v; }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(Slice* input);
 
@@ -73,6 +79,7 @@ class Footer {
  private:
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
+  bool partitioned_index_;
 };
 
 // kTableMagicNumber was picked by running
@@ -80,9 +87,33 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// kPartitionedTableMagicNumber was picked the same way from
+//    echo -n http://code.google.com/p/leveldb/partitioned | sha1sum
+static const uint64_t kPartitionedTableMagicNumber = 0xef8b5644ba1d6a1bull;
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// Metaindex key of the block holding a table's range deletions
+static const char kRangeDelBlockName[] = "leveldb.range_del";
+
+// Prefix of the metaindex key, followed by the filter policy name,
+// that marks a table whose filter is split along its index partitions
+static const char kPartitionedFilterPrefix[] = "partitionedfilter.";
+
+// Data blocks built with Options::data_block_hash_index set this bit in
+// their restart count and carry a hash index: one byte per bucket
+// holding the restart interval of the keys that hash to it, or one of
+// the two markers below.  Keys are hashed without their last 8 bytes,
+// which hold the sequence number and type of database entries, so all
+// versions of a key share a bucket.
+static const uint32_t kBlockHashIndexFlag = 1u << 31;
+static const uint8_t kBlockHashNoEntry = 254;
+static const uint8_t kBlockHashCollision = 255;
+static const uint32_t kBlockHashMaxRestarts = 253;
+static const size_t kBlockHashKeySuffix = 8;
+static const uint32_t kBlockHashSeed = 0x8a9b2c43;
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
@@ -96,6 +127,18 @@ extern Status ReadBlock(RandomAccessFile* file,
                         const BlockHandle& handle,
                         BlockContents* result);
 
+// Read the block identified by "handle" from "file" as it is stored,
+// followed by its trailer, into *stored.  The checksum is always
+// verified.  On failure return non-OK.
+extern Status ReadRawBlock(RandomAccessFile* file,
+                           const BlockHandle& handle,
+                           std::string* stored);
+
+// Fill *result with the contents of a block read by ReadRawBlock().
+// The contents are always copied to the heap.  On failure return
+// non-OK.
+extern Status DecodeRawBlock(const Slice& stored, BlockContents* result);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
@@ -4,6 +4,7 @@
 
 #include "table/merger.h"
 
+#include <vector>
 #include "leveldb/comparator.h"
 #include "leveldb/iterator.h"
 #include "table/iterator_wrapper.h"
@@ -22,6 +23,7 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n; i++) {
       children_[i].Set(children[i]);
     }
+    heap_.reserve(n);
   }
 
   virtual ~MergingIterator() {
@@ -36,24 +38,24 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToFirst();
     }
-    FindSmallest();
     direction_ = kForward;
+    RebuildHeap();
   }
 
   virtual void SeekToLast() {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToLast();
     }
-    FindLargest();
     direction_ = kReverse;
+    RebuildHeap();
   }
 
   virtual void Seek(const Slice& target) {
     for (int i = 0; i < n_; i++) {
       children_[i].Seek(target);
     }
-    FindSmallest();
     direction_ = kForward;
+    RebuildHeap();
   }
 
   virtual void Next() {
@@ -76,10 +78,12 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kForward;
+      current_->Next();
+      RebuildHeap();
+    } else {
+      current_->Next();
+      FixTop();
     }
-
-    current_->Next();
-    FindSmallest();
   }
 
   virtual void Prev() {
@@ -105,10 +109,12 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kReverse;
+      current_->Prev();
+      RebuildHeap();
+    } else {
+      current_->Prev();
+      FixTop();
     }
-
-    current_->Prev();
-    FindLargest();
   }
 
   virtual Slice key() const {
@@ -133,54 +139,78 @@ class MergingIterator : public Iterator {
   }
 
  private:
-  void FindSmallest();
-  void FindLargest();
-
-  // We might want to use a heap in case there are lots of children.
-  // For now we use a simple array since we expect a very small number
-  // of children in leveldb.
-  const Comparator* comparator_;
-  IteratorWrapper* children_;
-  int n_;
-  IteratorWrapper* current_;
-
   // Which direction is the iterator moving?
   enum Direction {
     kForward,
     kReverse
   };
-  Direction direction_;
-};
 
-void MergingIterator::FindSmallest() {
-  IteratorWrapper* smallest = NULL;
-  for (int i = 0; i < n_; i++) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (smallest == NULL) {
-        smallest = child;
-      } else if (comparator_->Compare(child->key(), smallest->key()) < 0) {
-        smallest = child;
+  // Return true if child "a" should be returned before child "b".  The
+  // smallest key comes first in the forward direction and the largest
+  // in reverse; equal keys are returned in order of the children.
+  bool Before(const IteratorWrapper* a, const IteratorWrapper* b) const {
+    const int r = comparator_->Compare(a->key(), b->key());
+    if (direction_ == kForward) {
+      return r < 0 || (r == 0 && a < b);
+    } else {
+      return r > 0 || (r == 0 && a > b);
+    }
+  }
+
+  // Restore the heap order below heap_[i].
+  void SiftDown(size_t i) {
+    const size_t n = heap_.size();
+    IteratorWrapper* child = heap_[i];
+    while (true) {
+      size_t first = 2 * i + 1;
+      if (first >= n) break;
+      if (first + 1 < n && Before(heap_[first + 1], heap_[first])) {
+        first++;
       }
+      if (!Before(heap_[first], child)) break;
+      heap_[i] = heap_[first];
+      i = first;
     }
+    heap_[i] = child;
   }
-  current_ = smallest;
-}
 
-void MergingIterator::FindLargest() {
-  IteratorWrapper* largest = NULL;
-  for (int i = n_-1; i >= 0; i--) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (largest == NULL) {
-        largest = child;
-      } else if (comparator_->Compare(child->key(), largest->key()) > 0) {
-        largest = child;
+  // Build the heap from the valid children for direction_.
+  void RebuildHeap() {
+    heap_.clear();
+    for (int i = 0; i < n_; i++) {
+      if (children_[i].Valid()) {
+        heap_.push_back(&children_[i]);
       }
     }
+    for (size_t i = heap_.size() / 2; i > 0; i--) {
+      SiftDown(i - 1);
+    }
+    current_ = heap_.empty() ? NULL : heap_[0];
   }
-  current_ = largest;
-}
+
+  // Restore the heap after its top child, current_, has moved.
+  void FixTop() {
+    if (!heap_[0]->Valid()) {
+      heap_[0] = heap_.back();
+      heap_.pop_back();
+    }
+    if (!heap_.empty()) {
+      SiftDown(0);
+    }
+    current_ = heap_.empty() ? NULL : heap_[0];
+  }
+
+  const Comparator* comparator_;
+  IteratorWrapper* children_;
+  int n_;
+  IteratorWrapper* current_;
+
+  // The valid children, ordered by Before() into a binary heap whose
+  // top is current_.
+  std::vector<IteratorWrapper*> heap_;
+
+  Direction direction_;
+};
 }  // namespace
 
 Iterator* NewMergingIterator(const Comparator* cmp, Iterator** list, int n) {
@@ -9,6 +9,7 @@
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/pinnable_slice.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -17,28 +18,117 @@
 
 namespace leveldb {
 
+// A filter block, as kept in the block cache
+struct CachedFilter {
+  FilterBlockReader reader;
+  const char* heap_data;  // NULL unless the reader's data must be freed
+
+  CachedFilter(const FilterPolicy* policy, const BlockContents& contents,
+               bool whole_table)
+      : reader(policy, contents.data, whole_table),
+        heap_data(contents.heap_allocated ? contents.data.data() : NULL) {
+  }
+  ~CachedFilter() {
+    delete[] heap_data;
+  }
+};
+
+// The filter used by one lookup, which stays alive as long as this does
+struct FilterRef {
+  FilterBlockReader* reader;    // NULL if there is no usable filter
+  Cache* cache;
+  Cache::Handle* cache_handle;  // Released when done, if non-NULL
+  CachedFilter* owned;          // Deleted when done
+
+  FilterRef() : reader(NULL), cache(NULL), cache_handle(NULL), owned(NULL) { }
+  ~FilterRef() {
+    if (cache_handle != NULL) {
+      cache->Release(cache_handle);
+    }
+    delete owned;
+  }
+};
+
 struct Table::Rep {
   ~Rep() {
-    delete filter;
+    if (filter_cache_handle != NULL) {
+      options.block_cache->Release(filter_cache_handle);
+    } else {
+      delete filter;
+    }
     delete [] filter_data;
-    delete index_block;
+    if (index_cache_handle != NULL) {
+      options.block_cache->Release(index_cache_handle);
+    } else {
+      delete index_block;
+    }
+    delete range_del_block;
   }
 
+  // Set *block to the block at "handle", looked up in the block cache
+  // and inserted there with "priority" if missing.  If *cache_handle
+  // is set, the caller must release it, and otherwise owns *block.
+  Status ReadCachedBlock(const ReadOptions& read_options,
+                         const BlockHandle& handle, Cache::Priority priority,
+                         Block** block, Cache::Handle** cache_handle);
+
+  // Returns an iterator over the block at "handle", read as above.
+  Iterator* NewBlockIterator(const ReadOptions& read_options,
+                             const BlockHandle& handle,
+                             Cache::Priority priority, bool point_lookup);
+
+  // Point *ref at the filter at "handle", read like an index block.
+  // Leaves ref->reader NULL if the filter cannot be read.
+  void ReadCachedFilter(const ReadOptions& read_options,
+                        const BlockHandle& handle, bool whole_table,
+                        FilterRef* ref);
+
+  // Point *ref at the filter read by ReadFilter(), if any.
+  void GetFilter(const ReadOptions& read_options, FilterRef* ref);
+
+  // Returns an iterator over the index block.
+  Iterator* NewIndexBlockIterator(const ReadOptions& read_options);
+
   Options options;
   Status status;
   RandomAccessFile* file;
   uint64_t cache_id;
-  FilterBlockReader* filter;
+  FilterBlockReader* filter;  // NULL if cached_filter, unless pinned
   const char* filter_data;
 
+  // With Options::cache_index_and_filter_blocks, the index block and
+  // the filter are read through the block cache from these handles
+  // whenever they are needed, unless pinned there for the life of the
+  // table.
+  bool cache_index_and_filter;
+  bool pin_index_and_filter;
+  BlockHandle index_handle;
+  BlockHandle filter_handle;
+  bool cached_filter;  // filter_handle locates the filter
+  bool cached_filter_whole_table;
+  Cache::Handle* index_cache_handle;   // Non-NULL while pinned
+  Cache::Handle* filter_cache_handle;  // Non-NULL while pinned
+
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
-  Block* index_block;
+  Block* index_block;      // The top-level index if partitioned_index;
+                           // NULL if cache_index_and_filter, unless pinned
+  bool partitioned_index;
+  bool partitioned_filter;  // Top-level index entries locate filters
+  Block* range_del_block;  // NULL if the table has no range deletions
 };
 
 Status Table::Open(const Options& options,
                    RandomAccessFile* file,
                    uint64_t size,
                    Table** table) {
+  return Open(options, file, size, false, table);
+}
+
+Status Table::Open(const Options& options,
+                   RandomAccessFile* file,
+                   uint64_t size,
+                   bool pin_index_and_filter,
+                   Table** table) {
   *table = NULL;
   if (size < Footer::kEncodedLength) {
     return Status::Corruption("file is too short to be an sstable");
@@ -58,10 +148,13 @@ Status Table::Open(const Options& options,
   s = footer.DecodeFrom(&footer_input);
   if (!s.ok()) return s;
 
-  // Read the index block
+  const bool cache_index_and_filter =
+      options.cache_index_and_filter_blocks && options.block_cache != NULL;
+
+  // Read the index block, unless it belongs in the block cache
   BlockContents contents;
   Block* index_block = NULL;
-  if (s.ok()) {
+  if (s.ok() && !cache_index_and_filter) {
     ReadOptions opt;
     if (options.paranoid_checks) {
       opt.verify_checksums = true;
@@ -82,11 +175,33 @@ Status Table::Open(const Options& options,
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
+    rep->partitioned_index = footer.partitioned_index();
+    rep->partitioned_filter = false;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = NULL;
     rep->filter = NULL;
-    *table = new Table(rep);
-    (*table)->ReadMeta(footer);
+    rep->range_del_block = NULL;
+    rep->cache_index_and_filter = cache_index_and_filter;
+    rep->pin_index_and_filter = cache_index_and_filter && pin_index_and_filter;
+    rep->index_handle = footer.index_handle();
+    rep->cached_filter = false;
+    rep->cached_filter_whole_table = false;
+    rep->index_cache_handle = NULL;
+    rep->filter_cache_handle = NULL;
+    if (rep->pin_index_and_filter) {
+      ReadOptions opt;
+      if (options.paranoid_checks) {
+        opt.verify_checksums = true;
+      }
+      s = rep->ReadCachedBlock(opt, rep->index_handle, Cache::kHighPriority,
+                               &rep->index_block, &rep->index_cache_handle);
+    }
+    if (s.ok()) {
+      *table = new Table(rep);
+      (*table)->ReadMeta(footer);
+    } else {
+      delete rep;
+    }
   } else {
     if (index_block) delete index_block;
   }
@@ -95,12 +210,11 @@ Status Table::Open(const Options& options,
 }
 
 void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == NULL) {
-    return;  // Do not need any metadata
+  // An empty block consists of a single restart point and the restart count
+  if (footer.metaindex_handle().size() <= 2 * sizeof(uint32_t)) {
+    return;  // No metadata
   }
 
-  // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
-  // it is an empty block.
   ReadOptions opt;
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
@@ -113,17 +227,65 @@ void Table::ReadMeta(const Footer& footer) {
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  if (rep_->options.filter_policy != NULL && rep_->partitioned_index) {
+    std::string key = kPartitionedFilterPrefix;
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    rep_->partitioned_filter = iter->Valid() && iter->key() == Slice(key);
+  } else if (rep_->options.filter_policy != NULL) {
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value(), false);
+    } else {
+      key = "fullfilter.";
+      key.append(rep_->options.filter_policy->Name());
+      iter->Seek(key);
+      if (iter->Valid() && iter->key() == Slice(key)) {
+        ReadFilter(iter->value(), true);
+      }
+    }
+  }
+  iter->Seek(kRangeDelBlockName);
+  if (iter->Valid() && iter->key() == Slice(kRangeDelBlockName)) {
+    ReadRangeDeletions(iter->value());
   }
   delete iter;
   delete meta;
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
+void Table::ReadRangeDeletions(const Slice& handle_value) {
+  Slice v = handle_value;
+  BlockHandle handle;
+  if (!handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  // Unlike the filter, range deletions are needed for correct reads,
+  // so always verify them.
+  ReadOptions opt;
+  opt.verify_checksums = true;
+  BlockContents contents;
+  Status s = ReadBlock(rep_->file, opt, handle, &contents);
+  if (s.ok()) {
+    rep_->range_del_block = new Block(contents);
+  } else if (rep_->status.ok()) {
+    rep_->status = s;
+  }
+}
+
+Iterator* Table::NewRangeDeletionIterator() const {
+  if (!rep_->status.ok()) {
+    return NewErrorIterator(rep_->status);
+  }
+  if (rep_->range_del_block == NULL) {
+    return NewEmptyIterator();
+  }
+  return rep_->range_del_block->NewIterator(rep_->options.comparator);
+}
+
+void Table::ReadFilter(const Slice& filter_handle_value, bool whole_table) {
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
   if (!filter_handle.DecodeFrom(&v).ok()) {
@@ -136,6 +298,22 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
   }
+  if (rep_->cache_index_and_filter) {
+    rep_->cached_filter = true;
+    rep_->filter_handle = filter_handle;
+    rep_->cached_filter_whole_table = whole_table;
+    if (rep_->pin_index_and_filter) {
+      FilterRef ref;
+      rep_->ReadCachedFilter(opt, filter_handle, whole_table, &ref);
+      if (ref.cache_handle != NULL) {
+        // Keep the reference until the table is deleted
+        rep_->filter = ref.reader;
+        rep_->filter_cache_handle = ref.cache_handle;
+        ref.cache_handle = NULL;
+      }
+    }
+    return;
+  }
   BlockContents block;
   if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
     return;
@@ -143,7 +321,8 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (block.heap_allocated) {
     rep_->filter_data = block.data.data();     // Will need to delete later
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
+  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data,
+                                       whole_table);
 }
 
 Table::~Table() {
@@ -159,95 +338,324 @@ static void DeleteCachedBlock(const Slice& key, void* value) {
   delete block;
 }
 
+static void DeleteCachedFilter(const Slice& key, void* value) {
+  delete reinterpret_cast<CachedFilter*>(value);
+}
+
 static void ReleaseBlock(void* arg, void* h) {
   Cache* cache = reinterpret_cast<Cache*>(arg);
   Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
   cache->Release(handle);
 }
 
+Status Table::Rep::ReadCachedBlock(const ReadOptions& read_options,
+                                   const BlockHandle& handle,
+                                   Cache::Priority priority,
+                                   Block** block,
+                                   Cache::Handle** cache_handle) {
+  Cache* block_cache = options.block_cache;
+  *block = NULL;
+  *cache_handle = NULL;
+
+  Status s;
+  BlockContents contents;
+  if (block_cache != NULL) {
+    char cache_key_buffer[16];
+    EncodeFixed64(cache_key_buffer, cache_id);
+    EncodeFixed64(cache_key_buffer+8, handle.offset());
+    Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+    *cache_handle = block_cache->Lookup(key);
+    if (*cache_handle != NULL) {
+      *block = reinterpret_cast<Block*>(block_cache->Value(*cache_handle));
+    } else {
+      s = ReadBlock(file, read_options, handle, &contents);
+      if (s.ok()) {
+        *block = new Block(contents);
+        // Blocks of high priority hold the index, which every read of
+        // the table needs, so they are cached regardless of fill_cache
+        if (contents.cachable &&
+            (read_options.fill_cache || priority == Cache::kHighPriority)) {
+          *cache_handle = block_cache->Insert(
+              key, *block, (*block)->size(), &DeleteCachedBlock, priority);
+        }
+      }
+    }
+  } else {
+    s = ReadBlock(file, read_options, handle, &contents);
+    if (s.ok()) {
+      *block = new Block(contents);
+    }
+  }
+  return s;
+}
+
+Iterator* Table::Rep::NewBlockIterator(const ReadOptions& read_options,
+                                       const BlockHandle& handle,
+                                       Cache::Priority priority,
+                                       bool point_lookup) {
+  Block* block = NULL;
+  Cache::Handle* cache_handle = NULL;
+  Status s = ReadCachedBlock(read_options, handle, priority,
+                             &block, &cache_handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  Iterator* iter = block->NewIterator(options.comparator, point_lookup);
+  if (cache_handle == NULL) {
+    iter->RegisterCleanup(&DeleteBlock, block, NULL);
+  } else {
+    iter->RegisterCleanup(&ReleaseBlock, options.block_cache, cache_handle);
+  }
+  return iter;
+}
+
+void Table::Rep::ReadCachedFilter(const ReadOptions& read_options,
+                                  const BlockHandle& handle, bool whole_table,
+                                  FilterRef* ref) {
+  Cache* block_cache = options.block_cache;
+  CachedFilter* cached = NULL;
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, cache_id);
+  EncodeFixed64(cache_key_buffer+8, handle.offset());
+  Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+  if (block_cache != NULL) {
+    ref->cache = block_cache;
+    ref->cache_handle = block_cache->Lookup(key);
+    if (ref->cache_handle != NULL) {
+      cached = reinterpret_cast<CachedFilter*>(
+          block_cache->Value(ref->cache_handle));
+    }
+  }
+  if (cached == NULL) {
+    BlockContents contents;
+    if (!ReadBlock(file, read_options, handle, &contents).ok()) {
+      return;  // Filters are an optimization; the data blocks decide
+    }
+    cached = new CachedFilter(options.filter_policy, contents, whole_table);
+    if (block_cache != NULL && contents.cachable) {
+      ref->cache_handle = block_cache->Insert(key, cached,
+                                              contents.data.size(),
+                                              &DeleteCachedFilter,
+                                              Cache::kHighPriority);
+    } else {
+      ref->owned = cached;
+    }
+  }
+  ref->reader = &cached->reader;
+}
+
+void Table::Rep::GetFilter(const ReadOptions& read_options, FilterRef* ref) {
+  if (filter != NULL) {
+    ref->reader = filter;
+  } else if (cached_filter) {
+    ReadCachedFilter(read_options, filter_handle, cached_filter_whole_table,
+                     ref);
+  }
+}
+
+Iterator* Table::Rep::NewIndexBlockIterator(const ReadOptions& read_options) {
+  if (index_block != NULL) {
+    return index_block->NewIterator(options.comparator);
+  }
+  return NewBlockIterator(read_options, index_handle, Cache::kHighPriority,
+                          false);
+}
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg,
                              const ReadOptions& options,
                              const Slice& index_value) {
-  Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
-  Block* block = NULL;
-  Cache::Handle* cache_handle = NULL;
+  return BlockReader(arg, options, index_value, false);
+}
 
+Iterator* Table::BlockReader(void* arg,
+                             const ReadOptions& options,
+                             const Slice& index_value,
+                             bool point_lookup) {
+  Table* table = reinterpret_cast<Table*>(arg);
   BlockHandle handle;
   Slice input = index_value;
   Status s = handle.DecodeFrom(&input);
   // We intentionally allow extra stuff in index_value so that we
   // can add more features in the future.
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  return table->rep_->NewBlockIterator(options, handle, Cache::kLowPriority,
+                                       point_lookup);
+}
 
-  if (s.ok()) {
-    BlockContents contents;
-    if (block_cache != NULL) {
-      char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-      EncodeFixed64(cache_key_buffer+8, handle.offset());
-      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
-      cache_handle = block_cache->Lookup(key);
-      if (cache_handle != NULL) {
-        block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
-      } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
-        if (s.ok()) {
-          block = new Block(contents);
-          if (contents.cachable && options.fill_cache) {
-            cache_handle = block_cache->Insert(
-                key, block, block->size(), &DeleteCachedBlock);
-          }
-        }
-      }
-    } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
-      if (s.ok()) {
-        block = new Block(contents);
-      }
+Iterator* Table::IndexPartitionReader(void* arg,
+                                      const ReadOptions& options,
+                                      const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  BlockHandle handle;
+  Slice input = index_value;
+  Status s = handle.DecodeFrom(&input);  // The filter handle follows
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+  return table->rep_->NewBlockIterator(options, handle, Cache::kHighPriority,
+                                       false);
+}
+
+bool Table::PartitionMayMatch(const ReadOptions& options, const Slice& key,
+                              bool prefix) const {
+  Iterator* top_iter = rep_->NewIndexBlockIterator(options);
+  top_iter->Seek(key);
+  BlockHandle index_handle, filter_handle;
+  bool found = false;
+  if (top_iter->Valid()) {
+    Slice input = top_iter->value();
+    found = index_handle.DecodeFrom(&input).ok() &&
+            filter_handle.DecodeFrom(&input).ok();
+  }
+  delete top_iter;
+  if (!found) {
+    return true;  // Leave it to the index
+  }
+
+  FilterRef filter;
+  rep_->ReadCachedFilter(options, filter_handle, true, &filter);
+  if (filter.reader == NULL) {
+    return true;
+  }
+  return prefix ? filter.reader->PrefixMayMatch(0, key)
+                : filter.reader->KeyMayMatch(0, key);
+}
+
+bool Table::PrefixMayMatch(void* arg, const Slice& key) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  if (table->rep_->partitioned_filter) {
+    // Keys with the prefix of "key" that are >= "key" start in the
+    // partition that "key" maps to, as they do for blocks below.
+    return table->PartitionMayMatch(ReadOptions(), key, true);
+  }
+  FilterRef filter;
+  table->rep_->GetFilter(ReadOptions(), &filter);
+  if (filter.reader == NULL) {
+    return true;
+  }
+  if (filter.reader->whole_table()) {
+    return filter.reader->PrefixMayMatch(0, key);
+  }
+  bool may_match = true;
+  Iterator* iiter = table->rep_->NewIndexBlockIterator(ReadOptions());
+  iiter->Seek(key);
+  if (iiter->Valid()) {
+    // Keys with the prefix of "key" that are >= "key" start in the block
+    // that "key" maps to, so its filter alone settles the question.
+    Slice handle_value = iiter->value();
+    BlockHandle handle;
+    if (handle.DecodeFrom(&handle_value).ok()) {
+      may_match = filter.reader->PrefixMayMatch(handle.offset(), key);
     }
   }
+  delete iiter;
+  return may_match;
+}
 
-  Iterator* iter;
-  if (block != NULL) {
-    iter = block->NewIterator(table->rep_->options.comparator);
-    if (cache_handle == NULL) {
-      iter->RegisterCleanup(&DeleteBlock, block, NULL);
-    } else {
-      iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+namespace {
+
+// Wraps a table iterator so that Seek() consults the filter first and
+// leaves the iterator invalid, without reading a data block, when the
+// table holds no key with the prefix of the target.
+class PrefixSeekIterator : public Iterator {
+ public:
+  PrefixSeekIterator(Iterator* iter, bool (*may_match)(void*, const Slice&),
+                     void* arg)
+      : iter_(iter),
+        may_match_(may_match),
+        arg_(arg),
+        filtered_(false) {
+  }
+  virtual ~PrefixSeekIterator() {
+    delete iter_;
+  }
+  virtual bool Valid() const { return !filtered_ && iter_->Valid(); }
+  virtual void Seek(const Slice& target) {
+    filtered_ = !(*may_match_)(arg_, target);
+    if (!filtered_) {
+      iter_->Seek(target);
     }
-  } else {
-    iter = NewErrorIterator(s);
+  }
+  virtual void SeekToFirst() {
+    filtered_ = false;
+    iter_->SeekToFirst();
+  }
+  virtual void SeekToLast() {
+    filtered_ = false;
+    iter_->SeekToLast();
+  }
+  virtual void Next() { iter_->Next(); }
+  virtual void Prev() { iter_->Prev(); }
+  virtual Slice key() const { return iter_->key(); }
+  virtual Slice value() const { return iter_->value(); }
+  virtual Status status() const { return iter_->status(); }
+
+ private:
+  Iterator* const iter_;
+  bool (*const may_match_)(void*, const Slice&);
+  void* const arg_;
+  bool filtered_;
+};
+
+}  // namespace
+
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  Iterator* iter = rep_->NewIndexBlockIterator(options);
+  if (rep_->partitioned_index) {
+    iter = NewTwoLevelIterator(iter, &Table::IndexPartitionReader,
+                               const_cast<Table*>(this), options);
   }
   return iter;
 }
 
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
+  Iterator* iter = NewTwoLevelIterator(
+      NewIndexIterator(options),
       &Table::BlockReader, const_cast<Table*>(this), options);
+  if (options.prefix_same_as_start &&
+      (rep_->filter != NULL || rep_->cached_filter ||
+       rep_->partitioned_filter)) {
+    iter = new PrefixSeekIterator(iter, &Table::PrefixMayMatch,
+                                  const_cast<Table*>(this));
+  }
+  return iter;
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k,
                           void* arg,
-                          void (*saver)(void*, const Slice&, const Slice&)) {
+                          void (*saver)(void*, const Slice&, const Slice&),
+                          PinnableSlice* pinned) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  FilterRef filter_ref;
+  rep_->GetFilter(options, &filter_ref);
+  FilterBlockReader* filter = filter_ref.reader;
+  if (filter != NULL && filter->whole_table() && !filter->KeyMayMatch(0, k)) {
+    return s;  // Not found, without touching the index
+  }
+  if (rep_->partitioned_filter && !PartitionMayMatch(options, k, false)) {
+    return s;  // Not found, without reading an index partition
+  }
+  Iterator* iiter = NewIndexIterator(options);
   iiter->Seek(k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
-    if (filter != NULL &&
+    if (filter != NULL && !filter->whole_table() &&
         handle.DecodeFrom(&handle_value).ok() &&
         !filter->KeyMayMatch(handle.offset(), k)) {
       // Not found
     } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
+      Iterator* block_iter = BlockReader(this, options, iiter->value(), true);
       block_iter->Seek(k);
       if (block_iter->Valid()) {
         (*saver)(arg, block_iter->key(), block_iter->value());
+        if (pinned != NULL) {
+          block_iter->DelegateCleanupsTo(pinned);
+        }
       }
       s = block_iter->status();
       delete block_iter;
@@ -260,10 +668,62 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
   return s;
 }
 
+Status Table::InternalMultiGet(
+    const ReadOptions& options, const std::vector<Slice>& keys,
+    const std::vector<void*>& args,
+    void (*saver)(void*, const Slice&, const Slice&)) {
+  Status s;
+  const Comparator* cmp = rep_->options.comparator;
+  Iterator* iiter = NewIndexIterator(options);
+  Iterator* block_iter = NULL;
+  FilterRef filter_ref;
+  rep_->GetFilter(options, &filter_ref);
+  FilterBlockReader* filter = filter_ref.reader;
+  for (size_t i = 0; i < keys.size() && s.ok(); i++) {
+    const Slice& k = keys[i];
+    if (filter != NULL && filter->whole_table() &&
+        !filter->KeyMayMatch(0, k)) {
+      continue;  // Not found
+    }
+    if (rep_->partitioned_filter && !PartitionMayMatch(options, k, false)) {
+      continue;  // Not found
+    }
+    // Keys are sorted, so keys[i] falls in the block found for the
+    // previous key unless it sorts after that block's index entry.
+    if (!iiter->Valid() || cmp->Compare(k, iiter->key()) > 0) {
+      delete block_iter;
+      block_iter = NULL;
+      iiter->Seek(k);
+      if (!iiter->Valid()) {
+        break;
+      }
+    }
+    Slice handle_value = iiter->value();
+    BlockHandle handle;
+    if (filter != NULL && !filter->whole_table() &&
+        handle.DecodeFrom(&handle_value).ok() &&
+        !filter->KeyMayMatch(handle.offset(), k)) {
+      continue;  // Not found
+    }
+    if (block_iter == NULL) {
+      block_iter = BlockReader(this, options, iiter->value(), true);
+    }
+    block_iter->Seek(k);
+    if (block_iter->Valid()) {
+      (*saver)(args[i], block_iter->key(), block_iter->value());
+    }
+    s = block_iter->status();
+  }
+  delete block_iter;
+  if (s.ok()) {
+    s = iiter->status();
+  }
+  delete iiter;
+  return s;
+}
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
@@ -288,4 +748,49 @@ uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
   return result;
 }
 
+void Table::GetDataBlockBoundaries(std::vector<std::string>* keys,
+                                   std::vector<uint64_t>* sizes) const {
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
+  for (index_iter->SeekToFirst(); index_iter->Valid(); index_iter->Next()) {
+    BlockHandle handle;
+    Slice input = index_iter->value();
+    if (handle.DecodeFrom(&input).ok()) {
+      keys->push_back(index_iter->key().ToString());
+      sizes->push_back(handle.size() + kBlockTrailerSize);
+    }
+  }
+  delete index_iter;
+}
+
+void Table::GetDataBlockHandles(std::vector<std::string>* keys,
+                                std::vector<std::string>* handles) const {
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
+  for (index_iter->SeekToFirst(); index_iter->Valid(); index_iter->Next()) {
+    keys->push_back(index_iter->key().ToString());
+    handles->push_back(index_iter->value().ToString());
+  }
+  delete index_iter;
+}
+
+Status Table::ReadDataBlock(const Slice& handle_value, std::string* stored,
+                            Iterator** entries) const {
+  *entries = NULL;
+  BlockHandle handle;
+  Slice input = handle_value;
+  Status s = handle.DecodeFrom(&input);
+  if (s.ok()) {
+    s = ReadRawBlock(rep_->file, handle, stored);
+  }
+  BlockContents contents;
+  if (s.ok()) {
+    s = DecodeRawBlock(*stored, &contents);
+  }
+  if (s.ok()) {
+    Block* block = new Block(contents);
+    *entries = block->NewIterator(rep_->options.comparator);
+    (*entries)->RegisterCleanup(&DeleteBlock, block, NULL);
+  }
+  return s;
+}
+
 }  // namespace leveldb
@@ -8,6 +8,7 @@
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/iterator.h"
 #include "leveldb/options.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
@@ -24,11 +25,15 @@ struct TableBuilder::Rep {
   uint64_t offset;
   Status status;
   BlockBuilder data_block;
-  BlockBuilder index_block;
+  BlockBuilder index_block;     // The current partition if partitioned
+  BlockBuilder top_index_block;
+  bool partitioned;
   std::string last_key;
   int64_t num_entries;
   bool closed;          // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
+  BlockBuilder range_del_block;
+  int64_t num_range_deletions;
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -49,12 +54,18 @@ struct TableBuilder::Rep {
         index_block_options(opt),
         file(f),
         offset(0),
-        data_block(&options),
+        data_block(&options, opt.data_block_hash_index),
         index_block(&index_block_options),
+        top_index_block(&index_block_options),
+        partitioned(opt.index_partition_size > 0),
         num_entries(0),
         closed(false),
         filter_block(opt.filter_policy == NULL ? NULL
-                     : new FilterBlockBuilder(opt.filter_policy)),
+                     : new FilterBlockBuilder(opt.filter_policy,
+                                              opt.whole_table_filter ||
+                                              partitioned)),
+        range_del_block(&options),
+        num_range_deletions(0),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
   }
@@ -80,6 +91,10 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if ((options.index_partition_size > 0) != rep_->partitioned) {
+    return Status::InvalidArgument(
+        "changing index partitioning while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
@@ -104,6 +119,7 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     r->pending_handle.EncodeTo(&handle_encoding);
     r->index_block.Add(r->last_key, Slice(handle_encoding));
     r->pending_index_entry = false;
+    MaybeFlushIndexPartition();
   }
 
   if (r->filter_block != NULL) {
@@ -120,6 +136,57 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::AddRangeDeletion(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  r->range_del_block.Add(key, value);
+  r->num_range_deletions++;
+}
+
+void TableBuilder::AddBlock(const Slice& stored, Iterator* entries) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  assert(stored.size() > kBlockTrailerSize);
+  Flush();
+  if (!ok()) return;
+
+  bool empty = true;
+  for (entries->SeekToFirst(); entries->Valid(); entries->Next()) {
+    const Slice key = entries->key();
+    empty = false;
+    if (r->pending_index_entry) {
+      r->options.comparator->FindShortestSeparator(&r->last_key, key);
+      std::string handle_encoding;
+      r->pending_handle.EncodeTo(&handle_encoding);
+      r->index_block.Add(r->last_key, Slice(handle_encoding));
+      r->pending_index_entry = false;
+      MaybeFlushIndexPartition();
+    } else if (r->num_entries > 0) {
+      assert(r->options.comparator->Compare(key, Slice(r->last_key)) > 0);
+    }
+    if (r->filter_block != NULL) {
+      r->filter_block->AddKey(key);
+    }
+    r->last_key.assign(key.data(), key.size());
+    r->num_entries++;
+  }
+  r->status = entries->status();
+  if (!ok() || empty) return;
+
+  r->pending_handle.set_offset(r->offset);
+  r->pending_handle.set_size(stored.size() - kBlockTrailerSize);
+  r->status = r->file->Append(stored);
+  if (ok()) {
+    r->offset += stored.size();
+    r->pending_index_entry = true;
+    r->status = r->file->Flush();
+  }
+  if (r->filter_block != NULL) {
+    r->filter_block->StartBlock(r->offset);
+  }
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
@@ -136,6 +203,41 @@ void TableBuilder::Flush() {
   }
 }
 
+void TableBuilder::MaybeFlushIndexPartition() {
+  Rep* r = rep_;
+  if (r->partitioned &&
+      r->index_block.CurrentSizeEstimate() >= r->options.index_partition_size) {
+    FlushIndexPartition();
+  }
+}
+
+// Write the current index partition and the filter over the keys of
+// its data blocks, and point a top-level index entry at both.  Called
+// between data blocks, so the partitions end up interleaved with them.
+void TableBuilder::FlushIndexPartition() {
+  Rep* r = rep_;
+  assert(r->partitioned && !r->index_block.empty());
+  if (!ok()) return;
+  BlockHandle index_handle, filter_handle;
+  if (r->filter_block != NULL) {
+    WriteRawBlock(r->filter_block->Finish(), kNoCompression, &filter_handle);
+    delete r->filter_block;
+    r->filter_block = new FilterBlockBuilder(r->options.filter_policy, true);
+  }
+  if (ok()) {
+    WriteBlock(&r->index_block, &index_handle);
+  }
+  if (ok()) {
+    // The key of the last entry of the partition is >= every key in it
+    std::string handle_encoding;
+    index_handle.EncodeTo(&handle_encoding);
+    if (r->filter_block != NULL) {
+      filter_handle.EncodeTo(&handle_encoding);
+    }
+    r->top_index_block.Add(r->last_key, Slice(handle_encoding));
+  }
+}
+
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
@@ -203,24 +305,56 @@ Status TableBuilder::Finish() {
   r->closed = true;
 
   BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle range_del_block_handle;
+
+  if (ok() && r->pending_index_entry) {
+    r->options.comparator->FindShortSuccessor(&r->last_key);
+    std::string handle_encoding;
+    r->pending_handle.EncodeTo(&handle_encoding);
+    r->index_block.Add(r->last_key, Slice(handle_encoding));
+    r->pending_index_entry = false;
+  }
+
+  // Write the last index partition, which takes the rest of the filter
+  if (ok() && r->partitioned && !r->index_block.empty()) {
+    FlushIndexPartition();
+  }
 
   // Write filter block
-  if (ok() && r->filter_block != NULL) {
+  if (ok() && r->filter_block != NULL && !r->partitioned) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
   }
 
+  // Write range deletion block
+  if (ok() && r->num_range_deletions > 0) {
+    WriteBlock(&r->range_del_block, &range_del_block_handle);
+  }
+
   // Write metaindex block
   if (ok()) {
     BlockBuilder meta_index_block(&r->options);
-    if (r->filter_block != NULL) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
+    if (r->filter_block != NULL && r->partitioned) {
+      // The top-level index locates the filter partitions; this entry
+      // only records which policy built them.
+      std::string key = kPartitionedFilterPrefix;
+      key.append(r->options.filter_policy->Name());
+      meta_index_block.Add(key, Slice());
+    } else if (r->filter_block != NULL) {
+      // Add mapping from "filter.Name" (or "fullfilter.Name") to
+      // location of filter data
+      std::string key = r->options.whole_table_filter ? "fullfilter."
+                                                      : "filter.";
       key.append(r->options.filter_policy->Name());
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (r->num_range_deletions > 0) {
+      std::string handle_encoding;
+      range_del_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kRangeDelBlockName, handle_encoding);
+    }
 
     // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
@@ -228,19 +362,14 @@ Status TableBuilder::Finish() {
 
   // Write index block
   if (ok()) {
-    if (r->pending_index_entry) {
-      r->options.comparator->FindShortSuccessor(&r->last_key);
-      std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
-    }
-    WriteBlock(&r->index_block, &index_block_handle);
+    WriteBlock(r->partitioned ? &r->top_index_block : &r->index_block,
+               &index_block_handle);
   }
 
   // Write footer
   if (ok()) {
     Footer footer;
+    footer.set_partitioned_index(r->partitioned);
     footer.set_metaindex_handle(metaindex_block_handle);
     footer.set_index_handle(index_block_handle);
     std::string footer_encoding;
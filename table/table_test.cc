@@ -9,13 +9,16 @@
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
 #include "leveldb/iterator.h"
 #include "leveldb/table_builder.h"
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "table/merger.h"
 #include "util/random.h"
 #include "util/testharness.h"
 #include "util/testutil.h"
@@ -110,15 +113,18 @@ class StringSink: public WritableFile {
 class StringSource: public RandomAccessFile {
  public:
   StringSource(const Slice& contents)
-      : contents_(contents.data(), contents.size()) {
+      : contents_(contents.data(), contents.size()),
+        reads_(0) {
   }
 
   virtual ~StringSource() { }
 
   uint64_t Size() const { return contents_.size(); }
+  int reads() const { return reads_; }
 
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                        char* scratch) const {
+    reads_++;
     if (offset > contents_.size()) {
       return Status::InvalidArgument("invalid Read offset");
     }
@@ -132,6 +138,7 @@ class StringSource: public RandomAccessFile {
 
  private:
   std::string contents_;
+  mutable int reads_;
 };
 
 typedef std::map<std::string, std::string, STLLessThan> KVMap;
@@ -190,7 +197,7 @@ class BlockConstructor: public Constructor {
   virtual Status FinishImpl(const Options& options, const KVMap& data) {
     delete block_;
     block_ = NULL;
-    BlockBuilder builder(&options);
+    BlockBuilder builder(&options, options.data_block_hash_index);
 
     for (KVMap::const_iterator it = data.begin();
          it != data.end();
@@ -218,6 +225,52 @@ class BlockConstructor: public Constructor {
   BlockConstructor();
 };
 
+// Spreads the data over several blocks and merges their iterators.
+class MergerConstructor: public Constructor {
+ public:
+  explicit MergerConstructor(const Comparator* cmp)
+      : Constructor(cmp),
+        comparator_(cmp) {
+    for (int i = 0; i < kNumChildren; i++) {
+      children_[i] = new BlockConstructor(cmp);
+    }
+  }
+  ~MergerConstructor() {
+    for (int i = 0; i < kNumChildren; i++) {
+      delete children_[i];
+    }
+  }
+  virtual Status FinishImpl(const Options& options, const KVMap& data) {
+    std::vector<KVMap> parts(kNumChildren, KVMap(STLLessThan(comparator_)));
+    int i = 0;
+    for (KVMap::const_iterator it = data.begin();
+         it != data.end();
+         ++it, ++i) {
+      // Uneven split, so that some children run out before others
+      parts[(i * i) % kNumChildren][it->first] = it->second;
+    }
+    for (int c = 0; c < kNumChildren; c++) {
+      Status s = children_[c]->FinishImpl(options, parts[c]);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return Status::OK();
+  }
+  virtual Iterator* NewIterator() const {
+    Iterator* list[kNumChildren];
+    for (int i = 0; i < kNumChildren; i++) {
+      list[i] = children_[i]->NewIterator();
+    }
+    return NewMergingIterator(comparator_, list, kNumChildren);
+  }
+
+ private:
+  enum { kNumChildren = 7 };
+  const Comparator* comparator_;
+  BlockConstructor* children_[kNumChildren];
+};
+
 class TableConstructor: public Constructor {
  public:
   TableConstructor(const Comparator* cmp)
@@ -399,6 +452,7 @@ class DBConstructor: public Constructor {
 enum TestType {
   TABLE_TEST,
   BLOCK_TEST,
+  MERGER_TEST,
   MEMTABLE_TEST,
   DB_TEST
 };
@@ -407,30 +461,46 @@ struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  bool data_block_hash_index;
+  size_t index_partition_size;
 };
 
 static const TestArgs kTestArgList[] = {
-  { TABLE_TEST, false, 16 },
-  { TABLE_TEST, false, 1 },
-  { TABLE_TEST, false, 1024 },
-  { TABLE_TEST, true, 16 },
-  { TABLE_TEST, true, 1 },
-  { TABLE_TEST, true, 1024 },
-
-  { BLOCK_TEST, false, 16 },
-  { BLOCK_TEST, false, 1 },
-  { BLOCK_TEST, false, 1024 },
-  { BLOCK_TEST, true, 16 },
-  { BLOCK_TEST, true, 1 },
-  { BLOCK_TEST, true, 1024 },
+  { TABLE_TEST, false, 16, false, 0 },
+  { TABLE_TEST, false, 1, false, 0 },
+  { TABLE_TEST, false, 1024, false, 0 },
+  { TABLE_TEST, true, 16, false, 0 },
+  { TABLE_TEST, true, 1, false, 0 },
+  { TABLE_TEST, true, 1024, false, 0 },
+  { TABLE_TEST, false, 16, true, 0 },
+  { TABLE_TEST, true, 1, true, 0 },
+  { TABLE_TEST, false, 16, false, 64 },
+  { TABLE_TEST, true, 1, false, 64 },
+  { TABLE_TEST, false, 1024, false, 64 },
+  { TABLE_TEST, false, 16, true, 256 },
+
+  { BLOCK_TEST, false, 16, false, 0 },
+  { BLOCK_TEST, false, 1, false, 0 },
+  { BLOCK_TEST, false, 1024, false, 0 },
+  { BLOCK_TEST, true, 16, false, 0 },
+  { BLOCK_TEST, true, 1, false, 0 },
+  { BLOCK_TEST, true, 1024, false, 0 },
+  { BLOCK_TEST, false, 16, true, 0 },
+  { BLOCK_TEST, true, 1, true, 0 },
+
+  { MERGER_TEST, false, 16, false, 0 },
+  { MERGER_TEST, true, 16, false, 0 },
 
   // Restart interval does not matter for memtables
-  { MEMTABLE_TEST, false, 16 },
-  { MEMTABLE_TEST, true, 16 },
+  { MEMTABLE_TEST, false, 16, false, 0 },
+  { MEMTABLE_TEST, true, 16, false, 0 },
 
   // Do not bother with restart interval variations for DB
-  { DB_TEST, false, 16 },
-  { DB_TEST, true, 16 },
+  { DB_TEST, false, 16, false, 0 },
+  { DB_TEST, true, 16, false, 0 },
+  { DB_TEST, false, 16, true, 0 },
+  { DB_TEST, false, 16, false, 64 },
+  { DB_TEST, true, 16, false, 256 },
 };
 static const int kNumTestArgs = sizeof(kTestArgList) / sizeof(kTestArgList[0]);
 
@@ -444,6 +514,8 @@ class Harness {
     options_ = Options();
 
     options_.block_restart_interval = args.restart_interval;
+    options_.data_block_hash_index = args.data_block_hash_index;
+    options_.index_partition_size = args.index_partition_size;
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
@@ -457,6 +529,9 @@ class Harness {
       case BLOCK_TEST:
         constructor_ = new BlockConstructor(options_.comparator);
         break;
+      case MERGER_TEST:
+        constructor_ = new MergerConstructor(options_.comparator);
+        break;
       case MEMTABLE_TEST:
         constructor_ = new MemTableConstructor(options_.comparator);
         break;
@@ -735,7 +810,7 @@ TEST(Harness, Randomized) {
 
 TEST(Harness, RandomizedLongDB) {
   Random rnd(test::RandomSeed());
-  TestArgs args = { DB_TEST, false, 16 };
+  TestArgs args = { DB_TEST, false, 16, false, 0 };
   Init(args);
   int num_entries = 100000;
   for (int e = 0; e < num_entries; e++) {
@@ -861,6 +936,240 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"),    4000,   6000));
 }
 
+TEST(TableTest, BlockHashIndex) {
+  // Several versions of each key, as the DB stores them, so that some
+  // keys span restart intervals
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options options;
+  options.comparator = &icmp;
+  options.block_restart_interval = 4;
+  BlockBuilder builder(&options, true);
+  char user_key[10];
+  for (int i = 0; i < 100; i++) {
+    snprintf(user_key, sizeof(user_key), "k%03d", i * 2);
+    for (int v = i % 5; v >= 0; v--) {
+      InternalKey ikey(user_key, 100 + v, kTypeValue);
+      builder.Add(ikey.Encode(), std::string(1, 'a' + v));
+    }
+  }
+  std::string data = builder.Finish().ToString();
+  BlockContents contents;
+  contents.data = data;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+
+  Iterator* lookup = block.NewIterator(&icmp, true);
+  for (int i = 0; i < 100; i++) {
+    snprintf(user_key, sizeof(user_key), "k%03d", i * 2);
+    const int versions = i % 5 + 1;
+    for (int v = 0; v < versions; v++) {
+      // The newest version visible at sequence 100 + v
+      InternalKey target(user_key, 100 + v, kValueTypeForSeek);
+      lookup->Seek(target.Encode());
+      ASSERT_TRUE(lookup->Valid());
+      ASSERT_EQ(std::string(user_key),
+                ExtractUserKey(lookup->key()).ToString());
+      ASSERT_EQ(std::string(1, 'a' + v), lookup->value().ToString());
+    }
+
+    // Missing keys leave the lookup iterator invalid, or on a later key
+    // if they collide in the index with a present one
+    snprintf(user_key, sizeof(user_key), "k%03d", i * 2 + 1);
+    InternalKey missing(user_key, 200, kValueTypeForSeek);
+    lookup->Seek(missing.Encode());
+    if (lookup->Valid()) {
+      ASSERT_NE(std::string(user_key),
+                ExtractUserKey(lookup->key()).ToString());
+    }
+  }
+  ASSERT_OK(lookup->status());
+  delete lookup;
+
+  // A plain iterator over the same block ignores the index
+  Iterator* iter = block.NewIterator(&icmp);
+  InternalKey missing("k001", 200, kValueTypeForSeek);
+  iter->Seek(missing.Encode());
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("k002", ExtractUserKey(iter->key()).ToString());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(300, count);
+  delete iter;
+}
+
+TEST(TableTest, PartitionedIndex) {
+  Options options;
+  options.block_size = 256;
+  options.index_partition_size = 128;
+  options.compression = kNoCompression;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  char key[10];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "k%04d", i * 2);
+    builder.Add(key, std::string(50, 'a' + i % 26));
+  }
+  ASSERT_OK(builder.Finish());
+
+  StringSource source(sink.contents());
+  Table* table;
+  ASSERT_OK(Table::Open(options, &source, sink.contents().size(), &table));
+
+  // The data blocks and partitions can be walked in order from the
+  // top-level index
+  std::vector<std::string> keys;
+  std::vector<uint64_t> sizes;
+  table->GetDataBlockBoundaries(&keys, &sizes);
+  ASSERT_GT(keys.size(), 100u);
+  for (size_t i = 1; i < keys.size(); i++) {
+    ASSERT_LT(keys[i - 1], keys[i]);
+  }
+
+  Iterator* iter = table->NewIterator(ReadOptions());
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "k%04d", i * 2 + 1);
+    iter->Seek(key);
+    if (i == 999) {
+      ASSERT_TRUE(!iter->Valid());
+    } else {
+      snprintf(key, sizeof(key), "k%04d", i * 2 + 2);
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(key, iter->key().ToString());
+    }
+  }
+  int count = 0;
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    count++;
+  }
+  ASSERT_EQ(1000, count);
+  ASSERT_OK(iter->status());
+  delete iter;
+
+  // Offsets still grow with the key, across partitions
+  ASSERT_LT(table->ApproximateOffsetOf("k0100"),
+            table->ApproximateOffsetOf("k1000"));
+  ASSERT_LT(table->ApproximateOffsetOf("k1000"),
+            table->ApproximateOffsetOf("k1900"));
+
+  delete table;
+  delete options.filter_policy;
+}
+
+// Read every data block of a table twice the size of the block cache,
+// and return the number of file reads that a lookup in the index then
+// takes.
+static int IndexReadsAfterScan(Cache* cache, bool cache_index) {
+  Options options;
+  options.compression = kNoCompression;
+  options.block_cache = cache;
+  options.cache_index_and_filter_blocks = cache_index;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  char key[10];
+  for (int i = 0; i < 4000; i++) {
+    snprintf(key, sizeof(key), "k%04d", i);
+    builder.Add(key, std::string(150, 'v'));
+  }
+  ASSERT_OK(builder.Finish());
+  ASSERT_GT(sink.contents().size(), 2 * (256u << 10));
+
+  StringSource source(sink.contents());
+  Table* table;
+  ASSERT_OK(Table::Open(options, &source, sink.contents().size(), &table));
+  // The footer is read, and the index block unless it belongs in the cache
+  ASSERT_EQ(cache_index ? 1 : 2, source.reads());
+  if (cache_index) {
+    ASSERT_EQ(0, cache->TotalCharge());
+  }
+
+  Iterator* iter = table->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(4000, count);
+  delete iter;
+
+  const int reads = source.reads();
+  table->ApproximateOffsetOf("k1500");
+  delete table;
+  delete cache;
+  return source.reads() - reads;
+}
+
+TEST(TableTest, CacheIndexAndFilterBlocks) {
+  // The index is charged to the block cache, so a cache without a high
+  // priority pool loses it to the data blocks, but one with a pool
+  // keeps it
+  ASSERT_EQ(1, IndexReadsAfterScan(NewLRUCache(256 << 10), true));
+  ASSERT_EQ(0, IndexReadsAfterScan(NewLRUCache(256 << 10, 0.5), true));
+  ASSERT_EQ(0, IndexReadsAfterScan(NewLRUCache(256 << 10), false));
+}
+
+TEST(TableTest, AddBlock) {
+  Options options;
+  options.block_size = 256;
+  options.compression = kNoCompression;
+  StringSink source_sink;
+  TableBuilder source_builder(options, &source_sink);
+  char key[10];
+  for (int i = 0; i < 200; i++) {
+    snprintf(key, sizeof(key), "k%03d", i);
+    source_builder.Add(key, std::string(20, 'a' + i % 26));
+  }
+  ASSERT_OK(source_builder.Finish());
+  StringSource source_file(source_sink.contents());
+  Table* source;
+  ASSERT_OK(Table::Open(options, &source_file, source_file.Size(), &source));
+
+  // Copy every data block of the source between two keys of our own
+  std::vector<std::string> index_keys;
+  std::vector<std::string> handles;
+  source->GetDataBlockHandles(&index_keys, &handles);
+  ASSERT_GT(handles.size(), 10u);
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  builder.Add("a", "first");
+  for (size_t i = 0; i < handles.size(); i++) {
+    std::string stored;
+    Iterator* entries;
+    ASSERT_OK(source->ReadDataBlock(handles[i], &stored, &entries));
+    builder.AddBlock(stored, entries);
+    delete entries;
+  }
+  builder.Add("z", "last");
+  ASSERT_OK(builder.Finish());
+  ASSERT_EQ(202u, builder.NumEntries());
+  delete source;
+
+  StringSource file(sink.contents());
+  Table* table;
+  ASSERT_OK(Table::Open(options, &file, file.Size(), &table));
+  Iterator* iter = table->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("a", iter->key().ToString());
+  for (int i = 0; i < 200; i++) {
+    iter->Next();
+    snprintf(key, sizeof(key), "k%03d", i);
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(key, iter->key().ToString());
+    ASSERT_EQ(std::string(20, 'a' + i % 26), iter->value().ToString());
+  }
+  iter->Next();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("z", iter->key().ToString());
+  iter->Seek("k150");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("k150", iter->key().ToString());
+  delete iter;
+  delete table;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -7,6 +7,10 @@
 #include "leveldb/slice.h"
 #include "util/hash.h"
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 namespace leveldb {
 
 namespace {
@@ -86,10 +90,129 @@ class BloomFilterPolicy : public FilterPolicy {
     return true;
   }
 };
+
+// A bloom filter made of 64-byte blocks.  Each key sets all of its bits
+// in a single block, so a probe touches one cache line.  The block is
+// picked from the key's hash; successive probe positions are the top 9
+// bits of the hash times growing powers of an odd multiplier.
+static const size_t kCacheLineBytes = 64;
+static const uint32_t kProbeMultiplier = 0x9e3779b9;  // Golden ratio
+
+class BlockedBloomFilterPolicy : public FilterPolicy {
+ private:
+  size_t bits_per_key_;
+  size_t k_;
+
+  // Return the offset of the block for hash "h" in a filter of
+  // "num_blocks" blocks.
+  static size_t BlockOffset(uint32_t h, size_t num_blocks) {
+    // Map the hash onto [0, num_blocks) without a division
+    const uint64_t index = (static_cast<uint64_t>(h) * num_blocks) >> 32;
+    return static_cast<size_t>(index) * kCacheLineBytes;
+  }
+
+  static bool BlockMayMatch(uint32_t h, const char* block, size_t k) {
+#ifdef __AVX2__
+    // Eight probes at a time: compute the bit positions in parallel and
+    // check them against the block with a single test.
+    const uint32_t m = kProbeMultiplier;
+    const uint32_t m2 = m * m, m3 = m2 * m, m4 = m3 * m;
+    const uint32_t m5 = m4 * m, m6 = m5 * m, m7 = m6 * m, m8 = m7 * m;
+    const __m256i multipliers = _mm256_setr_epi32(m, m2, m3, m4,
+                                                  m5, m6, m7, m8);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i ones = _mm256_set1_epi32(1);
+    const __m256i low5 = _mm256_set1_epi32(31);
+    const int* words = reinterpret_cast<const int*>(block);
+    for (size_t done = 0; done < k; done += 8) {
+      const __m256i hashes = _mm256_mullo_epi32(
+          _mm256_set1_epi32(static_cast<int>(h)), multipliers);
+      const __m256i bitpos = _mm256_srli_epi32(hashes, 23);
+      const __m256i word = _mm256_i32gather_epi32(
+          words, _mm256_srli_epi32(bitpos, 5), 4);
+      __m256i mask = _mm256_sllv_epi32(ones, _mm256_and_si256(bitpos, low5));
+      // Lanes past the k-th probe always pass
+      mask = _mm256_and_si256(mask, _mm256_cmpgt_epi32(
+          _mm256_set1_epi32(static_cast<int>(k - done)), lanes));
+      if (!_mm256_testc_si256(word, mask)) {
+        return false;
+      }
+      h *= m8;
+    }
+    return true;
+#else
+    for (size_t j = 0; j < k; j++) {
+      h *= kProbeMultiplier;
+      const uint32_t bitpos = h >> 23;
+      if ((block[bitpos/8] & (1 << (bitpos % 8))) == 0) return false;
+    }
+    return true;
+#endif
+  }
+
+ public:
+  explicit BlockedBloomFilterPolicy(int bits_per_key)
+      : bits_per_key_(bits_per_key) {
+    // Blocks fill unevenly, so round to nearest rather than down to
+    // keep the false positive rate close to that of a plain bloom filter
+    k_ = static_cast<size_t>(bits_per_key * 0.69 + 0.5);
+    if (k_ < 1) k_ = 1;
+    if (k_ > 30) k_ = 30;
+  }
+
+  virtual const char* Name() const {
+    return "leveldb.BlockedBloomFilter";
+  }
+
+  virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const {
+    const size_t block_bits = kCacheLineBytes * 8;
+    size_t num_blocks = (n * bits_per_key_ + block_bits - 1) / block_bits;
+    if (num_blocks < 1) num_blocks = 1;
+
+    // Blocks are addressed relative to the start of the filter and read
+    // in place, so no alignment is assumed.
+    const size_t init_size = dst->size();
+    dst->resize(init_size + num_blocks * kCacheLineBytes, 0);
+    dst->push_back(static_cast<char>(k_));  // Remember # of probes in filter
+    char* array = &(*dst)[init_size];
+    for (int i = 0; i < n; i++) {
+      uint32_t h = BloomHash(keys[i]);
+      char* block = array + BlockOffset(h, num_blocks);
+      for (size_t j = 0; j < k_; j++) {
+        h *= kProbeMultiplier;
+        const uint32_t bitpos = h >> 23;
+        block[bitpos/8] |= (1 << (bitpos % 8));
+      }
+    }
+  }
+
+  virtual bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const {
+    const size_t len = bloom_filter.size();
+    if (len < kCacheLineBytes + 1) return false;
+    if ((len - 1) % kCacheLineBytes != 0) {
+      return true;  // Not a layout we know; consider it a match
+    }
+
+    const char* array = bloom_filter.data();
+    const size_t k = array[len-1];
+    if (k > 30) {
+      // Reserved for potentially new encodings.  Consider it a match.
+      return true;
+    }
+
+    const uint32_t h = BloomHash(key);
+    const size_t num_blocks = (len - 1) / kCacheLineBytes;
+    return BlockMayMatch(h, array + BlockOffset(h, num_blocks), k);
+  }
+};
 }
 
 const FilterPolicy* NewBloomFilterPolicy(int bits_per_key) {
   return new BloomFilterPolicy(bits_per_key);
 }
 
+const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key) {
+  return new BlockedBloomFilterPolicy(bits_per_key);
+}
+
 }  // namespace leveldb
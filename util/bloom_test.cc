@@ -4,6 +4,7 @@
 
 #include "leveldb/filter_policy.h"
 
+#include "leveldb/env.h"
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/testharness.h"
@@ -26,6 +27,7 @@ class BloomTest {
 
  public:
   BloomTest() : policy_(NewBloomFilterPolicy(10)) { }
+  explicit BloomTest(const FilterPolicy* policy) : policy_(policy) { }
 
   ~BloomTest() {
     delete policy_;
@@ -83,6 +85,24 @@ class BloomTest {
     }
     return result / 10000.0;
   }
+
+  // Check filters of many sizes against the given bounds on their
+  // size overhead and false positive rate.
+  void CheckVaryingLengths(size_t extra_bytes, double max_rate,
+                           double good_rate);
+
+  // Report the time taken by lookups in a filter over "n" keys.
+  void Benchmark(const char* label, int n);
+};
+
+class BlockedBloomTest : public BloomTest {
+ public:
+  BlockedBloomTest() : BloomTest(NewBlockedBloomFilterPolicy(10)) { }
+};
+
+class RibbonTest : public BloomTest {
+ public:
+  RibbonTest() : BloomTest(NewRibbonFilterPolicy(10)) { }
 };
 
 TEST(BloomTest, EmptyFilter) {
@@ -112,7 +132,8 @@ static int NextLength(int length) {
   return length;
 }
 
-TEST(BloomTest, VaryingLengths) {
+void BloomTest::CheckVaryingLengths(size_t extra_bytes, double max_rate,
+                                    double good_rate) {
   char buffer[sizeof(int)];
 
   // Count number of filters that significantly exceed the false positive rate
@@ -126,7 +147,8 @@ TEST(BloomTest, VaryingLengths) {
     }
     Build();
 
-    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 40))
+    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) +
+                                                extra_bytes))
         << length;
 
     // All added keys must match
@@ -141,8 +163,8 @@ TEST(BloomTest, VaryingLengths) {
       fprintf(stderr, "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
               rate*100.0, length, static_cast<int>(FilterSize()));
     }
-    ASSERT_LE(rate, 0.02);   // Must not be over 2%
-    if (rate > 0.0125) mediocre_filters++;  // Allowed, but not too often
+    ASSERT_LE(rate, max_rate);
+    if (rate > good_rate) mediocre_filters++;  // Allowed, but not too often
     else good_filters++;
   }
   if (kVerbose >= 1) {
@@ -152,6 +174,125 @@ TEST(BloomTest, VaryingLengths) {
   ASSERT_LE(mediocre_filters, good_filters/5);
 }
 
+void BloomTest::Benchmark(const char* label, int n) {
+  char buffer[sizeof(int)];
+  Reset();
+  for (int i = 0; i < n; i++) {
+    Add(Key(i, buffer));
+  }
+  Build();
+
+  const int kLookups = 1000000;
+  int hits = 0;
+  const uint64_t start = Env::Default()->NowMicros();
+  for (int i = 0; i < kLookups; i++) {
+    // Alternate present and absent keys
+    if (Matches(Key((i & 1) ? i % n : i + 1000000000, buffer))) {
+      hits++;
+    }
+  }
+  const uint64_t micros = Env::Default()->NowMicros() - start;
+  ASSERT_GE(hits, kLookups / 2);
+  if (kVerbose >= 1) {
+    fprintf(stderr, "%s: %d keys, %d bytes, %.1f ns/probe, %.2f%% fp\n",
+            label, n, static_cast<int>(FilterSize()),
+            micros * 1000.0 / kLookups, FalsePositiveRate() * 100.0);
+  }
+}
+
+TEST(BloomTest, VaryingLengths) {
+  CheckVaryingLengths(40, 0.02, 0.0125);
+}
+
+TEST(BloomTest, Benchmark) {
+  Benchmark("bloom", 1000000);
+}
+
+TEST(BlockedBloomTest, BlockedEmptyFilter) {
+  ASSERT_TRUE(! Matches("hello"));
+  ASSERT_TRUE(! Matches("world"));
+}
+
+TEST(BlockedBloomTest, BlockedSmall) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(! Matches("x"));
+  ASSERT_TRUE(! Matches("foo"));
+}
+
+TEST(BlockedBloomTest, BlockedVaryingLengths) {
+  // Filters are made of whole 64-byte blocks
+  CheckVaryingLengths(65, 0.02, 0.0125);
+}
+
+TEST(BlockedBloomTest, BlockedBenchmark) {
+  Benchmark("blocked bloom", 1000000);
+}
+
+TEST(RibbonTest, RibbonEmptyFilter) {
+  ASSERT_TRUE(! Matches("hello"));
+  ASSERT_TRUE(! Matches("world"));
+}
+
+TEST(RibbonTest, RibbonSmall) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(! Matches("x"));
+  ASSERT_TRUE(! Matches("foo"));
+}
+
+TEST(RibbonTest, RibbonDuplicates) {
+  Add("hello");
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+}
+
+TEST(RibbonTest, RibbonVaryingLengths) {
+  // Small filters are padded to a 64-slot band
+  CheckVaryingLengths(70, 0.02, 0.0125);
+}
+
+TEST(RibbonTest, RibbonSpace) {
+  // Compared with a bloom filter over the same keys, for about the
+  // same false positive rate
+  char buffer[sizeof(int)];
+  const int kKeys = 100000;
+  std::vector<std::string> keys;
+  std::vector<Slice> slices;
+  for (int i = 0; i < kKeys; i++) {
+    keys.push_back(Key(i, buffer).ToString());
+  }
+  for (int i = 0; i < kKeys; i++) {
+    slices.push_back(keys[i]);
+  }
+  const FilterPolicy* bloom = NewBloomFilterPolicy(10);
+  std::string bloom_filter;
+  bloom->CreateFilter(&slices[0], kKeys, &bloom_filter);
+  delete bloom;
+
+  for (int i = 0; i < kKeys; i++) {
+    Add(keys[i]);
+  }
+  Build();
+  if (kVerbose >= 1) {
+    fprintf(stderr, "%d keys: bloom %d bytes, ribbon %d bytes\n", kKeys,
+            static_cast<int>(bloom_filter.size()),
+            static_cast<int>(FilterSize()));
+  }
+  ASSERT_LE(FilterSize(), bloom_filter.size() * 4 / 5);
+  ASSERT_LE(FalsePositiveRate(), 0.0125);
+}
+
+TEST(RibbonTest, RibbonBenchmark) {
+  Benchmark("ribbon", 1000000);
+}
+
 // Different bits-per-byte
 
 }  // namespace leveldb
@@ -16,12 +16,24 @@ namespace leveldb {
 Cache::~Cache() {
 }
 
+Cache::Handle* Cache::Insert(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key, void* value),
+                             Priority priority) {
+  return Insert(key, value, charge, deleter);
+}
+
+size_t Cache::TotalCharge() const {
+  return 0;
+}
+
 namespace {
 
 // LRU cache implementation
 
 // An entry is a variable length heap-allocated structure.  Entries
-// are kept in a circular doubly linked list ordered by access time.
+// are kept in a circular doubly linked list ordered by access time,
+// except that all entries on probation come first, and all entries in
+// the high priority pool come last.
 struct LRUHandle {
   void* value;
   void (*deleter)(const Slice&, void* value);
@@ -32,6 +44,10 @@ struct LRUHandle {
   size_t key_length;
   uint32_t refs;
   uint32_t hash;      // Hash of key(); used for fast sharding and comparisons
+  bool high_priority;
+  bool in_high_pri_pool;
+  bool in_probation;
+  bool hit;           // Looked up since it was inserted
   char key_data[1];   // Beginning of key
 
   Slice key() const {
@@ -138,40 +154,71 @@ class LRUCache {
   ~LRUCache();
 
   // Separate from constructor so caller can easily make an array of LRUCache
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  void SetCapacity(size_t capacity, double high_pri_pool_ratio,
+                   double probation_ratio) {
+    capacity_ = capacity;
+    high_pri_pool_capacity_ = static_cast<size_t>(capacity *
+                                                  high_pri_pool_ratio);
+    probation_ = (probation_ratio > 0);
+    hot_capacity_ = static_cast<size_t>(
+        (capacity_ - high_pri_pool_capacity_) * (1 - probation_ratio));
+  }
 
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key, uint32_t hash,
                         void* value, size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
+  size_t TotalCharge() const {
+    MutexLock l(&mutex_);
+    return usage_;
+  }
 
  private:
   void LRU_Remove(LRUHandle* e);
   void LRU_Append(LRUHandle* e);
+  void MaintainHotSize();
   void Unref(LRUHandle* e);
 
   // Initialized before use.
   size_t capacity_;
+  size_t high_pri_pool_capacity_;
+  bool probation_;
+  size_t hot_capacity_;  // Of entries neither on probation nor in the pool
 
   // mutex_ protects the following state.
-  port::Mutex mutex_;
+  mutable port::Mutex mutex_;
   size_t usage_;
+  size_t high_pri_pool_usage_;
+  size_t hot_usage_;
 
   // Dummy head of LRU list.
   // lru.prev is newest entry, lru.next is oldest entry.
   LRUHandle lru_;
 
+  // Newest entry outside the high priority pool, or &lru_ if none.
+  // The entries of the pool follow it, oldest first.
+  LRUHandle* lru_low_pri_;
+
+  // Newest entry on probation, or &lru_ if none.  Equal to lru_low_pri_
+  // if every entry outside the pool is on probation.
+  LRUHandle* lru_probation_;
+
   HandleTable table_;
 };
 
 LRUCache::LRUCache()
-    : usage_(0) {
+    : usage_(0),
+      high_pri_pool_usage_(0),
+      hot_usage_(0) {
   // Make empty circular linked list
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  lru_low_pri_ = &lru_;
+  lru_probation_ = &lru_;
 }
 
 LRUCache::~LRUCache() {
@@ -194,16 +241,81 @@ void LRUCache::Unref(LRUHandle* e) {
 }
 
 void LRUCache::LRU_Remove(LRUHandle* e) {
+  if (lru_low_pri_ == e) {
+    lru_low_pri_ = e->prev;
+  }
+  if (lru_probation_ == e) {
+    lru_probation_ = e->prev;
+  }
   e->next->prev = e->prev;
   e->prev->next = e->next;
+  if (e->in_high_pri_pool) {
+    high_pri_pool_usage_ -= e->charge;
+  } else if (!e->in_probation) {
+    hot_usage_ -= e->charge;
+  }
 }
 
 void LRUCache::LRU_Append(LRUHandle* e) {
-  // Make "e" newest entry by inserting just before lru_
-  e->next = &lru_;
-  e->prev = lru_.prev;
-  e->prev->next = e;
-  e->next->prev = e;
+  if (e->high_priority) {
+    // Make "e" newest entry by inserting just before lru_
+    e->next = &lru_;
+    e->prev = lru_.prev;
+    e->prev->next = e;
+    e->next->prev = e;
+    e->in_high_pri_pool = true;
+    high_pri_pool_usage_ += e->charge;
+
+    // Move the oldest entries of an overfull pool out of it, which makes
+    // them the newest entries outside it
+    while (high_pri_pool_usage_ > high_pri_pool_capacity_) {
+      lru_low_pri_ = lru_low_pri_->next;
+      assert(lru_low_pri_ != &lru_);
+      lru_low_pri_->in_high_pri_pool = false;
+      lru_low_pri_->in_probation = false;
+      high_pri_pool_usage_ -= lru_low_pri_->charge;
+      hot_usage_ += lru_low_pri_->charge;
+    }
+    MaintainHotSize();
+  } else if (probation_ && !e->hit) {
+    // Make "e" the newest entry on probation
+    const bool hot_empty = (lru_low_pri_ == lru_probation_);
+    e->next = lru_probation_->next;
+    e->prev = lru_probation_;
+    e->prev->next = e;
+    e->next->prev = e;
+    e->in_high_pri_pool = false;
+    e->in_probation = true;
+    lru_probation_ = e;
+    if (hot_empty) {
+      lru_low_pri_ = e;
+    }
+  } else {
+    // Make "e" the newest entry outside the high priority pool
+    e->next = lru_low_pri_->next;
+    e->prev = lru_low_pri_;
+    e->prev->next = e;
+    e->next->prev = e;
+    e->in_high_pri_pool = false;
+    e->in_probation = false;
+    lru_low_pri_ = e;
+    hot_usage_ += e->charge;
+    MaintainHotSize();
+  }
+}
+
+void LRUCache::MaintainHotSize() {
+  if (!probation_) {
+    return;
+  }
+  // Move the oldest entries that were looked up onto probation, which
+  // makes them the newest entries there
+  while (hot_usage_ > hot_capacity_) {
+    lru_probation_ = lru_probation_->next;
+    assert(lru_probation_ != &lru_ && !lru_probation_->in_high_pri_pool);
+    lru_probation_->in_probation = true;
+    hot_usage_ -= lru_probation_->charge;
+  }
 }
 
 Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
@@ -212,6 +324,7 @@ Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
   if (e != NULL) {
     e->refs++;
     LRU_Remove(e);
+    e->hit = true;
     LRU_Append(e);
   }
   return reinterpret_cast<Cache::Handle*>(e);
@@ -224,7 +337,8 @@ void LRUCache::Release(Cache::Handle* handle) {
 
 Cache::Handle* LRUCache::Insert(
     const Slice& key, uint32_t hash, void* value, size_t charge,
-    void (*deleter)(const Slice& key, void* value)) {
+    void (*deleter)(const Slice& key, void* value),
+    Cache::Priority priority) {
   MutexLock l(&mutex_);
 
   LRUHandle* e = reinterpret_cast<LRUHandle*>(
@@ -235,6 +349,8 @@ Cache::Handle* LRUCache::Insert(
   e->key_length = key.size();
   e->hash = hash;
   e->refs = 2;  // One from LRUCache, one for the returned handle
+  e->high_priority = (priority == Cache::kHighPriority);
+  e->hit = false;
   memcpy(e->key_data, key.data(), key.size());
   LRU_Append(e);
   usage_ += charge;
@@ -282,18 +398,25 @@ class ShardedLRUCache : public Cache {
   }
 
  public:
-  explicit ShardedLRUCache(size_t capacity)
+  ShardedLRUCache(size_t capacity, double high_pri_pool_ratio,
+                  double probation_ratio)
       : last_id_(0) {
     const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
     for (int s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
+      shard_[s].SetCapacity(per_shard, high_pri_pool_ratio, probation_ratio);
     }
   }
   virtual ~ShardedLRUCache() { }
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) {
+    return Insert(key, value, charge, deleter, kLowPriority);
+  }
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority) {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
   }
   virtual Handle* Lookup(const Slice& key) {
     const uint32_t hash = HashSlice(key);
@@ -314,12 +437,28 @@ class ShardedLRUCache : public Cache {
     MutexLock l(&id_mutex_);
     return ++(last_id_);
   }
+  virtual size_t TotalCharge() const {
+    size_t total = 0;
+    for (int s = 0; s < kNumShards; s++) {
+      total += shard_[s].TotalCharge();
+    }
+    return total;
+  }
 };
 
 }  // end anonymous namespace
 
 Cache* NewLRUCache(size_t capacity) {
-  return new ShardedLRUCache(capacity);
+  return new ShardedLRUCache(capacity, 0.0, 0.0);
+}
+
+Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio) {
+  return new ShardedLRUCache(capacity, high_pri_pool_ratio, 0.0);
+}
+
+Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio,
+                   double probation_ratio) {
+  return new ShardedLRUCache(capacity, high_pri_pool_ratio, probation_ratio);
 }
 
 }  // namespace leveldb
@@ -5,7 +5,11 @@
 #include "leveldb/cache.h"
 
 #include <vector>
+#include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -54,9 +58,10 @@ class CacheTest {
     return r;
   }
 
-  void Insert(int key, int value, int charge = 1) {
+  void Insert(int key, int value, int charge = 1,
+              Cache::Priority priority = Cache::kLowPriority) {
     cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
-                                   &CacheTest::Deleter));
+                                   &CacheTest::Deleter, priority));
   }
 
   void Erase(int key) {
@@ -173,14 +178,375 @@ TEST(CacheTest, HeavyEntries) {
   ASSERT_LE(cached_weight, kCacheSize + kCacheSize/10);
 }
 
+TEST(CacheTest, HighPriorityPool) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0.5);
+  for (int i = 0; i < 50; i++) {
+    Insert(i, 100+i, 1, Cache::kHighPriority);
+  }
+
+  // A stream of low priority entries far larger than the cache does not
+  // displace them
+  for (int i = 0; i < 10*kCacheSize; i++) {
+    Insert(1000+i, 2000+i);
+  }
+  for (int i = 0; i < 50; i++) {
+    ASSERT_EQ(100+i, Lookup(i));
+  }
+  ASSERT_LE(cache_->TotalCharge(), kCacheSize + kCacheSize/10);
+}
+
+TEST(CacheTest, HighPriorityPoolIsBounded) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0.5);
+  for (int i = 0; i < 10*kCacheSize; i++) {
+    Insert(i, 100+i, 1, Cache::kHighPriority);
+  }
+
+  // Entries of high priority beyond the pool are evicted first
+  for (int i = 0; i < 50; i++) {
+    Insert(100000+i, 200000+i);
+  }
+  for (int i = 0; i < 50; i++) {
+    ASSERT_EQ(200000+i, Lookup(100000+i));
+  }
+  ASSERT_EQ(-1, Lookup(0));
+}
+
+TEST(CacheTest, PriorityWithoutPool) {
+  for (int i = 0; i < 50; i++) {
+    Insert(i, 100+i, 1, Cache::kHighPriority);
+  }
+  for (int i = 0; i < 10*kCacheSize; i++) {
+    Insert(1000+i, 2000+i);
+  }
+  for (int i = 0; i < 50; i++) {
+    ASSERT_EQ(-1, Lookup(i));
+  }
+}
+
+TEST(CacheTest, TotalCharge) {
+  Insert(100, 101, 3);
+  Insert(200, 201, 5);
+  ASSERT_EQ(8, cache_->TotalCharge());
+
+  // Entries still referenced count until they are released
+  Cache::Handle* h = cache_->Lookup(EncodeKey(100));
+  Erase(100);
+  ASSERT_EQ(8, cache_->TotalCharge());
+  cache_->Release(h);
+  ASSERT_EQ(5, cache_->TotalCharge());
+}
+
+TEST(CacheTest, MidpointInsertion) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0.0, 0.5);
+  for (int i = 0; i < 50; i++) {
+    Insert(i, 100+i);
+    ASSERT_EQ(100+i, Lookup(i));
+  }
+
+  // A scan of entries that are never read again only evicts entries on
+  // probation
+  for (int i = 0; i < 10*kCacheSize; i++) {
+    Insert(1000+i, 2000+i);
+  }
+  for (int i = 0; i < 50; i++) {
+    ASSERT_EQ(100+i, Lookup(i));
+  }
+  ASSERT_EQ(-1, Lookup(1000));
+}
+
+TEST(CacheTest, EntriesNeedSecondHit) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0.0, 0.5);
+  for (int i = 0; i < 50; i++) {
+    Insert(i, 100+i);
+  }
+  for (int i = 0; i < 10*kCacheSize; i++) {
+    Insert(1000+i, 2000+i);
+  }
+  for (int i = 0; i < 50; i++) {
+    ASSERT_EQ(-1, Lookup(i));
+  }
+}
+
+TEST(CacheTest, HotSegmentIsBounded) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0.0, 0.5);
+  for (int i = 0; i < 10*kCacheSize; i++) {
+    Insert(i, 100+i);
+    Lookup(i);
+  }
+
+  // Entries that were read once fall back into probation, so new entries
+  // still find room there
+  for (int i = 0; i < 50; i++) {
+    Insert(100000+i, 200000+i);
+  }
+  for (int i = 0; i < 50; i++) {
+    ASSERT_EQ(200000+i, Lookup(100000+i));
+  }
+  ASSERT_EQ(-1, Lookup(0));
+}
+
 TEST(CacheTest, NewId) {
   uint64_t a = cache_->NewId();
   uint64_t b = cache_->NewId();
   ASSERT_NE(a, b);
 }
 
+class ClockCacheTest : public CacheTest {
+ public:
+  ClockCacheTest() {
+    delete cache_;
+    cache_ = NewClockCache(kCacheSize, 1);
+  }
+};
+
+TEST(ClockCacheTest, ClockHitAndMiss) {
+  ASSERT_EQ(-1, Lookup(100));
+
+  Insert(100, 101);
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1,  Lookup(200));
+
+  Insert(200, 201);
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+
+  Insert(100, 102);
+  ASSERT_EQ(102, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(100, deleted_keys_[0]);
+  ASSERT_EQ(101, deleted_values_[0]);
+
+  Erase(200);
+  ASSERT_EQ(-1, Lookup(200));
+  ASSERT_EQ(2, deleted_keys_.size());
+}
+
+TEST(ClockCacheTest, ClockEntriesArePinned) {
+  Insert(100, 101);
+  Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
+
+  Insert(100, 102);
+  Cache::Handle* h2 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(102, DecodeValue(cache_->Value(h2)));
+  ASSERT_EQ(0, deleted_keys_.size());
+
+  cache_->Release(h1);
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(101, deleted_values_[0]);
+
+  Erase(100);
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(1, deleted_keys_.size());
+
+  cache_->Release(h2);
+  ASSERT_EQ(2, deleted_keys_.size());
+  ASSERT_EQ(102, deleted_values_[1]);
+}
+
+TEST(ClockCacheTest, ClockEvictionPolicy) {
+  Insert(100, 101);
+  Insert(200, 201);
+
+  // An entry looked up before the clock hand comes around is kept
+  for (int i = 0; i < kCacheSize + 100; i++) {
+    Insert(1000+i, 2000+i);
+    ASSERT_EQ(2000+i, Lookup(1000+i));
+    ASSERT_EQ(101, Lookup(100));
+  }
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1, Lookup(200));
+}
+
+TEST(ClockCacheTest, ClockHeavyEntries) {
+  const int kLight = 1;
+  const int kHeavy = 10;
+  int added = 0;
+  int index = 0;
+  while (added < 2*kCacheSize) {
+    const int weight = (index & 1) ? kLight : kHeavy;
+    Insert(index, 1000+index, weight);
+    added += weight;
+    index++;
+  }
+
+  int cached_weight = 0;
+  for (int i = 0; i < index; i++) {
+    const int weight = (i & 1 ? kLight : kHeavy);
+    int r = Lookup(i);
+    if (r >= 0) {
+      cached_weight += weight;
+      ASSERT_EQ(1000+i, r);
+    }
+  }
+  ASSERT_LE(cached_weight, kCacheSize + kCacheSize/10);
+  ASSERT_EQ(cached_weight, cache_->TotalCharge());
+}
+
+TEST(ClockCacheTest, ClockTableFull) {
+  // Room for many more entries than the table has slots for
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, kCacheSize);
+  std::vector<Cache::Handle*> handles;
+  for (int i = 0; i < 10*kCacheSize; i++) {
+    handles.push_back(cache_->Insert(EncodeKey(i), EncodeValue(100+i), 1,
+                                     &CacheTest::Deleter));
+  }
+
+  // Entries that found no free slot are still handed out
+  for (int i = 0; i < 10*kCacheSize; i++) {
+    ASSERT_EQ(100+i, DecodeValue(cache_->Value(handles[i])));
+  }
+  ASSERT_EQ(10*kCacheSize, cache_->TotalCharge());
+  for (int i = 0; i < 10*kCacheSize; i++) {
+    cache_->Release(handles[i]);
+  }
+  ASSERT_LT(cache_->TotalCharge(), static_cast<size_t>(kCacheSize));
+  ASSERT_EQ(10*kCacheSize, deleted_keys_.size() + cache_->TotalCharge());
+  ASSERT_EQ(-1, Lookup(10*kCacheSize - 1));
+}
+
+namespace {
+
+// Shared by the threads of a concurrent run
+struct ConcurrentState {
+  Cache* cache;
+  int num_keys;
+  int ops_per_thread;
+  bool modify;      // Whether threads also insert and erase
+  port::Mutex mu;
+  port::CondVar cv;
+  int running;      // Protected by mu
+  int inserts;      // Protected by mu
+  int wrong_values; // Protected by mu
+
+  ConcurrentState() : cv(&mu), running(0), inserts(0), wrong_values(0) { }
+};
+
+struct ConcurrentThread {
+  ConcurrentState* state;
+  uint32_t seed;
+};
+
+static port::Mutex deleted_mu;
+static int deleted_count = 0;
+
+static void CountingDeleter(const Slice& key, void* v) {
+  MutexLock l(&deleted_mu);
+  deleted_count++;
+}
+
+static void ConcurrentBody(void* arg) {
+  ConcurrentThread* t = reinterpret_cast<ConcurrentThread*>(arg);
+  ConcurrentState* state = t->state;
+  Random rnd(t->seed);
+  int inserts = 0;
+  int wrong_values = 0;
+  for (int i = 0; i < state->ops_per_thread; i++) {
+    const int k = rnd.Uniform(state->num_keys);
+    const std::string key = EncodeKey(k);
+    if (state->modify && rnd.OneIn(10)) {
+      state->cache->Release(state->cache->Insert(key, EncodeValue(k), 1,
+                                                 &CountingDeleter));
+      inserts++;
+    } else if (state->modify && rnd.OneIn(50)) {
+      state->cache->Erase(key);
+    } else {
+      Cache::Handle* h = state->cache->Lookup(key);
+      if (h != NULL) {
+        if (DecodeValue(state->cache->Value(h)) != k) {
+          wrong_values++;
+        }
+        state->cache->Release(h);
+      }
+    }
+  }
+  MutexLock l(&state->mu);
+  state->inserts += inserts;
+  state->wrong_values += wrong_values;
+  state->running--;
+  state->cv.SignalAll();
+}
+
+// Run "num_threads" threads against state->cache and wait for them
+static void RunConcurrent(ConcurrentState* state, int num_threads) {
+  std::vector<ConcurrentThread> threads(num_threads);
+  state->running = num_threads;
+  for (int i = 0; i < num_threads; i++) {
+    threads[i].state = state;
+    threads[i].seed = 301 + i;
+    Env::Default()->StartThread(ConcurrentBody, &threads[i]);
+  }
+  MutexLock l(&state->mu);
+  while (state->running > 0) {
+    state->cv.Wait();
+  }
+}
+
+}  // namespace
+
+TEST(ClockCacheTest, ClockConcurrentUse) {
+  // Every entry is deleted exactly once, and lookups never see the
+  // value of another key
+  deleted_count = 0;
+  ConcurrentState state;
+  state.cache = NewClockCache(200, 1);
+  state.num_keys = 1000;
+  state.ops_per_thread = 200000;
+  state.modify = true;
+  RunConcurrent(&state, 8);
+  ASSERT_EQ(0, state.wrong_values);
+  delete state.cache;
+  ASSERT_EQ(state.inserts, deleted_count);
+}
+
+// Time lookups of cached entries from "num_threads" threads.  "cache"
+// must have room for 10000 entries of charge 1.
+static void BM_CacheLookup(const char* name, Cache* cache, int num_threads) {
+  const int kNumKeys = 10000;
+  for (int i = 0; i < kNumKeys; i++) {
+    cache->Release(cache->Insert(EncodeKey(i), EncodeValue(i), 1,
+                                 &CountingDeleter));
+  }
+  ConcurrentState state;
+  state.cache = cache;
+  state.num_keys = kNumKeys;
+  state.ops_per_thread = 1000000;
+  state.modify = false;
+
+  Env* env = Env::Default();
+  uint64_t start_micros = env->NowMicros();
+  RunConcurrent(&state, num_threads);
+  uint64_t stop_micros = env->NowMicros();
+  const double total_ops = static_cast<double>(state.ops_per_thread) *
+                           num_threads;
+  fprintf(stderr,
+          "BM_CacheLookup/%-5s %2d threads : %9u us (%7.1f ns / op)\n",
+          name, num_threads, static_cast<unsigned>(stop_micros - start_micros),
+          (stop_micros - start_micros) * 1000.0 / total_ops);
+  delete cache;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+    const int kThreads[] = { 1, 4, 16 };
+    for (int i = 0; i < 3; i++) {
+      leveldb::BM_CacheLookup("lru", leveldb::NewLRUCache(20000),
+                              kThreads[i]);
+      leveldb::BM_CacheLookup("clock", leveldb::NewClockCache(20000, 1),
+                              kThreads[i]);
+    }
+    return 0;
+  }
+
   return leveldb::test::RunAllTests();
 }
@@ -0,0 +1,421 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A cache using the CLOCK eviction policy.  Each shard keeps its entries
+// in a fixed size open-addressed table.  The reference count, a clock
+// bit and the state of an entry are packed in a single word that is
+// only changed with atomic operations, so Lookup and Release need no
+// lock.  Insert, Erase and eviction hold the shard's mutex, which
+// serializes everything that fills or clears a slot.
+//
+// A slot moves through these states:
+//   kEmpty:     Free.  Only changed under the mutex.
+//   kBusy:      Owned by the thread holding the mutex, while it fills or
+//               clears the slot.
+//   kVisible:   In the table.  Lookup may take references to it.
+//   kInvisible: Erased or replaced while still referenced.  The thread
+//               that drops the last reference frees it.
+// Lookup only takes a reference with a compare-and-swap from kVisible,
+// and eviction and Erase only take a slot with a compare-and-swap from
+// kVisible without references, so exactly one thread ends up freeing
+// each entry.
+//
+// Linear probing needs to find entries past slots that were cleared
+// since they were inserted, so each slot counts the entries in the
+// table that probed past it.  A lookup stops at the first slot with a
+// count of zero.
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "leveldb/cache.h"
+#include "port/port.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+// The atomic operations below are gcc builtins (also provided by clang
+// and icc); they imply a full memory barrier.
+
+// Layout of ClockHandle::meta
+static const uint64_t kRefsMask = 0xffffffffull;
+static const uint64_t kClockBit = 1ull << 32;
+static const int kStateShift = 33;
+static const uint64_t kStateMask = 3ull << kStateShift;
+static const uint64_t kEmpty = 0ull << kStateShift;
+static const uint64_t kBusy = 1ull << kStateShift;
+static const uint64_t kVisible = 2ull << kStateShift;
+static const uint64_t kInvisible = 3ull << kStateShift;
+
+struct ClockHandle {
+  volatile uint64_t meta;
+  volatile uint32_t displacements;  // Entries that probed past this slot
+  uint32_t hash;
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  size_t charge;
+  char* key_data;
+  size_t key_length;
+  bool detached;      // Not in the table; deleted when released
+
+  Slice key() const {
+    return Slice(key_data, key_length);
+  }
+};
+
+static inline uint64_t StateOf(uint64_t meta) {
+  return meta & kStateMask;
+}
+
+static inline uint64_t RefsOf(uint64_t meta) {
+  return meta & kRefsMask;
+}
+
+// A single shard of sharded cache.
+class ClockCache {
+ public:
+  ClockCache();
+  ~ClockCache();
+
+  // Separate from constructor so caller can easily make an array of
+  // ClockCache
+  void SetCapacity(size_t capacity, size_t estimated_entry_charge);
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash,
+                        void* value, size_t charge,
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  size_t TotalCharge() const {
+    MutexLock l(&mutex_);
+    return usage_;
+  }
+
+ private:
+  void Unref(ClockHandle* e);
+  ClockHandle* FindVisible(const Slice& key, uint32_t hash);
+  void Invalidate(ClockHandle* e);
+  void EvictFor(size_t charge);
+  void Free(ClockHandle* e);
+
+  // Initialized before use.
+  size_t capacity_;
+  ClockHandle* table_;
+  uint32_t mask_;             // Number of slots - 1
+  uint32_t max_occupancy_;
+
+  // mutex_ serializes all changes of slots that are not kVisible, and
+  // protects the following state.  Slots that are kVisible only change
+  // their references and clock bit without it.
+  mutable port::Mutex mutex_;
+  size_t usage_;              // Including entries that are kInvisible
+  uint32_t occupancy_;        // Slots that are not kEmpty
+  uint32_t clock_hand_;
+};
+
+ClockCache::ClockCache()
+    : table_(NULL),
+      mask_(0),
+      usage_(0),
+      occupancy_(0),
+      clock_hand_(0) {
+}
+
+ClockCache::~ClockCache() {
+  for (uint32_t i = 0; table_ != NULL && i <= mask_; i++) {
+    ClockHandle* e = &table_[i];
+    if (StateOf(e->meta) != kEmpty) {
+      // Error if caller has an unreleased handle
+      assert(StateOf(e->meta) == kVisible && RefsOf(e->meta) == 0);
+      (*e->deleter)(e->key(), e->value);
+      free(e->key_data);
+    }
+  }
+  delete[] table_;
+}
+
+void ClockCache::SetCapacity(size_t capacity,
+                             size_t estimated_entry_charge) {
+  capacity_ = capacity;
+  // Keep the table at most half full for the expected number of
+  // entries, and evict once it is three quarters full.
+  size_t expected = capacity / (estimated_entry_charge > 0 ?
+                                estimated_entry_charge : 1);
+  uint32_t slots = 16;
+  while (slots < 2 * expected && slots < (1u << 30)) {
+    slots *= 2;
+  }
+  table_ = new ClockHandle[slots];
+  memset(table_, 0, sizeof(ClockHandle) * slots);
+  mask_ = slots - 1;
+  max_occupancy_ = slots - slots / 4;
+}
+
+Cache::Handle* ClockCache::Lookup(const Slice& key, uint32_t hash) {
+  uint32_t i = hash & mask_;
+  for (uint32_t probes = 0; probes <= mask_; probes++) {
+    ClockHandle* e = &table_[i];
+    uint64_t meta = e->meta;
+    while (StateOf(meta) == kVisible) {
+      const uint64_t prev = __sync_val_compare_and_swap(&e->meta, meta,
+                                                        meta + 1);
+      if (prev != meta) {
+        meta = prev;
+        continue;
+      }
+      // The fields of "e" cannot change while we hold a reference
+      if (e->hash == hash && key == e->key()) {
+        if ((meta & kClockBit) == 0) {
+          __sync_fetch_and_or(&e->meta, kClockBit);
+        }
+        return reinterpret_cast<Cache::Handle*>(e);
+      }
+      Unref(e);
+      break;
+    }
+    if (e->displacements == 0) {
+      break;
+    }
+    i = (i + 1) & mask_;
+  }
+  return NULL;
+}
+
+void ClockCache::Unref(ClockHandle* e) {
+  const uint64_t prev = __sync_fetch_and_sub(&e->meta, 1);
+  assert(RefsOf(prev) > 0);
+  if (RefsOf(prev) == 1 && StateOf(prev) == kInvisible) {
+    // Nobody else can reference it any more
+    MutexLock l(&mutex_);
+    Free(e);
+  }
+}
+
+void ClockCache::Release(Cache::Handle* handle) {
+  Unref(reinterpret_cast<ClockHandle*>(handle));
+}
+
+// REQUIRES: mutex_ held
+ClockHandle* ClockCache::FindVisible(const Slice& key, uint32_t hash) {
+  // Visible entries are only freed under mutex_, so their keys can be
+  // read without taking a reference.
+  uint32_t i = hash & mask_;
+  for (uint32_t probes = 0; probes <= mask_; probes++) {
+    ClockHandle* e = &table_[i];
+    if (StateOf(e->meta) == kVisible && e->hash == hash && key == e->key()) {
+      return e;
+    }
+    if (e->displacements == 0) {
+      break;
+    }
+    i = (i + 1) & mask_;
+  }
+  return NULL;
+}
+
+// Remove "e" from the table; free it now or once its last reference is
+// released.
+// REQUIRES: mutex_ held
+void ClockCache::Invalidate(ClockHandle* e) {
+  uint64_t meta = e->meta;
+  while (StateOf(meta) == kVisible) {
+    const uint64_t next = (RefsOf(meta) == 0) ? kBusy :
+                          ((meta & ~kStateMask) | kInvisible);
+    const uint64_t prev = __sync_val_compare_and_swap(&e->meta, meta, next);
+    if (prev == meta) {
+      if (next == kBusy) {
+        Free(e);
+      }
+      return;
+    }
+    meta = prev;
+  }
+}
+
+// Evict unreferenced entries until "charge" fits and a slot is free, or
+// until every entry had a chance.  Entries that were looked up since the
+// hand last passed them get another round.
+// REQUIRES: mutex_ held
+void ClockCache::EvictFor(size_t charge) {
+  const uint32_t max_steps = 2 * (mask_ + 1);
+  for (uint32_t steps = 0;
+       steps < max_steps &&
+       (usage_ + charge > capacity_ || occupancy_ >= max_occupancy_);
+       steps++) {
+    ClockHandle* e = &table_[clock_hand_];
+    clock_hand_ = (clock_hand_ + 1) & mask_;
+    const uint64_t meta = e->meta;
+    if (StateOf(meta) != kVisible || RefsOf(meta) != 0) {
+      continue;
+    }
+    if (meta & kClockBit) {
+      // Fails harmlessly if someone takes a reference meanwhile
+      __sync_bool_compare_and_swap(&e->meta, meta, meta & ~kClockBit);
+    } else if (__sync_bool_compare_and_swap(&e->meta, meta, kBusy)) {
+      Free(e);
+    }
+  }
+}
+
+// REQUIRES: mutex_ held, and no references to "e" are left
+void ClockCache::Free(ClockHandle* e) {
+  (*e->deleter)(e->key(), e->value);
+  free(e->key_data);
+  usage_ -= e->charge;
+  if (e->detached) {
+    delete e;
+    return;
+  }
+  const uint32_t slot = static_cast<uint32_t>(e - table_);
+  for (uint32_t i = e->hash & mask_; i != slot; i = (i + 1) & mask_) {
+    __sync_fetch_and_sub(&table_[i].displacements, 1);
+  }
+  occupancy_--;
+  __sync_synchronize();
+  e->meta = kEmpty;
+}
+
+Cache::Handle* ClockCache::Insert(
+    const Slice& key, uint32_t hash, void* value, size_t charge,
+    void (*deleter)(const Slice& key, void* value),
+    Cache::Priority priority) {
+  MutexLock l(&mutex_);
+
+  ClockHandle* old = FindVisible(key, hash);
+  if (old != NULL) {
+    Invalidate(old);
+  }
+  EvictFor(charge);
+
+  ClockHandle* e = NULL;
+  if (occupancy_ < max_occupancy_) {
+    uint32_t i = hash & mask_;
+    while (StateOf(table_[i].meta) != kEmpty) {
+      __sync_fetch_and_add(&table_[i].displacements, 1);
+      i = (i + 1) & mask_;
+    }
+    e = &table_[i];
+    e->meta = kBusy;
+    e->detached = false;
+    occupancy_++;
+  } else {
+    // Every slot is referenced.  Hand out an entry that is not cached,
+    // as if it was evicted right away.
+    e = new ClockHandle;
+    e->meta = kBusy;
+    e->displacements = 0;
+    e->detached = true;
+  }
+  e->hash = hash;
+  e->value = value;
+  e->deleter = deleter;
+  e->charge = charge;
+  e->key_length = key.size();
+  e->key_data = reinterpret_cast<char*>(malloc(key.size() > 0 ?
+                                               key.size() : 1));
+  memcpy(e->key_data, key.data(), key.size());
+  usage_ += charge;
+
+  // One reference for the returned handle.  Entries of high priority
+  // start with their clock bit set, so they survive one more round.
+  uint64_t meta = 1 | (e->detached ? kInvisible : kVisible);
+  if (priority == Cache::kHighPriority) {
+    meta |= kClockBit;
+  }
+  __sync_synchronize();
+  e->meta = meta;
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void ClockCache::Erase(const Slice& key, uint32_t hash) {
+  MutexLock l(&mutex_);
+  ClockHandle* e = FindVisible(key, hash);
+  if (e != NULL) {
+    Invalidate(e);
+  }
+}
+
+static const int kNumShardBits = 4;
+static const int kNumShards = 1 << kNumShardBits;
+
+class ShardedClockCache : public Cache {
+ private:
+  ClockCache shard_[kNumShards];
+  port::Mutex id_mutex_;
+  uint64_t last_id_;
+
+  static inline uint32_t HashSlice(const Slice& s) {
+    return Hash(s.data(), s.size(), 0);
+  }
+
+  static uint32_t Shard(uint32_t hash) {
+    return hash >> (32 - kNumShardBits);
+  }
+
+ public:
+  ShardedClockCache(size_t capacity, size_t estimated_entry_charge)
+      : last_id_(0) {
+    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
+    for (int s = 0; s < kNumShards; s++) {
+      shard_[s].SetCapacity(per_shard, estimated_entry_charge);
+    }
+  }
+  virtual ~ShardedClockCache() { }
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value)) {
+    return Insert(key, value, charge, deleter, kLowPriority);
+  }
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority) {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
+  }
+  virtual Handle* Lookup(const Slice& key) {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Lookup(key, hash);
+  }
+  virtual void Release(Handle* handle) {
+    ClockHandle* h = reinterpret_cast<ClockHandle*>(handle);
+    shard_[Shard(h->hash)].Release(handle);
+  }
+  virtual void Erase(const Slice& key) {
+    const uint32_t hash = HashSlice(key);
+    shard_[Shard(hash)].Erase(key, hash);
+  }
+  virtual void* Value(Handle* handle) {
+    return reinterpret_cast<ClockHandle*>(handle)->value;
+  }
+  virtual uint64_t NewId() {
+    MutexLock l(&id_mutex_);
+    return ++(last_id_);
+  }
+  virtual size_t TotalCharge() const {
+    size_t total = 0;
+    for (int s = 0; s < kNumShards; s++) {
+      total += shard_[s].TotalCharge();
+    }
+    return total;
+  }
+};
+
+}  // end anonymous namespace
+
+Cache* NewClockCache(size_t capacity) {
+  return new ShardedClockCache(capacity, 4096);
+}
+
+Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge) {
+  return new ShardedClockCache(capacity, estimated_entry_charge);
+}
+
+}  // namespace leveldb
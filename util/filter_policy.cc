@@ -8,4 +8,9 @@ namespace leveldb {
 
 FilterPolicy::~FilterPolicy() { }
 
+bool FilterPolicy::PrefixMayMatch(const Slice& key,
+                                  const Slice& filter) const {
+  return true;
+}
+
 }  // namespace leveldb
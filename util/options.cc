@@ -19,10 +19,36 @@ Options::Options()
       write_buffer_size(4<<20),
       max_open_files(1000),
       block_cache(NULL),
+      cache_index_and_filter_blocks(false),
+      pin_l0_filter_and_index_blocks_in_cache(false),
       block_size(4096),
       block_restart_interval(16),
       compression(kSnappyCompression),
-      filter_policy(NULL) {
+      filter_policy(NULL),
+      prefix_extractor(NULL),
+      whole_table_filter(false),
+      data_block_hash_index(false),
+      index_partition_size(0),
+      compaction_filter(NULL),
+      max_sequential_skip_in_iterations(8),
+      level0_file_num_compaction_trigger(4),
+      level0_slowdown_writes_trigger(8),
+      level0_stop_writes_trigger(12),
+      max_mem_compact_level(2),
+      target_file_size_base(2 * 1048576),
+      target_file_size_multiplier(1),
+      max_grandparent_overlap_factor(10),
+      expanded_compaction_factor(25),
+      max_bytes_for_level_base(10 * 1048576),
+      max_bytes_for_level_multiplier(10),
+      deletion_compaction_ratio(0),
+      deletion_compaction_min_entries(1000),
+      max_subcompactions(1),
+      dynamic_level_bytes(false),
+      compaction_style(kCompactionStyleLevel),
+      universal_size_ratio(1),
+      universal_min_merge_width(2),
+      universal_max_size_amplification_percent(200) {
 }
 
 
@@ -0,0 +1,221 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Ribbon filter ("Ribbon filter: practically smarter than Bloom",
+// Dillinger and Walzer 2021) stores an r-bit fingerprint per key in about
+// r * 1.08 bits, against the ~1.44 * r bits a bloom filter needs for the
+// same false positive rate of 2^-r.
+//
+// Each key maps to a start slot s, a 64-bit coefficient row c and an
+// r-bit fingerprint f.  Building solves the linear system over GF(2)
+// that makes the XOR of the r-bit solution values of the slots
+// s + i, for every bit i set in c, equal f for every key.  A lookup
+// recomputes that XOR and compares it with the key's fingerprint.
+
+#include "leveldb/filter_policy.h"
+
+#include <vector>
+#include "leveldb/slice.h"
+#include "util/coding.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+static const int kBandWidth = 64;           // Width of a coefficient row
+static const int kMaxSeeds = 4;             // Attempts before growing
+static const uint32_t kMaxFingerprintBits = 16;
+static const size_t kTrailerSize = 6;       // num_blocks, seed, bits
+
+// Finalizer of splitmix64: spreads a value over all 64 bits
+static uint64_t Mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  x ^= x >> 31;
+  return x;
+}
+
+static int Parity64(uint64_t x) {
+  x ^= x >> 32;
+  x ^= x >> 16;
+  x ^= x >> 8;
+  x ^= x >> 4;
+  return (0x6996 >> (x & 0xf)) & 1;
+}
+
+// The equation a key contributes for a given seed
+struct RibbonRow {
+  size_t start;
+  uint64_t coeff;      // Bit i stands for slot start + i; bit 0 is set
+  uint32_t result;     // Fingerprint
+};
+
+static void ComputeRow(uint32_t key_hash, uint32_t seed, size_t num_slots,
+                       uint32_t bits, RibbonRow* row) {
+  const uint64_t a = Mix64(key_hash + seed * 0x9e3779b97f4a7c15ull);
+  const uint64_t b = Mix64(a ^ 0x2545f4914f6cdd1dull);
+  const uint64_t num_starts = num_slots - kBandWidth + 1;
+  row->start = static_cast<size_t>(((a >> 32) * num_starts) >> 32);
+  row->coeff = b | 1;
+  row->result = static_cast<uint32_t>(a) & ((1u << bits) - 1);
+}
+
+class RibbonFilterPolicy : public FilterPolicy {
+ private:
+  uint32_t bits_;  // Fingerprint bits per key
+
+  // Solve for "hashes" in "num_slots" slots with the given seed.  On
+  // success, append the solution to *dst and return true.
+  bool Build(const std::vector<uint32_t>& hashes, size_t num_slots,
+             uint32_t seed, std::string* dst) const {
+    // Gaussian elimination as rows arrive: each slot keeps at most one
+    // row, whose lowest set coefficient bit is that slot.
+    std::vector<uint64_t> coeffs(num_slots, 0);
+    std::vector<uint32_t> results(num_slots, 0);
+    for (size_t i = 0; i < hashes.size(); i++) {
+      RibbonRow row;
+      ComputeRow(hashes[i], seed, num_slots, bits_, &row);
+      size_t s = row.start;
+      uint64_t c = row.coeff;
+      uint32_t r = row.result;
+      while (true) {
+        if (coeffs[s] == 0) {
+          coeffs[s] = c;
+          results[s] = r;
+          break;
+        }
+        c ^= coeffs[s];
+        r ^= results[s];
+        if (c == 0) {
+          if (r != 0) {
+            return false;  // Inconsistent; try another seed
+          }
+          break;  // Duplicate key
+        }
+        while ((c & 1) == 0) {
+          c >>= 1;
+          s++;
+        }
+      }
+    }
+
+    // Back substitution from the last slot, keeping the solution bits of
+    // the next kBandWidth slots of each column in a window.  Bit 0 of
+    // window[b] is bit b of the value of the slot last solved.
+    const size_t num_blocks = num_slots / kBandWidth;
+    std::vector<uint64_t> window(bits_, 0);
+    std::vector<uint64_t> words(num_blocks * bits_, 0);
+    for (size_t i = num_slots; i-- > 0; ) {
+      const uint64_t c = coeffs[i];
+      const uint32_t r = results[i];
+      for (uint32_t b = 0; b < bits_; b++) {
+        uint64_t bit = 0;
+        if (c != 0) {
+          bit = ((r >> b) & 1) ^ Parity64((c >> 1) & window[b]);
+        }
+        window[b] = (window[b] << 1) | bit;
+        if (i % kBandWidth == 0) {
+          // The window holds exactly the slots of block i / kBandWidth
+          words[(i / kBandWidth) * bits_ + b] = window[b];
+        }
+      }
+    }
+
+    for (size_t i = 0; i < words.size(); i++) {
+      PutFixed64(dst, words[i]);
+    }
+    PutFixed32(dst, static_cast<uint32_t>(num_blocks));
+    dst->push_back(static_cast<char>(seed));
+    dst->push_back(static_cast<char>(bits_));
+    return true;
+  }
+
+ public:
+  explicit RibbonFilterPolicy(int bits_per_key) {
+    // Match the false positive rate of a bloom filter with as many bits
+    // per key: 2^-r =~ 0.6185^bits_per_key
+    bits_ = static_cast<uint32_t>(bits_per_key * 0.69 + 0.5);
+    if (bits_ < 1) bits_ = 1;
+    if (bits_ > kMaxFingerprintBits) bits_ = kMaxFingerprintBits;
+  }
+
+  virtual const char* Name() const {
+    return "leveldb.RibbonFilter";
+  }
+
+  virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const {
+    if (n == 0) {
+      // No slots at all, so nothing matches
+      PutFixed32(dst, 0);
+      dst->push_back(0);
+      dst->push_back(static_cast<char>(bits_));
+      return;
+    }
+
+    std::vector<uint32_t> hashes(n);
+    for (int i = 0; i < n; i++) {
+      hashes[i] = Hash(keys[i].data(), keys[i].size(), 0xbc9f1d34);
+    }
+
+    // With 8% more slots than keys, construction nearly always succeeds
+    // with the first or second seed.  Grow the filter if it keeps
+    // failing.
+    size_t num_slots = static_cast<size_t>(n * 1.08);
+    if (num_slots < kBandWidth) num_slots = kBandWidth;
+    const size_t init_size = dst->size();
+    while (true) {
+      num_slots = (num_slots + kBandWidth - 1) / kBandWidth * kBandWidth;
+      for (uint32_t seed = 0; seed < kMaxSeeds; seed++) {
+        if (Build(hashes, num_slots, seed, dst)) {
+          return;
+        }
+        dst->resize(init_size);
+      }
+      num_slots += num_slots / 10;
+    }
+  }
+
+  virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const {
+    const size_t len = filter.size();
+    if (len < kTrailerSize) return false;
+    const char* trailer = filter.data() + len - kTrailerSize;
+    const size_t num_blocks = DecodeFixed32(trailer);
+    const uint32_t seed = static_cast<unsigned char>(trailer[4]);
+    const uint32_t bits = static_cast<unsigned char>(trailer[5]);
+    if (bits == 0 || bits > kMaxFingerprintBits ||
+        len != num_blocks * bits * 8 + kTrailerSize) {
+      // Not an encoding we know.  Consider it a match.
+      return true;
+    }
+    if (num_blocks == 0) return false;
+
+    RibbonRow row;
+    ComputeRow(Hash(key.data(), key.size(), 0xbc9f1d34), seed,
+               num_blocks * kBandWidth, bits, &row);
+    const size_t block = row.start / kBandWidth;
+    const size_t shift = row.start % kBandWidth;
+    const char* lo = filter.data() + block * bits * 8;
+    const char* hi = lo + bits * 8;  // Only read if shift > 0
+    uint32_t result = 0;
+    for (uint32_t b = 0; b < bits; b++) {
+      uint64_t slots = DecodeFixed64(lo + b * 8) >> shift;
+      if (shift > 0) {
+        slots |= DecodeFixed64(hi + b * 8) << (kBandWidth - shift);
+      }
+      result |= static_cast<uint32_t>(Parity64(row.coeff & slots)) << b;
+    }
+    return result == row.result;
+  }
+};
+
+}  // namespace
+
+const FilterPolicy* NewRibbonFilterPolicy(int bits_per_key) {
+  return new RibbonFilterPolicy(bits_per_key);
+}
+
+}  // namespace leveldb